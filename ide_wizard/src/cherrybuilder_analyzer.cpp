@@ -30,6 +30,10 @@
 
 #include "cherrybuilder_analyzer.h"
 
+#include <System.StrUtils.hpp>
+
+#include <algorithm>
+
 #include "cherrybuilder_debugtools.h"
 //---------------------------------------------------------------------------
 
@@ -37,6 +41,26 @@
 
 namespace Cherrybuilder
 {
+
+// The interval (ms) of checking for an idle pipeline while there's indexing work
+const unsigned int kIndexPollInterval = 250;
+
+// The intervals (ms) of sampling the debugger state and the CPU load, and of checking the
+// deferred work while the user is busy
+const unsigned int kBusySampleInterval  = 1000;
+const unsigned int kBusyPollInterval    = 1000;
+
+// The CPU load (percent) has to drop this far below the maximum to end a contention (as our
+// own tagging adds to the load)
+const int kCpuLoadHysteresis = 20;
+//---------------------------------------------------------------------------
+
+static unsigned __int64 FileTimeToUInt64(const FILETIME& Time)
+{
+    return (static_cast<unsigned __int64>(Time.dwHighDateTime) << 32) | Time.dwLowDateTime;
+}
+//---------------------------------------------------------------------------
+
 __fastcall TChBldAnalyzer::TChBldAnalyzer(
     TMemIniFile* SettingsINI,
     const String& CtagsExePath,
@@ -49,7 +73,37 @@ __fastcall TChBldAnalyzer::TChBldAnalyzer(
         FProjectDB(ProjectDB),
         FScanningMutex(new TMutex(false)),
         FFullUpdate(false),
-        FUpdateSettings(false)
+        FUpdateSettings(false),
+        FBuildVariant(L""),
+        FActiveEditorFile(L""),
+        FProjectOpenTicks(0),
+        FIndexTotal(0),
+        FIndexDone(0),
+        FIndexStartTicks(0),
+        FBuildMutex(new TMutex(false)),
+        FBuildInProgress(false),
+        FDebugging(false),
+        FCpuLoad(0),
+        FCpuIdleTime(0),
+        FCpuTotalTime(0),
+        FCpuOwnTime(0),
+        FLastBusySample(0),
+        FBusy(false),
+        FContended(false),
+        FTerminateEvent(new TEvent(NULL, false, false, L"", false)),
+        FProjectEvent(new TEvent(NULL, false, false, L"", false)),
+        FSettingsEvent(new TEvent(NULL, false, false, L"", false)),
+        FEditEvent(new TEvent(NULL, false, false, L"", false)),
+        FBuildEvent(new TEvent(NULL, false, false, L"", false)),
+        FFileWatcher(new TChBldFileWatcher),
+        FPipeline(
+            new TChBldParsePipeline(
+                FCtagsParser,
+                FProjectDB,
+                SettingsINI->ReadInteger(L"CodeAnalyzer", L"TaggingWorkers", 2),
+                SettingsINI->ReadInteger(L"CodeAnalyzer", L"PipelineQueueDepth", 4)
+                )
+            )
 {
     CS_SEND(L"Analyzer::Constructor");
 }
@@ -59,18 +113,29 @@ __fastcall TChBldAnalyzer::~TChBldAnalyzer()
 {
     CS_SEND(L"Analyzer:Destructor");
 
-    // Kill the thread
+    // Kill the thread (and wake it up if it's waiting)
     Terminate();
+    FTerminateEvent->SetEvent();
 
     // Wait for the thread to fully terminate
     WaitFor();
 
+    // Stop the pipeline workers (before the parser and the DB are gone)
+    FPipeline.reset();
+
     // Delete the scanning mutex
     if (FScanningMutex)
     {
         delete FScanningMutex;
         FScanningMutex = NULL;
     }
+
+    // Delete the build mutex
+    if (FBuildMutex)
+    {
+        delete FBuildMutex;
+        FBuildMutex = NULL;
+    }
 }
 //---------------------------------------------------------------------------
 
@@ -81,6 +146,8 @@ void TChBldAnalyzer::FullUpdate()
     TChBldLockGuard LG(FScanningMutex);
 
     FFullUpdate = true;
+
+    FProjectEvent->SetEvent();
 }
 //---------------------------------------------------------------------------
 
@@ -91,6 +158,60 @@ void TChBldAnalyzer::UpdateSettings()
     TChBldLockGuard LG(FScanningMutex);
 
     FUpdateSettings = true;
+
+    FSettingsEvent->SetEvent();
+}
+//---------------------------------------------------------------------------
+
+// Called by the IDE side on each editor keystroke (the contents are synced when the
+// editing pauses for the 'EditQuietPeriod')
+void TChBldAnalyzer::NotifyEdit()
+{
+    FEditEvent->SetEvent();
+}
+//---------------------------------------------------------------------------
+
+// Called by the IDE notifier before and after a build (the background work is held back
+// meanwhile)
+void TChBldAnalyzer::NotifyBuild(bool Building)
+{
+    CS_SEND(L"Analyzer::NotifyBuild(" + String(static_cast<int>(Building)) + L")");
+
+    // Begin of interlock
+    {
+        TChBldLockGuard LG(FBuildMutex);
+
+        FBuildInProgress = Building;
+    }
+    // End of interlock
+
+    FBuildEvent->SetEvent();
+}
+//---------------------------------------------------------------------------
+
+// Called by the debugger notifier when the first debugged process has been created and
+// when the last one has been destroyed
+void TChBldAnalyzer::NotifyDebugging(bool Debugging)
+{
+    CS_SEND(L"Analyzer::NotifyDebugging(" + String(static_cast<int>(Debugging)) + L")");
+
+    // Begin of interlock
+    {
+        TChBldLockGuard LG(FBuildMutex);
+
+        FDebugging = Debugging;
+    }
+    // End of interlock
+
+    FBuildEvent->SetEvent();
+}
+//---------------------------------------------------------------------------
+
+unsigned int TChBldAnalyzer::GetRemainingTime(unsigned int StartTicks, unsigned int Interval)
+{
+    unsigned int Elapsed = GetTickCount() - StartTicks;
+
+    return (Elapsed < Interval) ? (Interval - Elapsed) : 0;
 }
 //---------------------------------------------------------------------------
 
@@ -103,7 +224,24 @@ void __fastcall TChBldAnalyzer::Execute()
 
     unsigned int    LastEditorContentsSync  = GetTickCount();
     unsigned int    LastFullUpdate          = GetTickCount();
+    unsigned int    LastEdit                = GetTickCount();
+    unsigned int    LastIndexScan           = GetTickCount();
+    unsigned int    LastDiskChange          = GetTickCount();
     bool            ContinueFullUpdate      = false;
+    bool            PendingEdit             = false;
+    bool            PendingDiskChange       = false;
+    bool            IndexScanDue            = false;
+
+    // The order defines the priority if more than one event is signaled
+    HANDLE Events[] =
+    {
+        reinterpret_cast<HANDLE>(FTerminateEvent->Handle),
+        reinterpret_cast<HANDLE>(FProjectEvent->Handle),
+        reinterpret_cast<HANDLE>(FSettingsEvent->Handle),
+        reinterpret_cast<HANDLE>(FEditEvent->Handle),
+        reinterpret_cast<HANDLE>(FFileWatcher->ChangeEvent->Handle),
+        reinterpret_cast<HANDLE>(FBuildEvent->Handle)
+    };
 
     // We must update the local settings in the first iteration
     FUpdateSettings = true;
@@ -112,50 +250,110 @@ void __fastcall TChBldAnalyzer::Execute()
     {
         while (!Terminated)
         {
+            bool SettingsPending;
+            bool FullUpdatePending;
+
+            // Take over the pending requests - they're handled outside of the lock, as the
+            // main thread takes it to post them (waiting for the main thread in 'Synchronize'
+            // or for the pipeline while holding it would block the IDE or even deadlock)
             // Begin of interlock
             {
                 TChBldLockGuard LG(FScanningMutex);
 
-                // Handle a possible settings change
-                if (FUpdateSettings)
-                {
-                    FUpdateSettings = false;
+                SettingsPending     = FUpdateSettings;
+                FullUpdatePending   = FFullUpdate;
 
-                    // Update the local settings
-                    Synchronize(&SyncSettings);
-                }
+                FUpdateSettings = false;
+                FFullUpdate     = false;
+            }
+            // End of interlock
+
+            // Handle a possible settings change
+            if (SettingsPending)
+            {
+                // Update the local settings
+                Synchronize(&SyncSettings);
+
+                // Set the size limits of the DB write chunks
+                FProjectDB.WriteChunkRows =
+                    FLocalSettingsINI->ReadInteger(L"CodeAnalyzer", L"WriteChunkRows", 5000);
+
+                FProjectDB.WriteChunkTime =
+                    FLocalSettingsINI->ReadInteger(L"CodeAnalyzer", L"WriteChunkTime", 20);
 
-                // Handle a possible full update
-                if (FFullUpdate)
+                // Set the number of build variant databases kept per project
+                FProjectDB.MaxDBVariants =
+                    FLocalSettingsINI->ReadInteger(L"CodeAnalyzer", L"MaxDBVariants", 4);
+
+                // Set the thresholds of the DB maintenance
+                FProjectDB.CheckpointRows =
+                    FLocalSettingsINI->ReadInteger(L"CodeAnalyzer", L"CheckpointRows", 10000);
+
+                FProjectDB.AnalyzeInterval =
+                    FLocalSettingsINI->ReadInteger(L"CodeAnalyzer", L"AnalyzeInterval", 1800000);
+
+                // Set the query profiling
+                FProjectDB.QueryProfiler->Enabled =
+                    FLocalSettingsINI->ReadBool(L"CodeAnalyzer", L"ProfileQueries", false);
+
+                FProjectDB.QueryProfiler->SlowQueryTime =
+                    FLocalSettingsINI->ReadInteger(L"CodeAnalyzer", L"SlowQueryTime", 50);
+            }
+
+            // Handle a possible full update
+            if (FullUpdatePending)
+            {
+                // The index of the old project context is dropped (and a new one is
+                // scanned after the update)
+                FIndexQueue.clear();
+                IndexScanDue = true;
+
+                // The jobs of the old project context have to be written before
+                // switching it (and the writer must not maintain the DB meanwhile)
+                FPipeline->WaitIdle();
+
+                TChBldLockGuard WG(FPipeline->WriterMutex);
+
+                // (Re)Init the DB with the new project path and build variant
+                Synchronize(&SyncSetProjectPathDB);
+
+                // The snapshots of the old project are dropped (no job uses them anymore)
+                FContentStore.Reset(
+                    FProjectDB.ProjectPath.IsEmpty()
+                        ? String()
+                        : FProjectDB.ProjectPath + L"__chbld\\"
+                    );
+
+                // Stop watching the directories of the old project
+                FFileWatcher->SetDirectories(TChBldWatchDirectories());
+
+                // There must be an open project to...
+                if (!FProjectDB.ProjectPath.IsEmpty())
                 {
-                    FFullUpdate = false;
+                    // ...remove any old temp files
+                    IDE::RemoveOldTempFiles(FProjectDB.ProjectPath);
 
-                    // (Re)Init the DB with the new project path
-                    Synchronize(&SyncSetProjectPathDB);
+                    // ...and do the first synchronization of the editor contents
+                    Synchronize(&SyncEditorsContents);
 
-                    // There must be an open project to...
-                    if (!FProjectDB.ProjectPath.IsEmpty())
-                    {
-                        // ...remove any old temp files
-                        IDE::RemoveOldTempFiles(FProjectDB.ProjectPath);
+                    // Clear all IDE and Project include path entries
+                    IdeIncludePaths.clear();
+                    ProjectIncludePaths.clear();
 
-                        // ...and do the first synchronization of the editor contents
-                        Synchronize(&SyncEditorsContents);
+                    // Get the (possibly new) IDE and Project include paths
+                    IDE::GetCurrentPlatformIncludePaths(IdeIncludePaths);
+                    IDE::GetCurrentPlatformIncludePaths(ProjectIncludePaths, true);
 
-                        // Clear all IDE and Project include path entries
-                        IdeIncludePaths.clear();
-                        ProjectIncludePaths.clear();
+                    // Watch the project for changes made outside of the IDE
+                    WatchProjectDirectories(ProjectIncludePaths);
 
-                        // Get the (possibly new) IDE and Project include paths
-                        IDE::GetCurrentPlatformIncludePaths(IdeIncludePaths);
-                        IDE::GetCurrentPlatformIncludePaths(ProjectIncludePaths, true);
+                    // The time to the first completion in the active file is logged
+                    FProjectOpenTicks = GetTickCount();
 
-                        // Continue the update in the 'unmutexed' section
-                        ContinueFullUpdate = true;
-                    }
+                    // Continue the update in the 'unmutexed' section
+                    ContinueFullUpdate = true;
                 }
             }
-            // End of interlock
 
             if (ContinueFullUpdate)
             {
@@ -166,42 +364,143 @@ void __fastcall TChBldAnalyzer::Execute()
                 FCtagsParser.SetIdeIncludePaths(IdeIncludePaths);
                 FCtagsParser.SetProjectIncludePaths(ProjectIncludePaths);
 
-                VString TempProjectFiles;
-                std::pair<String,   String> ContentFile;
+                // Begin of interlock
+                {
+                    TChBldLockGuard WG(FPipeline->WriterMutex);
+
+                    // The tags of the IDE include paths go to the shared database of the
+                    // platform and compiler family
+                    FProjectDB.SetSDK(
+                        Environment::GetCurrentSettingsFolder()
+                            + kSDKDBFilePrefix
+                            + L"_"
+                            + IDE::GetCurrentPlatform().LowerCase()
+                            + L"_"
+                            + IDE::GetCurrentCompilerFamily()
+                            + L".db",
+                        IdeIncludePaths
+                        );
+
+                    // Load the symbol index of a changed project context or SDK once (the
+                    // writer mustn't refresh it meanwhile)
+                    FProjectDB.LoadSymbolIndex();
+                }
+                // End of interlock
 
-                // Get all relevant project files and assign them to a new string vector
-                // (not the original files but their "temporary brothers")
-                foreach_ (ContentFile, FContentFiles)
-                    TempProjectFiles.push_back(ContentFile.second);
+                // If the database is new or incompatible, it has to be built from scratch...
+                if (FProjectDB.RequiresRebuild)
+                {
+                    VString TempProjectFiles;
+                    std::pair<String,   String> ContentFile;
+
+                    // Get all relevant project files and assign them to a new string vector
+                    // (not the original files but their "temporary brothers")
+                    foreach_ (ContentFile, FContentFiles)
+                        TempProjectFiles.push_back(ContentFile.second);
+
+                    // Parse and add the results to the database
+                    SubmitParseJob(TempProjectFiles, VString(), true, false, FContentFiles);
+                }
+                // ...otherwise only the files which have changed since their tagging are
+                // re-tagged
+                else
+                {
+                    std::map<String, String> StaleFiles;
 
-                Ctags::VTag ParsingResults;
+                    FProjectDB.GetStaleFiles(FContentFiles, StaleFiles);
 
-                // Parse
-                Parse(TempProjectFiles, FContentFiles, ParsingResults);
+                    if (StaleFiles.size() > 0)
+                    {
+                        VString StaleContentFiles;
+                        VString StaleOtherFiles;
+                        std::pair<String, String> StaleFile;
+
+                        // Editor contents are parsed with their includes, other files alone
+                        foreach_ (StaleFile, StaleFiles)
+                        {
+                            if (FContentFiles.count(StaleFile.first) > 0)
+                                StaleContentFiles.push_back(StaleFile.second);
+                            else
+                                StaleOtherFiles.push_back(StaleFile.second);
+                        }
+
+                        // Reparse the stale files and diff the results against the stored
+                        // tags of those files
+                        SubmitParseJob(StaleContentFiles, StaleOtherFiles, false, true, StaleFiles);
+                    }
+                }
 
-                // Add the results to the database
-                FProjectDB.Refresh(ParsingResults, true);
+                FProjectOpenTicks = 0;
 
                 LastFullUpdate = GetTickCount();
             }
 
-            // When the sync time has expired
-            if ((GetTickCount() - LastEditorContentsSync) >
-                static_cast<unsigned int>(
-                    FLocalSettingsINI->ReadInteger(
-                        L"CodeAnalyzer",
-                        L"SyncInterval",
-                        2000
-                        )
-                    )
-                )
+            // The editor contents are synced after an edit when the typing pauses, and
+            // otherwise polled in the sync interval (to catch changes without keystrokes, like
+            // refactorings or file reloads)
+            unsigned int SyncInterval =
+                FLocalSettingsINI->ReadInteger(L"CodeAnalyzer", L"SyncInterval", 2000);
+
+            unsigned int EditQuietPeriod =
+                FLocalSettingsINI->ReadInteger(L"CodeAnalyzer", L"EditQuietPeriod", 300);
+
+            unsigned int DeepRefreshInterval =
+                FLocalSettingsINI->ReadInteger(L"CodeAnalyzer", L"DeepRefreshInterval", 7200000);
+
+            unsigned int WatchQuietPeriod =
+                FLocalSettingsINI->ReadInteger(L"CodeAnalyzer", L"WatchQuietPeriod", 500);
+
+            // The project files are indexed in the background, in small batches and only while
+            // the pipeline is idle and the editing has paused (so an interactive job never has
+            // to wait for more than one batch)
+            unsigned int IndexIdleTime =
+                FLocalSettingsINI->ReadInteger(L"CodeAnalyzer", L"IndexIdleTime", 1000);
+
+            unsigned int IndexRescanInterval =
+                FLocalSettingsINI->ReadInteger(L"CodeAnalyzer", L"IndexRescanInterval", 300000);
+
+            bool HasProject = !FProjectDB.ProjectPath.IsEmpty();
+
+            // The background work which is either running or due (without it there's nothing
+            // the CPU load would have to hold back)
+            bool WorkPending =
+                PendingDiskChange
+                    || !FPipeline->IsIdle()
+                    || (GetRemainingTime(LastFullUpdate, DeepRefreshInterval) == 0)
+                    || (HasProject
+                        && (IndexScanDue
+                            || !FIndexQueue.empty()
+                            || (GetRemainingTime(LastIndexScan, IndexRescanInterval) == 0)));
+
+            // Compiling, debugging, typing or a high CPU load defers the background work
+            // (the deep refresh, the re-tagging of files changed on disk and the indexing)
+            // until the user is idle again
+            UpdateBusyState(LastEdit, WorkPending);
+
+            // When the editing has paused or the sync time has expired
+            if ((PendingEdit && (GetRemainingTime(LastEdit, EditQuietPeriod) == 0))
+                || (GetRemainingTime(LastEditorContentsSync, SyncInterval) == 0))
             {
+                PendingEdit = false;
+
                 // If we have an open project
                 if (!FProjectDB.ProjectPath.IsEmpty())
                 {
                     // Get all of the editor contents
                     Synchronize(&SyncEditorsContents);
 
+                    // Get the build variant of the active configuration
+                    Synchronize(&SyncBuildVariant);
+
+                    // A switch of the platform or configuration selects another database
+                    // (which is kept from the last use of that variant)
+                    if (!FBuildVariant.IsEmpty() && (FBuildVariant != FProjectDB.Variant))
+                    {
+                        CS_SEND(L"Analyzer::Execute(Build variant changed: " + FBuildVariant + L")");
+
+                        FullUpdate();
+                    }
+
                     // If we have changes in the project files
                     if (FChangedContentFiles.size() > 0)
                     {
@@ -212,41 +511,117 @@ void __fastcall TChBldAnalyzer::Execute()
                         foreach_ (ChangedContentFile, FChangedContentFiles)
                             ChangedFiles.push_back(ChangedContentFile.second);
 
-                        Ctags::VTag ParsingResults;
-
-                        // Reparse the changed files
-                        Parse(ChangedFiles, FContentFiles, ParsingResults);
-
-                        // Add the results to the database after deleting everything
-                        // related to those files from the DB
-                        FProjectDB.Refresh(ParsingResults, false, true, &FChangedContentFiles);
+                        // Reparse the changed files, diff the results against the stored
+                        // tags of those files and write only the changed rows to the DB
+                        // (while we're taking the next snapshot)
+                        SubmitParseJob(ChangedFiles, VString(), false, true, FChangedContentFiles);
                     }
                 }
 
                 LastEditorContentsSync = GetTickCount();
             }
             // When the deep refresh time has expired
-            else if ((GetTickCount() - LastFullUpdate) >
-                static_cast<unsigned int>(
-                    FLocalSettingsINI->ReadInteger(
-                        L"CodeAnalyzer",
-                        L"DeepRefreshInterval",
-                        600000
-                        )
-                    )
-                )
+            else if (!FBusy && (GetRemainingTime(LastFullUpdate, DeepRefreshInterval) == 0))
             {
-                // Begin of interlock
+                // Restart the timer here as well (the update doesn't take place without a
+                // project, which would let us wake up again at once)
+                LastFullUpdate = GetTickCount();
+
+                FullUpdate();
+            }
+
+            // The files changed on disk are re-tagged when the changes have settled (e.g.
+            // after a checkout has written all of its files)
+            if (PendingDiskChange
+                && !FBusy
+                && (GetRemainingTime(LastDiskChange, WatchQuietPeriod) == 0))
+            {
+                PendingDiskChange = false;
+
+                if (HasProject)
+                    RetagChangedFiles();
+            }
+
+            if (HasProject
+                && !FBusy
+                && !PendingEdit
+                && (GetRemainingTime(LastEdit, IndexIdleTime) == 0)
+                && FPipeline->IsIdle())
+            {
+                // The timestamps of the project files are checked after each full update and
+                // in the rescan interval
+                if (IndexScanDue
+                    || (FIndexQueue.empty()
+                        && (GetRemainingTime(LastIndexScan, IndexRescanInterval) == 0)))
                 {
-                    TChBldLockGuard LG(FScanningMutex);
+                    IndexScanDue = false;
+
+                    ScanProjectFiles();
 
-                    FFullUpdate = true;
+                    LastIndexScan = GetTickCount();
                 }
-                // End of interlock
+                else if (!FIndexQueue.empty())
+                {
+                    IndexProjectFiles(
+                        FLocalSettingsINI->ReadInteger(L"CodeAnalyzer", L"IndexBatchFiles", 8)
+                        );
+                }
+            }
+
+            // While the user is busy, the deferred work is checked in the poll interval
+            unsigned int DeferredTimeout = FBusy ? kBusyPollInterval : 0;
+
+            // Sleep until an event is signaled or the next sync or deep refresh is due
+            unsigned int Timeout =
+                std::min(
+                    GetRemainingTime(LastEditorContentsSync, SyncInterval),
+                    std::max(GetRemainingTime(LastFullUpdate, DeepRefreshInterval), DeferredTimeout)
+                    );
+
+            if (PendingEdit)
+                Timeout = std::min(Timeout, GetRemainingTime(LastEdit, EditQuietPeriod));
+
+            if (PendingDiskChange)
+            {
+                Timeout =
+                    std::min(
+                        Timeout,
+                        std::max(GetRemainingTime(LastDiskChange, WatchQuietPeriod), DeferredTimeout)
+                        );
             }
 
-            //  Wait ~50 ms to give the OS time to handle it's necessary stuff
-            Sleep(50);
+            // While there's indexing work, we check for an idle pipeline in short intervals
+            if (HasProject)
+            {
+                unsigned int IndexTimeout =
+                    (IndexScanDue || !FIndexQueue.empty())
+                        ? 0
+                        : GetRemainingTime(LastIndexScan, IndexRescanInterval);
+
+                Timeout = std::min(Timeout, std::max(IndexTimeout, kIndexPollInterval));
+            }
+
+            DWORD WaitResult =
+                WaitForMultipleObjects(
+                    sizeof(Events) / sizeof(Events[0]),
+                    Events,
+                    false,
+                    Timeout
+                    );
+
+            // A further edit restarts the quiet period (a project or settings change is
+            // flagged by its setter and handled at the begin of the next iteration)
+            if (WaitResult == (WAIT_OBJECT_0 + 3))
+            {
+                PendingEdit = true;
+                LastEdit = GetTickCount();
+            }
+            // A further change on disk restarts the quiet period of the watcher
+            else if (WaitResult == (WAIT_OBJECT_0 + 4))
+            {
+                PendingDiskChange = true;
+                LastDiskChange = GetTickCount();
+            }
         }
     }
     __finally
@@ -256,71 +631,354 @@ void __fastcall TChBldAnalyzer::Execute()
 }
 //---------------------------------------------------------------------------
 
-void TChBldAnalyzer::Parse(
-    VString& EditorContentFiles,
-    std::map<String, String>& FilenameLookupMap,
-    Ctags::VTag& ParsingResults
+// Hands the files over to the parse pipeline, which writes the results to the DB with the
+// given 'Refresh' options (blocks while the pipeline is full). The file of the active
+// editor gets a job of its own, which is served first.
+void TChBldAnalyzer::SubmitParseJob(
+    const VString& EditorContentFiles,
+    const VString& OtherFiles,
+    bool DeepRefresh,
+    bool DeleteFilesContent,
+    const std::map<String, String>& ContentFiles
     )
 {
-    CS_SEND(L"Analyzer::Parse(Begin)");
-    unsigned int StartTicks = GetTickCount();
-
-    // Clear the parsing results
-    ParsingResults.clear();
-
-    VString IncludeParsingResultFiles;
-
-    // Do a full include file parsing with the files
-    FCtagsParser.FullParseIncludes(EditorContentFiles, IncludeParsingResultFiles);
-
-    String RtlIncludePath =
-        IncludeTrailingPathDelimiter(GetEnvironmentVariable(L"BDSINCLUDE"))
-            + IDE::GetCurrentTargetOS()
-            + L"\\rtl\\";
-
-    // Add some system files to the files list (they are needed but not included automatically)
-    IncludeParsingResultFiles.push_back(String(RtlIncludePath + L"systobj.h").LowerCase());
-    IncludeParsingResultFiles.push_back(String(RtlIncludePath + L"sysclass.h").LowerCase());
-    IncludeParsingResultFiles.push_back(String(RtlIncludePath + L"syscomp.h").LowerCase());
-    IncludeParsingResultFiles.push_back(String(RtlIncludePath + L"syscurr.h").LowerCase());
-    IncludeParsingResultFiles.push_back(String(RtlIncludePath + L"sysdefs.h").LowerCase());
-    IncludeParsingResultFiles.push_back(String(RtlIncludePath + L"sysdyn.h").LowerCase());
-    IncludeParsingResultFiles.push_back(String(RtlIncludePath + L"sysmac.h").LowerCase());
-    IncludeParsingResultFiles.push_back(String(RtlIncludePath + L"sysopen.h").LowerCase());
-    IncludeParsingResultFiles.push_back(String(RtlIncludePath + L"sysset.h").LowerCase());
-    IncludeParsingResultFiles.push_back(String(RtlIncludePath + L"systdate.h").LowerCase());
-
-    // Add the IDE editor content files to the files list
-    foreach_ (String& EditorContentFile, EditorContentFiles)
-        IncludeParsingResultFiles.push_back(EditorContentFile);
-
-    // Do the full tag parsing
-    FCtagsParser.ParseTags(IncludeParsingResultFiles, ParsingResults);
-
-    // Iterate over each tag entry of the parsing results
-    foreach_ (Ctags::TTag& ParsingResult, ParsingResults)
+    String ActiveContentFile =
+        (FContentFiles.count(FActiveEditorFile) > 0) ? FContentFiles[FActiveEditorFile] : String(L"");
+
+    TChBldParseJobPtr ActiveJob(new TChBldParseJob);
+    TChBldParseJobPtr OtherJob(new TChBldParseJob);
+
+    ActiveJob->Priority = ppActiveEditor;
+    OtherJob->Priority  = ppOtherEditors;
+
+    foreach_ (const String& EditorContentFile, EditorContentFiles)
     {
-        std::pair<String, String> FilenameLookup;
+        if (!ActiveContentFile.IsEmpty() && (EditorContentFile == ActiveContentFile))
+            ActiveJob->EditorContentFiles.push_back(EditorContentFile);
+        else
+            OtherJob->EditorContentFiles.push_back(EditorContentFile);
+    }
 
-        // Iterate over each filename lookup name
-        foreach_ (FilenameLookup, FilenameLookupMap)
-        {
-            // Replace double backslashes with only one
-            ParsingResult.File =
-                StringReplace(
-                    ParsingResult.File,
-                    L"\\\\",
-                    L"\\",
-                    TReplaceFlags() << rfReplaceAll
-                    );
+    OtherJob->OtherFiles = OtherFiles;
 
-            // Replace temporary file names with the correct ones
-            if (ParsingResult.File == FilenameLookup.second)
-                ParsingResult.File = FilenameLookup.first;
-        }
+    std::pair<String, String> ContentFile;
+
+    foreach_ (ContentFile, ContentFiles)
+    {
+        if (!ActiveContentFile.IsEmpty() && (ContentFile.first == FActiveEditorFile))
+            ActiveJob->ContentFiles.insert(ContentFile);
+        else
+            OtherJob->ContentFiles.insert(ContentFile);
     }
 
-    CS_SEND(L"Analyzer::Parse(End, " + String(GetTickCount() - StartTicks) + L")");
+    bool HasActiveJob = !ActiveJob->EditorContentFiles.empty();
+
+    bool HasOtherJob =
+        !OtherJob->EditorContentFiles.empty()
+            || !OtherJob->OtherFiles.empty()
+            || !OtherJob->ContentFiles.empty();
+
+    ActiveJob->DeepRefresh          = DeepRefresh;
+    ActiveJob->DeleteFilesContent   = DeleteFilesContent;
+
+    // After a rebuild with the active file, the other files are added to the new database
+    // (diffed against their non-existent tags, so their file records are written as well)
+    OtherJob->DeepRefresh           = DeepRefresh && !HasActiveJob;
+    OtherJob->DeleteFilesContent    = DeleteFilesContent || (DeepRefresh && HasActiveJob);
+
+    ActiveJob->FilenameLookupMap    = FContentFiles;
+    OtherJob->FilenameLookupMap     = FContentFiles;
+
+    ActiveJob->ProjectOpenTicks     = FProjectOpenTicks;
+    OtherJob->ProjectOpenTicks      = FProjectOpenTicks;
+
+    // The jobs keep the current snapshots, so their slot files aren't overwritten before
+    // the jobs are written
+    FContentStore.GetSnapshots(ActiveJob->Snapshots);
+    OtherJob->Snapshots = ActiveJob->Snapshots;
+
+    if (HasActiveJob)
+        FPipeline->Submit(ActiveJob);
+
+    // Without an active job, the other job is submitted in any case (a rebuild of an
+    // empty project has to create the database)
+    if (HasOtherJob || !HasActiveJob)
+        FPipeline->Submit(OtherJob);
+}
+//---------------------------------------------------------------------------
+
+// Queues the project files which have never been tagged or changed on disk since their
+// tagging
+void TChBldAnalyzer::ScanProjectFiles()
+{
+    // Get the files of the active project
+    Synchronize(&SyncProjectFiles);
+
+    std::map<String, String> StaleFiles;
+
+    FProjectDB.GetStaleFiles(FContentFiles, StaleFiles, &FProjectFiles);
+
+    FIndexQueue.clear();
+
+    std::pair<String, String> StaleFile;
+
+    // The editor contents are tagged by the editor syncs
+    foreach_ (StaleFile, StaleFiles)
+    {
+        if (FContentFiles.count(StaleFile.first) == 0)
+            FIndexQueue.push_back(StaleFile.first);
+    }
+
+    FIndexTotal         = static_cast<int>(FIndexQueue.size());
+    FIndexDone          = 0;
+    FIndexStartTicks    = GetTickCount();
+
+    if (FIndexTotal > 0)
+    {
+        CS_SEND(
+            L"Analyzer::ScanProjectFiles("
+                + String(FIndexTotal)
+                + L" of "
+                + String(static_cast<int>(FProjectFiles.size()))
+                + L" project files to index)"
+            );
+    }
+}
+//---------------------------------------------------------------------------
+
+// Submits the next batch of the queued project files at the lowest priority
+void TChBldAnalyzer::IndexProjectFiles(int BatchFiles)
+{
+    TChBldParseJobPtr Job(new TChBldParseJob);
+
+    Job->Priority           = ppProjectIndex;
+    Job->DeleteFilesContent = true;
+
+    while (!FIndexQueue.empty() && (static_cast<int>(Job->OtherFiles.size()) < BatchFiles))
+    {
+        String FileName = FIndexQueue.front();
+        FIndexQueue.pop_front();
+
+        ++FIndexDone;
+
+        // A file opened meanwhile is tagged from its editor content
+        if (FContentFiles.count(FileName) > 0)
+            continue;
+
+        Job->OtherFiles.push_back(FileName);
+        Job->ContentFiles[FileName] = FileName;
+    }
+
+    if (!Job->OtherFiles.empty())
+        FPipeline->Submit(Job);
+
+    CS_SEND(
+        L"Analyzer::IndexProjectFiles("
+            + String(FIndexDone)
+            + L"/"
+            + String(FIndexTotal)
+            + L" files"
+            + (FIndexQueue.empty()
+                ? L", done in " + String(GetTickCount() - FIndexStartTicks) + L" ms)"
+                : String(L")"))
+        );
+}
+//---------------------------------------------------------------------------
+
+// Watches the project directory (with its sub directories) and the project include paths
+// outside of it
+void TChBldAnalyzer::WatchProjectDirectories(const VString& ProjectIncludePaths)
+{
+    TChBldWatchDirectories Directories;
+
+    TChBldWatchDirectory ProjectDirectory = {FProjectDB.ProjectPath, true};
+
+    Directories.push_back(ProjectDirectory);
+
+    foreach_ (const String& ProjectIncludePath, ProjectIncludePaths)
+    {
+        if (StartsText(FProjectDB.ProjectPath, IncludeTrailingPathDelimiter(ProjectIncludePath)))
+            continue;
+
+        TChBldWatchDirectory IncludeDirectory = {ProjectIncludePath, false};
+
+        Directories.push_back(IncludeDirectory);
+    }
+
+    FFileWatcher->SetDirectories(Directories);
+}
+//---------------------------------------------------------------------------
+
+// Re-tags the files which have been changed on disk (but aren't open in an editor)
+void TChBldAnalyzer::RetagChangedFiles()
+{
+    std::set<String>    ChangedFiles;
+    bool                Overflow = false;
+
+    FFileWatcher->TakeChanges(ChangedFiles, Overflow);
+
+    // If the changes of a directory got lost, only a full update finds them
+    if (Overflow)
+    {
+        CS_SEND(L"Analyzer::RetagChangedFiles(Overflow)");
+
+        FullUpdate();
+
+        return;
+    }
+
+    VString                     OtherFiles;
+    std::map<String, String>    Files;
+
+    foreach_ (const String& FileName, ChangedFiles)
+    {
+        // The open files are tagged from their editor contents
+        if (FContentFiles.count(FileName) > 0)
+            continue;
+
+        OtherFiles.push_back(FileName);
+        Files[FileName] = FileName;
+    }
+
+    if (OtherFiles.empty())
+        return;
+
+    CS_SEND(L"Analyzer::RetagChangedFiles(" + String(static_cast<int>(OtherFiles.size())) + L" files)");
+
+    // Re-tag the files (a deleted file loses its tags)
+    SubmitParseJob(VString(), OtherFiles, false, true, Files);
+}
+//---------------------------------------------------------------------------
+
+// Decides whether the user is busy, and limits the tagging workers to one while a build or
+// the CPU load competes for the cores
+void TChBldAnalyzer::UpdateBusyState(unsigned int LastEdit, bool WorkPending)
+{
+    unsigned int BusyTypingPeriod =
+        FLocalSettingsINI->ReadInteger(L"CodeAnalyzer", L"BusyTypingPeriod", 2000);
+
+    int MaxCpuLoad = FLocalSettingsINI->ReadInteger(L"CodeAnalyzer", L"MaxCpuLoad", 80);
+
+    // The CPU load is sampled in an interval, and only while there's background work (an
+    // idle analyzer drops the sample, so the next one doesn't span the idle time)
+    if (!WorkPending)
+    {
+        FCpuLoad        = 0;
+        FCpuTotalTime   = 0;
+    }
+    else if (GetRemainingTime(FLastBusySample, kBusySampleInterval) == 0)
+    {
+        FCpuLoad        = SampleCpuLoad();
+        FLastBusySample = GetTickCount();
+    }
+
+    bool BuildInProgress    = false;
+    bool Debugging          = false;
+
+    // Begin of interlock
+    {
+        TChBldLockGuard LG(FBuildMutex);
+
+        BuildInProgress = FBuildInProgress;
+        Debugging       = FDebugging;
+    }
+    // End of interlock
+
+    bool Typing = (GetRemainingTime(LastEdit, BusyTypingPeriod) > 0);
+
+    bool Contended =
+        BuildInProgress
+            || (FCpuLoad >= MaxCpuLoad)
+            || (FContended && (FCpuLoad >= (MaxCpuLoad - kCpuLoadHysteresis)));
+
+    bool Busy = Contended || Debugging || Typing;
+
+    // Scale the tagging down while contended and back up afterwards
+    if (Contended != FContended)
+    {
+        FContended = Contended;
+
+        FPipeline->SetTaggingLimit(FContended ? 1 : FPipeline->TaggingWorkers);
+    }
+
+    if (Busy != FBusy)
+    {
+        FBusy = Busy;
+
+        CS_SEND(
+            L"Analyzer::UpdateBusyState("
+                + String(FBusy ? L"Busy" : L"Idle")
+                + L", build "
+                + String(static_cast<int>(BuildInProgress))
+                + L", debugger "
+                + String(static_cast<int>(Debugging))
+                + L", typing "
+                + String(static_cast<int>(Typing))
+                + L", CPU load "
+                + String(FCpuLoad)
+                + L"%)"
+            );
+    }
+}
+//---------------------------------------------------------------------------
+
+// Returns the CPU load (percent) of the other processes since the last call (0 for the first
+// call after the sample has been dropped). Our own process and the ctags processes don't
+// count, otherwise our own tagging would make us scale it down.
+int TChBldAnalyzer::SampleCpuLoad()
+{
+    FILETIME IdleTime;
+    FILETIME KernelTime;
+    FILETIME UserTime;
+
+    if (!GetSystemTimes(&IdleTime, &KernelTime, &UserTime))
+        return 0;
+
+    FILETIME ProcessCreationTime;
+    FILETIME ProcessExitTime;
+    FILETIME ProcessKernelTime;
+    FILETIME ProcessUserTime;
+
+    // The CPU time of our own process and of the processes it has run
+    unsigned __int64 Own = Environment::GetExecutedCmdsCpuTime();
+
+    if (GetProcessTimes(
+            GetCurrentProcess(),
+            &ProcessCreationTime,
+            &ProcessExitTime,
+            &ProcessKernelTime,
+            &ProcessUserTime
+            )
+        )
+    {
+        Own += FileTimeToUInt64(ProcessKernelTime) + FileTimeToUInt64(ProcessUserTime);
+    }
+
+    // The kernel time includes the idle time
+    unsigned __int64 Idle   = FileTimeToUInt64(IdleTime);
+    unsigned __int64 Total  = FileTimeToUInt64(KernelTime) + FileTimeToUInt64(UserTime);
+
+    unsigned __int64 IdleDelta  = Idle - FCpuIdleTime;
+    unsigned __int64 TotalDelta = Total - FCpuTotalTime;
+    unsigned __int64 OwnDelta   = Own - FCpuOwnTime;
+
+    bool HasSample = (FCpuTotalTime != 0);
+
+    FCpuIdleTime    = Idle;
+    FCpuTotalTime   = Total;
+    FCpuOwnTime     = Own;
+
+    if (!HasSample || (TotalDelta <= IdleDelta))
+        return 0;
+
+    unsigned __int64 BusyDelta = TotalDelta - IdleDelta;
+
+    // The time of a process is updated at other times than the system times, so it may
+    // exceed the busy time of the interval
+    if (BusyDelta <= OwnDelta)
+        return 0;
+
+    return static_cast<int>(((BusyDelta - OwnDelta) * 100) / TotalDelta);
 }
 //---------------------------------------------------------------------------
 
@@ -331,7 +989,22 @@ void __fastcall TChBldAnalyzer::SyncSetProjectPathDB()
     _di_IOTAProject ActiveProject =
         IDE::GetInterface<_di_IOTAModuleServices>()->GetActiveProject();
 
-    FProjectDB.ProjectPath = ExtractFilePath(ActiveProject->GetFileName());
+    FProjectDB.SetProjectContext(
+        ExtractFilePath(ActiveProject->GetFileName()),
+        IDE::GetCurrentBuildVariant()
+        );
+}
+//---------------------------------------------------------------------------
+
+void __fastcall TChBldAnalyzer::SyncBuildVariant()
+{
+    FBuildVariant = IDE::GetCurrentBuildVariant();
+}
+//---------------------------------------------------------------------------
+
+void __fastcall TChBldAnalyzer::SyncProjectFiles()
+{
+    IDE::GetCurrentProjectFiles(FProjectFiles);
 }
 //---------------------------------------------------------------------------
 
@@ -339,9 +1012,17 @@ void __fastcall TChBldAnalyzer::SyncEditorsContents()
 {
     if (!Terminated)
     {
+        // The file of the active editor is parsed first
+        FActiveEditorFile = IDE::GetCurrentEditorFileName();
+
         // Extract the contents of all project source files to temporary files
         // if they don't exist or have changed
-        IDE::ExtractAllEditorsContent(FProjectDB.ProjectPath, FContentFiles, &FChangedContentFiles);
+        IDE::ExtractAllEditorsContent(
+            FContentStore,
+            FContentFiles,
+            FEditorStamps,
+            &FChangedContentFiles
+            );
     }
 
     if (FChangedContentFiles.size() > 0)
@@ -30,14 +30,18 @@
 //---------------------------------------------------------------------------
 
 #include <System.IniFiles.hpp>
+#include <System.SyncObjs.hpp>
 
 #include <vector>
+#include <deque>
 #include <map>
 
 #include "cherrybuilder_environment.h"
 #include "cherrybuilder_ide.h"
 #include "cherrybuilder_ctags.h"
 #include "cherrybuilder_projectdb.h"
+#include "cherrybuilder_pipeline.h"
+#include "cherrybuilder_filewatcher.h"
 //---------------------------------------------------------------------------
 
 namespace Cherrybuilder
@@ -56,18 +60,36 @@ public:
 
     void FullUpdate();
     void UpdateSettings();
+    void NotifyEdit();
+    void NotifyBuild(bool Building);
+    void NotifyDebugging(bool Debugging);
 
 private:
     void __fastcall Execute();
 
-    void Parse(
-        VString& EditorContentFiles,
-        std::map<String, String>& FilenameLookupMap,
-        Ctags::VTag& ParsingResults
+    static unsigned int GetRemainingTime(unsigned int StartTicks, unsigned int Interval);
+
+    void SubmitParseJob(
+        const VString& EditorContentFiles,
+        const VString& OtherFiles,
+        bool DeepRefresh,
+        bool DeleteFilesContent,
+        const std::map<String, String>& ContentFiles
         );
 
+    void ScanProjectFiles();
+    void IndexProjectFiles(int BatchFiles);
+
+    void WatchProjectDirectories(const VString& ProjectIncludePaths);
+    void RetagChangedFiles();
+
+    void UpdateBusyState(unsigned int LastEdit, bool WorkPending);
+    int SampleCpuLoad();
+
     void __fastcall SyncSetProjectPathDB();
     void __fastcall SyncEditorsContents();
+    void __fastcall SyncBuildVariant();
+    void __fastcall SyncProjectFiles();
     void __fastcall SyncSettings();
 
     TMutex          *FScanningMutex;
@@ -75,11 +97,62 @@ private:
     TChBldProjectDB &FProjectDB;
     bool            FFullUpdate;
     bool            FUpdateSettings;
+    String          FBuildVariant;
+
+    // The (lower case) file of the active editor and the begin of the last full update
+    // with an open project (0 outside of the full update)
+    String          FActiveEditorFile;
+    unsigned int    FProjectOpenTicks;
+
+    // The background indexing of the project files which aren't open in an editor: The
+    // files of the project, the stale ones still to be tagged and the progress of the
+    // current scan
+    VString             FProjectFiles;
+    std::deque<String>  FIndexQueue;
+    int                 FIndexTotal;
+    int                 FIndexDone;
+    unsigned int        FIndexStartTicks;
+
+    // The throttling of the background work: The build and the debugger state are set by
+    // the IDE and the debugger notifier (guarded by 'FBuildMutex', which is never held
+    // during a 'Synchronize'), the CPU load of the other processes is sampled in an interval
+    // while there's background work
+    TMutex              *FBuildMutex;
+    bool                FBuildInProgress;
+    bool                FDebugging;
+    int                 FCpuLoad;
+    unsigned __int64    FCpuIdleTime;
+    unsigned __int64    FCpuTotalTime;
+    unsigned __int64    FCpuOwnTime;
+    unsigned int        FLastBusySample;
+    bool                FBusy;
+    bool                FContended;
+
+    // The events waking up the thread (auto reset, so each signal is handled once)
+    std::unique_ptr<TEvent> FTerminateEvent;
+    std::unique_ptr<TEvent> FProjectEvent;
+    std::unique_ptr<TEvent> FSettingsEvent;
+    std::unique_ptr<TEvent> FEditEvent;
+    std::unique_ptr<TEvent> FBuildEvent;
+
+    // Reports the files changed on disk (its change event is waited for by the thread)
+    std::unique_ptr<TChBldFileWatcher> FFileWatcher;
+
+    // The snapshots of the editor contents (declared before the pipeline, as its jobs keep
+    // their snapshots)
+    TChBldContentStore FContentStore;
+
+    // Parses the submitted files and writes the results to the DB (declared last, as it
+    // uses the parser, the DB and the content store)
+    std::unique_ptr<TChBldParsePipeline> FPipeline;
 
     TMemIniFile                     *FSettingsINI;
     std::unique_ptr<TMemIniFile>    FLocalSettingsINI;
     std::map<String, String>        FContentFiles;
     std::map<String, String>        FChangedContentFiles;
+
+    // The change state of the editor buffers (only accessed in 'SyncEditorsContents')
+    TChBldEditorStamps              FEditorStamps;
 };
 //---------------------------------------------------------------------------
 
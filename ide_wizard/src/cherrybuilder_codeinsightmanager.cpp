@@ -45,10 +45,12 @@ namespace Cherrybuilder
 
 __fastcall TChBldCodeInsightManager::TChBldCodeInsightManager(
     TMemIniFile* SettingsINI,
-    TChBldProjectDB& ProjectDB
+    TChBldProjectDB& ProjectDB,
+    TChBldAnalyzer* Analyzer
     )
     :   FSettingsINI(SettingsINI),
         FProjectDB(ProjectDB),
+        FAnalyzer(Analyzer),
         FCommonHintForm(new TCommonHintForm(NULL)),
         FSymbolHintForm(new TSymbolHintForm(NULL))
 {
@@ -137,6 +139,11 @@ void __fastcall TChBldCodeInsightManager::AllowCodeInsight(bool& Allow, const wc
 {
     CS_SEND(L"CodeInsightManager::AllowCodeInsight(" + String((int)Key) + L")");
 
+    // Each typed key changes the editor content, so let the analyzer know (the request
+    // codes below are no edits)
+    if (FAnalyzer && (Key > L'\x03'))
+        FAnalyzer->NotifyEdit();
+
     // Code completion request
     if (Key == L'\x00')
     {
@@ -246,7 +253,12 @@ bool __fastcall TChBldCodeInsightManager::InvokeCodeCompletion(
                 // Begin of interlock
                 __try
                 {
-                    TChBldLockGuard LG(FProjectDB.UpdateMutex);
+                    unsigned int LockStartTicks = GetTickCount();
+
+                    TChBldReadLockGuard LG(FProjectDB.DBLock);
+
+                    // Measure how long we had to wait for a schema change or a DB swap
+                    FProjectDB.RegisterLockWait(GetTickCount() - LockStartTicks);
 
                     int Line;
                     int Column;
@@ -625,10 +637,10 @@ void TChBldCodeInsightManager::JumpToHeader()
         if (IDE::GetCurrentEditorPos(Line, Column, FileName))
         {
             // Get the implementation symbol
-            Ctags::TTag ImplementationSymbol = FProjectDB.GetPosImplementation(FileName, Line, Column);
+            TChBldTagLocation ImplementationSymbol = FProjectDB.GetPosImplementation(FileName, Line, Column);
 
             // Get the header symbol
-            Ctags::TTag HeaderSymbol = FProjectDB.GetPosHeaderTarget(ImplementationSymbol);
+            TChBldTagLocation HeaderSymbol = FProjectDB.GetPosHeaderTarget(ImplementationSymbol);
 
             // Check if the file exists
             if (FileExists(HeaderSymbol.File))
@@ -660,10 +672,10 @@ void TChBldCodeInsightManager::JumpToImplementation()
         if (IDE::GetCurrentEditorPos(Line, Column, FileName))
         {
             // Get the header symbol
-            Ctags::TTag HeaderSymbol = FProjectDB.GetPosHeader(FileName, Line, Column);
+            TChBldTagLocation HeaderSymbol = FProjectDB.GetPosHeader(FileName, Line, Column);
 
             // Get the implementation symbol
-            Ctags::TTag ImplementationSymbol = FProjectDB.GetPosImplementationTarget(HeaderSymbol);
+            TChBldTagLocation ImplementationSymbol = FProjectDB.GetPosImplementationTarget(HeaderSymbol);
 
             // Check if the file exists
             if (FileExists(ImplementationSymbol.File))
@@ -850,7 +862,7 @@ void TChBldCodeInsightManager::PerformParameterHintRequest()
 
         // Begin of interlock
         {
-            TChBldLockGuard LG(FProjectDB.UpdateMutex);
+            TChBldReadLockGuard LG(FProjectDB.DBLock);
 
             // Resolve the classes/structs for the function name
             for (std::size_t i = 0; i < Symbols.size() - 1; ++i)
@@ -1009,12 +1021,7 @@ void TChBldCodeInsightManager::HandleInvocation(
         NamespaceIdent = RightStr(NamespaceIdent, NamespaceIdent.Length() - 2);
 
     // Get token object type
-    FProjectDB.GetMatchingIdentifierList(
-        L"SELECT * FROM Common "
-            L"WHERE TagName = '" + Token + L"' "
-            L"AND Namespace = '" + NamespaceIdent + L"';",
-        Matches
-        );
+    FProjectDB.GetSymbolIndex()->GetSymbolsByName(Token, NamespaceIdent, Matches);
 
     if (Matches.size() > 0)
     {
@@ -1065,53 +1072,42 @@ void TChBldCodeInsightManager::GetMatchingObjectIdentifiers(
 {
     CS_SEND(L"ChBldCodeInsightManager::GetMatchingObjectIdentifiers(" + ObjectType + L")");
 
-    Ctags::VTag Matches;
-
     bool ShowPrivateMembers     = FSettingsINI->ReadBool(L"CodeCompletion", L"ShowPrivateMembers", true);
     bool ShowImplementations    = FSettingsINI->ReadBool(L"CodeCompletion", L"ShowImplementations", false);
 
-    // Get public/__published members of object to show in completion list
-    FProjectDB.GetMatchingIdentifierList(
-        L"SELECT * FROM Common "
-            L"WHERE (Class    LIKE '%" + ObjectType + L"' "
-            L"OR    Struct    LIKE '%" + ObjectType + L"' "
-            L"OR    Namespace LIKE '%" + ObjectType + L"') "
-            L"AND   ((Access = 'public') OR (Access = 'protected') "
-            + (ShowPrivateMembers ? L"OR (Access = 'private'))" : L")") +
-            L"AND   Kind <> 'constructor' "
-            + (ShowImplementations ? L";" : L"AND   Kind <> 'implementation';"),
-        MatchingIdentifiers,
-        false
-        );
+    unsigned int StartTicks = GetTickCount();
 
-    // Get the class/struct definition itself to determine if there are ancestors
-    FProjectDB.GetMatchingIdentifierList(
-        L"SELECT * FROM Common "
-            L"WHERE (QualifiedName  LIKE '%" + ObjectType + L"' "
-            L"AND "
-            L"(Kind = 'class' OR Kind = 'struct')"
-            L");",
-        Matches
-        );
+    // The access and kind filters for the members to show in completion list
+    unsigned int Accesses =
+        taPublic | taProtected | (ShowPrivateMembers ? taPrivate : 0);
 
-    // If we have a class/struct definition...
-    if (Matches.size() > 0)
-    {
-        Ctags::TTag &Tag = Matches[0];
+    unsigned int Kinds =
+        ~(tkConstructor | (ShowImplementations ? 0 : tkImplementation));
 
-        // ...and if our object is derived from one or more classes/structs...
-        if (!Tag.Inherits.IsEmpty())
-        {
-            // ...read and split the ancestor field values (C++ supports multiple inheritance!!)
-            VString Ancestors = Environment::SplitCtagsObjectAncestors(Tag.Inherits);
+    // Get the current snapshot of the symbol index (it stays valid even if a refresh
+    // publishes a new one in the meantime)
+    TChBldSymbolIndexPtr SymbolIndex = FProjectDB.GetSymbolIndex();
 
-            // Iterate recursively over each inherited object type
-            foreach_ (String Ancestor, Ancestors)
-            {
-                GetMatchingObjectIdentifiers(Ancestor, MatchingIdentifiers);
-            }
-        }
-    }
+    // The keys of the identifiers found so far (shared by the lookups, so each member is
+    // checked for duplicates in constant time)
+    TChBldSymbolKeys Keys;
+
+    TChBldSymbolIndex::GetSymbolKeys(MatchingIdentifiers, Keys);
+
+    // Get the members of the object and of all of its ancestors (C++ supports multiple
+    // inheritance!!), with the members of the nearest classes first
+    SymbolIndex->GetObjectMembers(ObjectType, Kinds, Accesses, MatchingIdentifiers, &Keys);
+
+    // Get the members of a namespace with that name
+    SymbolIndex->GetNamespaceMembers(ObjectType, Kinds, Accesses, MatchingIdentifiers, &Keys);
+
+    CS_SEND(
+        L"ChBldCodeInsightManager::GetMatchingObjectIdentifiers(End, "
+            + String(static_cast<int>(MatchingIdentifiers.size()))
+            + L" members, "
+            + String(GetTickCount() - StartTicks)
+            + L")"
+        );
 }
 //---------------------------------------------------------------------------
 
@@ -1279,12 +1275,16 @@ void TChBldCodeInsightManager::DrawListItem(const int Index, TCanvas* Canvas, co
     // Set the selected highlight color
     Canvas->Font->Color = HighlightColor;
 
-    // Overpaint the filter text ('FilterText' is lower case thus this string handling)
-    Canvas->TextOutW(
-        SelRect.Left + MaxClassTextWidth + (MaxLetterWidth * 4),
-        SelRect.Top,
-        Text.SubString(1, FilterText.Length())
-        );
+    // Overpaint the filter text ('FilterText' is lower case thus this string handling) -
+    // camel-case matches don't start with it
+    if (StartsText(FilterText, Text))
+    {
+        Canvas->TextOutW(
+            SelRect.Left + MaxClassTextWidth + (MaxLetterWidth * 4),
+            SelRect.Top,
+            Text.SubString(1, FilterText.Length())
+            );
+    }
 
     int TextWidth = Canvas->TextWidth(Text);
 
@@ -42,6 +42,7 @@
 #include "cherrybuilder_ide.h"
 #include "cherrybuilder_codeinsightsymbollist.h"
 #include "cherrybuilder_projectdb.h"
+#include "cherrybuilder_analyzer.h"
 #include "cherrybuilder_commonhintform.h"
 #include "cherrybuilder_symbolhintform.h"
 //---------------------------------------------------------------------------
@@ -119,7 +120,11 @@ struct TChBldJumpbackData
 class TChBldCodeInsightManager : public TCppInterfacedObject<IOTANotifier, IOTACodeInsightManager, INTACustomDrawCodeInsightViewer>
 {
 public:
-            __fastcall TChBldCodeInsightManager(TMemIniFile* SettingsINI, TChBldProjectDB& ProjectDB);
+            __fastcall TChBldCodeInsightManager(
+                TMemIniFile* SettingsINI,
+                TChBldProjectDB& ProjectDB,
+                TChBldAnalyzer* Analyzer
+                );
     virtual __fastcall ~TChBldCodeInsightManager();
 
     String      __fastcall  GetName();
@@ -225,6 +230,7 @@ private:
     TSymbolHintForm             *FSymbolHintForm;
     TSysCharSet                 FSysCharSet;
     TChBldProjectDB             &FProjectDB;
+    TChBldAnalyzer              *FAnalyzer;
     TChBldInvocationData        FInvocationData;
     TChBldJumpbackData          FJumpbackDataImplementation;
     TChBldJumpbackData          FJumpbackDataHeader;
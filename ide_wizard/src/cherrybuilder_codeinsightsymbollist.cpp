@@ -29,6 +29,7 @@
 #pragma hdrstop
 
 #include "cherrybuilder_codeinsightsymbollist.h"
+#include "cherrybuilder_symbolindex.h"
 
 #include <System.StrUtils.hpp>
 
@@ -169,8 +170,11 @@ void __fastcall TChBldCodeInsightSymbolList::SetFilter(const String FilterText)
     // Add the complete symbol list
     FSymbols = FCompleteSymbols;
 
-    // Extract the pure token as filter text
-    FFilterText = Environment::ExtractToken(FilterText).LowerCase();
+    // Extract the pure token as filter text (the humps of a camel-case filter are given by
+    // its upper case letters)
+    String CamelCaseFilter = Environment::ExtractToken(FilterText);
+
+    FFilterText = CamelCaseFilter.LowerCase();
 
     // Filter with filter text
     if (!FFilterText.IsEmpty())
@@ -180,10 +184,16 @@ void __fastcall TChBldCodeInsightSymbolList::SetFilter(const String FilterText)
                 // --- no third parameter --
             )
         {
-            if (AnsiStartsStr(FFilterText, it->Name.LowerCase()))
+            if (AnsiStartsStr(FFilterText, it->Name.LowerCase())
+                || TChBldNameSearchIndex::IsCamelCaseMatch(CamelCaseFilter, it->Name)
+                )
+            {
                 ++it;
+            }
             else
+            {
                 it = FSymbols.erase(it);
+            }
         }
     }
 }
@@ -0,0 +1,279 @@
+﻿/* ===============================================================================
+ * CherryBuilder - The Productivity Extension for C++Builder®
+ * ===============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2017 Florian Koch <flko@mail.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ===============================================================================
+ */
+
+#include <vcl.h>
+#pragma hdrstop
+
+#include "cherrybuilder_contentstore.h"
+
+#include "cherrybuilder_debugtools.h"
+//---------------------------------------------------------------------------
+
+#pragma package(smart_init)
+
+namespace Cherrybuilder
+{
+
+// The maximum number of unused slot files kept per extension
+const std::size_t kMaxFreeSlots = 16;
+
+// The interval (ms) of logging the write statistics
+const unsigned int kStatsInterval = 3600000;
+//---------------------------------------------------------------------------
+
+void TChBldContentStore::TSlotRelease::operator()(TChBldContentSnapshot* Snapshot)
+{
+    Store->ReleaseSlot(*Snapshot);
+
+    delete Snapshot;
+}
+//---------------------------------------------------------------------------
+
+TChBldContentStore::TChBldContentStore()
+    :   FMutex(new TMutex(false)),
+        FFolder(L""),
+        FGeneration(0),
+        FNextSlot(0)
+{
+    FStats.StartTime    = GetTickCount();
+    FStats.Snapshots    = 0;
+    FStats.BytesWritten = 0;
+    FStats.SlotsCreated = 0;
+    FStats.SlotsReused  = 0;
+    FStats.SlotsDeleted = 0;
+}
+//---------------------------------------------------------------------------
+
+TChBldContentStore::~TChBldContentStore()
+{
+    // Release the current snapshots (the parse jobs are gone already) and remove all of
+    // the slot files
+    Reset(L"");
+
+    // Delete the store mutex
+    if (FMutex)
+    {
+        delete FMutex;
+        FMutex = NULL;
+    }
+}
+//---------------------------------------------------------------------------
+
+// Drops all snapshots and starts over in the given folder
+void TChBldContentStore::Reset(const String& Folder)
+{
+    std::map<String, TChBldContentSnapshotPtr> Snapshots;
+
+    // Begin of interlock
+    {
+        TChBldLockGuard LG(FMutex);
+
+        FFolder = Folder;
+        ++FGeneration;
+
+        // The unused slots are removed...
+        std::pair<String, VString> FreeSlots;
+
+        foreach_ (FreeSlots, FFreeSlots)
+        {
+            foreach_ (const String& FreeSlot, FreeSlots.second)
+            {
+                DeleteFile(FreeSlot);
+                ++FStats.SlotsDeleted;
+            }
+        }
+
+        FFreeSlots.clear();
+
+        // ...and the used ones when they're released (outside the interlock, as releasing
+        // takes it again)
+        Snapshots.swap(FSnapshots);
+    }
+    // End of interlock
+}
+//---------------------------------------------------------------------------
+
+// Stores the content as the current snapshot of the file (the slot of the previous one is
+// released when it's not used anymore)
+TChBldContentSnapshotPtr TChBldContentStore::Add(
+    const String& FileName,
+    const char* Content,
+    int Length
+    )
+{
+    TSlotRelease SlotRelease = {this};
+
+    TChBldContentSnapshotPtr Snapshot(new TChBldContentSnapshot, SlotRelease);
+
+    // The previous snapshot (released outside the interlock)
+    TChBldContentSnapshotPtr PreviousSnapshot;
+
+    // Begin of interlock
+    {
+        TChBldLockGuard LG(FMutex);
+
+        Snapshot->FileName      = FileName;
+        Snapshot->SlotFile      = AcquireSlot(ExtractFileExt(FileName));
+        Snapshot->Length        = Length;
+        Snapshot->Generation    = FGeneration;
+
+        PreviousSnapshot = FSnapshots[FileName];
+        FSnapshots[FileName] = Snapshot;
+
+        ++FStats.Snapshots;
+        FStats.BytesWritten += Length;
+    }
+    // End of interlock
+
+    WriteSlotFile(Snapshot->SlotFile, Content, Length);
+
+    LogStatsIfDue();
+
+    return Snapshot;
+}
+//---------------------------------------------------------------------------
+
+void TChBldContentStore::GetSnapshots(std::vector<TChBldContentSnapshotPtr>& Snapshots)
+{
+    TChBldLockGuard LG(FMutex);
+
+    Snapshots.clear();
+
+    std::pair<String, TChBldContentSnapshotPtr> Snapshot;
+
+    foreach_ (Snapshot, FSnapshots)
+        Snapshots.push_back(Snapshot.second);
+}
+//---------------------------------------------------------------------------
+
+// Returns an unused slot file (the caller has to hold 'FMutex')
+String TChBldContentStore::AcquireSlot(const String& Extension)
+{
+    VString& FreeSlots = FFreeSlots[Extension.LowerCase()];
+
+    if (!FreeSlots.empty())
+    {
+        String SlotFile = FreeSlots.back();
+        FreeSlots.pop_back();
+
+        ++FStats.SlotsReused;
+
+        return SlotFile;
+    }
+
+    ++FStats.SlotsCreated;
+
+    return FFolder + L"chbld_slot" + String(++FNextSlot) + Extension.LowerCase();
+}
+//---------------------------------------------------------------------------
+
+void TChBldContentStore::ReleaseSlot(const TChBldContentSnapshot& Snapshot)
+{
+    TChBldLockGuard LG(FMutex);
+
+    VString& FreeSlots = FFreeSlots[ExtractFileExt(Snapshot.SlotFile).LowerCase()];
+
+    // Keep the slot for the next snapshot (if it belongs to the current folder and the
+    // pool isn't full)
+    if ((Snapshot.Generation == FGeneration)
+        && !FFolder.IsEmpty()
+        && (FreeSlots.size() < kMaxFreeSlots))
+    {
+        FreeSlots.push_back(Snapshot.SlotFile);
+    }
+    else
+    {
+        DeleteFile(Snapshot.SlotFile);
+        ++FStats.SlotsDeleted;
+    }
+}
+//---------------------------------------------------------------------------
+
+void TChBldContentStore::WriteSlotFile(const String& SlotFile, const char* Content, int Length)
+{
+    // A temporary file is kept in the file cache (if there's enough memory) instead of
+    // being flushed to the disk
+    HANDLE File =
+        CreateFileW(
+            SlotFile.c_str(),
+            GENERIC_WRITE,
+            FILE_SHARE_READ,
+            NULL,
+            CREATE_ALWAYS,
+            FILE_ATTRIBUTE_TEMPORARY,
+            NULL
+            );
+
+    if (File == INVALID_HANDLE_VALUE)
+        throw Exception(Environment::GetWinAPILastErrorText());
+
+    __try
+    {
+        DWORD BytesWritten = 0;
+
+        if ((Length > 0) && !WriteFile(File, Content, Length, &BytesWritten, NULL))
+            throw Exception(Environment::GetWinAPILastErrorText());
+    }
+    __finally
+    {
+        CloseHandle(File);
+    }
+}
+//---------------------------------------------------------------------------
+
+void TChBldContentStore::LogStatsIfDue()
+{
+    TChBldLockGuard LG(FMutex);
+
+    if ((GetTickCount() - FStats.StartTime) < kStatsInterval)
+        return;
+
+    // Each reused slot saves the creation of a new file and the later deletion of it
+    CS_SEND(
+        L"ContentStore::Stats(Last hour: "
+            + String(FStats.Snapshots)
+            + L" snapshots, "
+            + String(FStats.BytesWritten)
+            + L" bytes written, "
+            + String(FStats.SlotsReused)
+            + L" slots reused, "
+            + String(FStats.SlotsCreated)
+            + L" created, "
+            + String(FStats.SlotsDeleted)
+            + L" deleted)"
+        );
+
+    FStats.StartTime    = GetTickCount();
+    FStats.Snapshots    = 0;
+    FStats.BytesWritten = 0;
+    FStats.SlotsCreated = 0;
+    FStats.SlotsReused  = 0;
+    FStats.SlotsDeleted = 0;
+}
+//---------------------------------------------------------------------------
+
+} // namespace Cherrybuilder
@@ -0,0 +1,121 @@
+﻿/* ===============================================================================
+ * CherryBuilder - The Productivity Extension for C++Builder®
+ * ===============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2017 Florian Koch <flko@mail.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ===============================================================================
+ */
+
+#ifndef cherrybuilder_contentstoreH
+#define cherrybuilder_contentstoreH
+//---------------------------------------------------------------------------
+
+#include <vector>
+#include <map>
+#include <boost/shared_ptr.hpp>
+
+#include "cherrybuilder_environment.h"
+//---------------------------------------------------------------------------
+
+namespace Cherrybuilder
+{
+
+// A snapshot of an editor content, handed to the tagger via a slot file (which is reused
+// once the last reference to the snapshot is gone)
+struct TChBldContentSnapshot
+{
+    String  FileName;
+    String  SlotFile;
+    int     Length;
+    int     Generation;
+};
+//---------------------------------------------------------------------------
+
+typedef boost::shared_ptr<TChBldContentSnapshot> TChBldContentSnapshotPtr;
+//---------------------------------------------------------------------------
+
+// The write statistics of the content store since 'StartTime'
+struct TChBldContentStoreStats
+{
+    unsigned int    StartTime;
+    unsigned int    Snapshots;
+    __int64         BytesWritten;
+    unsigned int    SlotsCreated;
+    unsigned int    SlotsReused;
+    unsigned int    SlotsDeleted;
+};
+//---------------------------------------------------------------------------
+
+// Keeps the current snapshot of each editor content. The tagger reads them from a small
+// pool of slot files (instead of a new GUID named file per content), which are written as
+// temporary files, so they're mostly kept in the file cache. The snapshots are reference
+// counted: A slot isn't overwritten while a parse job still uses its snapshot.
+class TChBldContentStore
+{
+public:
+    TChBldContentStore();
+    ~TChBldContentStore();
+
+    void Reset(const String& Folder);
+
+    TChBldContentSnapshotPtr Add(const String& FileName, const char* Content, int Length);
+
+    void GetSnapshots(std::vector<TChBldContentSnapshotPtr>& Snapshots);
+
+private:
+    // Returns the slot of a snapshot to the pool when its last reference is gone
+    struct TSlotRelease
+    {
+        TChBldContentStore *Store;
+
+        void operator()(TChBldContentSnapshot* Snapshot);
+    };
+
+    String AcquireSlot(const String& Extension);
+    void ReleaseSlot(const TChBldContentSnapshot& Snapshot);
+
+    static void WriteSlotFile(const String& SlotFile, const char* Content, int Length);
+
+    void LogStatsIfDue();
+
+    TMutex *FMutex;
+
+    // The folder of the slot files, the generation is increased with each reset (the slots
+    // of an older generation aren't reused)
+    String  FFolder;
+    int     FGeneration;
+
+    int FNextSlot;
+
+    // The unused slot files by their extension
+    std::map<String, VString> FFreeSlots;
+
+    // The current snapshot of each file
+    std::map<String, TChBldContentSnapshotPtr> FSnapshots;
+
+    TChBldContentStoreStats FStats;
+};
+//---------------------------------------------------------------------------
+
+} // namespace Cherrybuilder
+
+#endif
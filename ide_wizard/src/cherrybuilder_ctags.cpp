@@ -382,6 +382,19 @@ void TParser::ParseTags(const VString& Queue, VTag& Results)
 }
 //---------------------------------------------------------------------------
 
+// Returns whether the file is located in one of the IDE include paths
+bool TParser::IsIdeIncludeFile(const String& FileName)
+{
+    foreach_ (const String& IDEIncludePath, FIDEIncludePaths)
+    {
+        if (StartsText(IncludeTrailingPathDelimiter(IDEIncludePath), FileName))
+            return true;
+    }
+
+    return false;
+}
+//---------------------------------------------------------------------------
+
 bool TParser::InterpretIncludeData(const String& LineText, TIncludeTag& IncludeTag)
 {
     VString Includes = Environment::SplitStr(LineText, L'\t');
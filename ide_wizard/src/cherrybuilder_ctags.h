@@ -101,6 +101,8 @@ public:
 
     void    ParseTags(const VString& Queue, VTag& Results);
 
+    bool    IsIdeIncludeFile(const String& FileName);
+
 private:
     bool    InterpretIncludeData(const String& LineText, TIncludeTag& Record);
     bool    InterpretLineData(const String& LineText, TTag& Record);
@@ -40,6 +40,9 @@ namespace Cherrybuilder
 
 const String Environment::FProgramDataFolderName = L"CherryBuilder for Embarcadero RAD Studio";
 const String Environment::FSettingsFileExtension = L".cfg";
+
+// The job of the processes run by 'ExecuteCmd' (for accounting their CPU time only)
+HANDLE Environment::FExecutedCmdsJob = CreateJobObjectW(NULL, NULL);
 //---------------------------------------------------------------------------
 
 String Environment::GetCurrentComputerName()
@@ -161,14 +164,14 @@ void Environment::ExecuteCmd(const String& CommandLine)
 
     __try
     {
-        // Run command
+        // Run command (suspended until it's been added to the job)
         if (!CreateProcessW(
                 NULL,
                 CommandLine.w_str(),
                 NULL,
                 NULL,
                 FALSE,
-                CREATE_NEW_CONSOLE,
+                CREATE_NEW_CONSOLE | CREATE_SUSPENDED,
                 NULL,
                 NULL,
                 &StartupInfo,
@@ -178,6 +181,13 @@ void Environment::ExecuteCmd(const String& CommandLine)
             throw Exception(Environment::GetWinAPILastErrorText());
         }
 
+        // The process runs outside of the job if it can't be added (e.g. if the IDE runs in
+        // a job which doesn't allow nested ones), only its CPU time isn't accounted then
+        if (FExecutedCmdsJob)
+            AssignProcessToJobObject(FExecutedCmdsJob, ProcessInfo.hProcess);
+
+        ResumeThread(ProcessInfo.hThread);
+
         // Wait for command to finish
         WaitForSingleObject(ProcessInfo.hProcess, INFINITE);
     }
@@ -190,6 +200,29 @@ void Environment::ExecuteCmd(const String& CommandLine)
 }
 //---------------------------------------------------------------------------
 
+// Returns the CPU time (in 100 ns units) used by the processes run by 'ExecuteCmd' so far,
+// including the ones still running
+unsigned __int64 Environment::GetExecutedCmdsCpuTime()
+{
+    JOBOBJECT_BASIC_ACCOUNTING_INFORMATION AccountingInfo;
+
+    if (!FExecutedCmdsJob
+        || !QueryInformationJobObject(
+                FExecutedCmdsJob,
+                JobObjectBasicAccountingInformation,
+                &AccountingInfo,
+                sizeof(AccountingInfo),
+                NULL
+                )
+        )
+    {
+        return 0;
+    }
+
+    return AccountingInfo.TotalUserTime.QuadPart + AccountingInfo.TotalKernelTime.QuadPart;
+}
+//---------------------------------------------------------------------------
+
 String Environment::GetWinTempPath()
 {
     return IncludeTrailingPathDelimiter(GetEnvironmentVariable(L"TEMP"));
@@ -268,6 +301,26 @@ bool Environment::IsHppFile(const String& File)
 }
 //---------------------------------------------------------------------------
 
+bool Environment::GetFileStamp(const String& File, __int64& ModificationTime, __int64& Size)
+{
+    WIN32_FILE_ATTRIBUTE_DATA FileAttributeData;
+
+    // Get the last write time and the size of the file in one go
+    if (!GetFileAttributesExW(File.c_str(), GetFileExInfoStandard, &FileAttributeData))
+        return false;
+
+    ModificationTime =
+        (static_cast<__int64>(FileAttributeData.ftLastWriteTime.dwHighDateTime) << 32)
+        | FileAttributeData.ftLastWriteTime.dwLowDateTime;
+
+    Size =
+        (static_cast<__int64>(FileAttributeData.nFileSizeHigh) << 32)
+        | FileAttributeData.nFileSizeLow;
+
+    return true;
+}
+//---------------------------------------------------------------------------
+
 String Environment::ExtractToken(const String& Text)
 {
     // Replace all invocation operators with '.'
@@ -58,6 +58,8 @@ namespace Cherrybuilder
 {
 
 const String kDBFileName = L"chbld_tags.db";
+const String kDBFilePrefix = L"chbld_tags";
+const String kSDKDBFilePrefix = L"chbld_sdk";
 //---------------------------------------------------------------------------
 
 enum TMatchMode
@@ -88,6 +90,40 @@ struct TChBldLockGuard
 };
 //---------------------------------------------------------------------------
 
+struct TChBldReadLockGuard
+{
+    TChBldReadLockGuard(TMultiReadExclusiveWriteSynchronizer* ASync)
+        :   Sync(ASync)
+    {
+        Sync->BeginRead();
+    }
+
+    ~TChBldReadLockGuard()
+    {
+        Sync->EndRead();
+    }
+
+    TMultiReadExclusiveWriteSynchronizer *Sync;
+};
+//---------------------------------------------------------------------------
+
+struct TChBldWriteLockGuard
+{
+    TChBldWriteLockGuard(TMultiReadExclusiveWriteSynchronizer* ASync)
+        :   Sync(ASync)
+    {
+        Sync->BeginWrite();
+    }
+
+    ~TChBldWriteLockGuard()
+    {
+        Sync->EndWrite();
+    }
+
+    TMultiReadExclusiveWriteSynchronizer *Sync;
+};
+//---------------------------------------------------------------------------
+
 class Environment
 {
 public:
@@ -106,6 +142,7 @@ public:
     static String       CreateGuidString(bool NoParantheses=false);
 
     static void         ExecuteCmd(const String& CommandLine);
+    static unsigned __int64 GetExecutedCmdsCpuTime();
 
     static String       GetWinTempPath();
 
@@ -114,6 +151,8 @@ public:
     static bool         IsCppFile(const String& File);
     static bool         IsHppFile(const String& File);
 
+    static bool         GetFileStamp(const String& File, __int64& ModificationTime, __int64& Size);
+
     static String       ExtractToken(const String& Text);
 
     static VString      SplitStr(
@@ -139,6 +178,8 @@ private:
     static const        String FProgramDataFolderName;
     static const        String FSettingsFileExtension;
 
+    static HANDLE       FExecutedCmdsJob;
+
 };
 //---------------------------------------------------------------------------
 
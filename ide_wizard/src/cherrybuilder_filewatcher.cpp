@@ -0,0 +1,339 @@
+﻿/* ===============================================================================
+ * CherryBuilder - The Productivity Extension for C++Builder®
+ * ===============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2017 Florian Koch <flko@mail.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ===============================================================================
+ */
+
+#include <vcl.h>
+#pragma hdrstop
+
+#include "cherrybuilder_filewatcher.h"
+
+#include <System.StrUtils.hpp>
+
+#include "cherrybuilder_debugtools.h"
+//---------------------------------------------------------------------------
+
+#pragma package(smart_init)
+
+namespace Cherrybuilder
+{
+
+// The size (bytes) of the change buffer of a watched directory
+const DWORD kWatchBufferSize = 65536;
+//---------------------------------------------------------------------------
+
+__fastcall TChBldFileWatcher::TChBldFileWatcher()
+    :   TThread(false),
+        FMutex(new TMutex(false)),
+        FDirectoriesChanged(false),
+        FOverflow(false),
+        FWakeEvent(new TEvent(NULL, false, false, L"", false)),
+        FChangeEvent(new TEvent(NULL, false, false, L"", false))
+{
+    CS_SEND(L"FileWatcher::Constructor");
+}
+//---------------------------------------------------------------------------
+
+__fastcall TChBldFileWatcher::~TChBldFileWatcher()
+{
+    CS_SEND(L"FileWatcher::Destructor");
+
+    // Kill the thread (and wake it up)
+    Terminate();
+    FWakeEvent->SetEvent();
+
+    // Wait for the thread to fully terminate
+    WaitFor();
+
+    // Delete the mutex
+    if (FMutex)
+    {
+        delete FMutex;
+        FMutex = NULL;
+    }
+}
+//---------------------------------------------------------------------------
+
+// Replaces the watched directories (the changes collected so far are kept)
+void TChBldFileWatcher::SetDirectories(const TChBldWatchDirectories& Directories)
+{
+    // Begin of interlock
+    {
+        TChBldLockGuard LG(FMutex);
+
+        FDirectories        = Directories;
+        FDirectoriesChanged = true;
+    }
+    // End of interlock
+
+    FWakeEvent->SetEvent();
+}
+//---------------------------------------------------------------------------
+
+void TChBldFileWatcher::TakeChanges(std::set<String>& Files, bool& Overflow)
+{
+    TChBldLockGuard LG(FMutex);
+
+    Files.clear();
+    Files.swap(FChangedFiles);
+
+    Overflow    = FOverflow;
+    FOverflow   = false;
+}
+//---------------------------------------------------------------------------
+
+TEvent* TChBldFileWatcher::GetChangeEvent()
+{
+    return FChangeEvent.get();
+}
+//---------------------------------------------------------------------------
+
+void __fastcall TChBldFileWatcher::Execute()
+{
+    CS_SEND(L"FileWatcher::Execute (Thread, Begin)");
+
+    std::vector<TWatchPtr> Watches;
+
+    __try
+    {
+        while (!Terminated)
+        {
+            bool DirectoriesChanged = false;
+
+            // Begin of interlock
+            {
+                TChBldLockGuard LG(FMutex);
+
+                DirectoriesChanged  = FDirectoriesChanged;
+                FDirectoriesChanged = false;
+            }
+            // End of interlock
+
+            // Watch the new directories
+            if (DirectoriesChanged)
+            {
+                CloseWatches(Watches);
+                OpenWatches(Watches);
+            }
+
+            // The wake event is the first one, followed by the events of the watches
+            std::vector<HANDLE> Events;
+
+            Events.push_back(reinterpret_cast<HANDLE>(FWakeEvent->Handle));
+
+            foreach_ (const TWatchPtr& Watch, Watches)
+                Events.push_back(Watch->Overlapped.hEvent);
+
+            DWORD WaitResult =
+                WaitForMultipleObjects(Events.size(), &Events[0], false, INFINITE);
+
+            if ((WaitResult > WAIT_OBJECT_0) && (WaitResult < (WAIT_OBJECT_0 + Events.size())))
+            {
+                std::vector<TWatchPtr>::iterator Watch =
+                    Watches.begin() + (WaitResult - WAIT_OBJECT_0 - 1);
+
+                DWORD Bytes = 0;
+
+                if (GetOverlappedResult((*Watch)->Handle, &(*Watch)->Overlapped, &Bytes, false))
+                    CollectChanges(**Watch, Bytes);
+
+                // Continue watching (a directory which can't be watched anymore, e.g. as it
+                // has been deleted, is dropped)
+                if (!StartWatch(**Watch))
+                {
+                    CS_SEND(L"FileWatcher::Execute(Dropped " + (*Watch)->Path + L")");
+
+                    CloseWatch(**Watch);
+                    Watches.erase(Watch);
+                }
+            }
+        }
+    }
+    __finally
+    {
+        CloseWatches(Watches);
+
+        CS_SEND(L"FileWatcher::Execute(Thread, End)");
+    }
+}
+//---------------------------------------------------------------------------
+
+void TChBldFileWatcher::OpenWatches(std::vector<TWatchPtr>& Watches)
+{
+    TChBldWatchDirectories Directories;
+
+    // Begin of interlock
+    {
+        TChBldLockGuard LG(FMutex);
+
+        Directories = FDirectories;
+    }
+    // End of interlock
+
+    foreach_ (const TChBldWatchDirectory& Directory, Directories)
+    {
+        // A thread can't wait for more handles (the wake event included)
+        if (Watches.size() >= (MAXIMUM_WAIT_OBJECTS - 1))
+        {
+            CS_SEND(L"FileWatcher::OpenWatches(Too many directories, skipped " + Directory.Path + L")");
+            continue;
+        }
+
+        TWatchPtr Watch(new TWatch);
+
+        Watch->Path     = IncludeTrailingPathDelimiter(Directory.Path);
+        Watch->Subtree  = Directory.Subtree;
+        Watch->Handle   =
+            CreateFileW(
+                Watch->Path.c_str(),
+                FILE_LIST_DIRECTORY,
+                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                NULL,
+                OPEN_EXISTING,
+                FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+                NULL
+                );
+
+        // Skip the directories which don't exist (anymore)
+        if (Watch->Handle == INVALID_HANDLE_VALUE)
+            continue;
+
+        ZeroMemory(&Watch->Overlapped, sizeof(Watch->Overlapped));
+
+        Watch->Overlapped.hEvent = CreateEventW(NULL, true, false, NULL);
+        Watch->Buffer.resize(kWatchBufferSize / sizeof(DWORD));
+
+        if (StartWatch(*Watch))
+            Watches.push_back(Watch);
+        else
+            CloseWatch(*Watch);
+    }
+
+    CS_SEND(L"FileWatcher::OpenWatches(" + String(static_cast<int>(Watches.size())) + L" directories)");
+}
+//---------------------------------------------------------------------------
+
+void TChBldFileWatcher::CloseWatches(std::vector<TWatchPtr>& Watches)
+{
+    foreach_ (const TWatchPtr& Watch, Watches)
+        CloseWatch(*Watch);
+
+    Watches.clear();
+}
+//---------------------------------------------------------------------------
+
+void TChBldFileWatcher::CloseWatch(TWatch& Watch)
+{
+    if (Watch.Handle != INVALID_HANDLE_VALUE)
+    {
+        DWORD Bytes = 0;
+
+        // The pending read must be finished before its buffer is gone
+        if (CancelIo(Watch.Handle))
+            GetOverlappedResult(Watch.Handle, &Watch.Overlapped, &Bytes, true);
+
+        CloseHandle(Watch.Handle);
+        Watch.Handle = INVALID_HANDLE_VALUE;
+    }
+
+    if (Watch.Overlapped.hEvent)
+    {
+        CloseHandle(Watch.Overlapped.hEvent);
+        Watch.Overlapped.hEvent = NULL;
+    }
+}
+//---------------------------------------------------------------------------
+
+bool TChBldFileWatcher::StartWatch(TWatch& Watch)
+{
+    ResetEvent(Watch.Overlapped.hEvent);
+
+    return
+        ReadDirectoryChangesW(
+            Watch.Handle,
+            &Watch.Buffer[0],
+            Watch.Buffer.size() * sizeof(DWORD),
+            Watch.Subtree,
+            FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE,
+            NULL,
+            &Watch.Overlapped,
+            NULL
+            );
+}
+//---------------------------------------------------------------------------
+
+void TChBldFileWatcher::CollectChanges(const TWatch& Watch, DWORD Bytes)
+{
+    std::set<String> ChangedFiles;
+
+    // No bytes means that the buffer has overflown, so the changes are unknown
+    bool Overflow = (Bytes == 0);
+
+    if (!Overflow)
+    {
+        const BYTE* Entry = reinterpret_cast<const BYTE*>(&Watch.Buffer[0]);
+
+        for (;;)
+        {
+            const FILE_NOTIFY_INFORMATION* Info =
+                reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(Entry);
+
+            // Get the full file name in lower case (the file name of the entry isn't
+            // null terminated)
+            String FileName =
+                (Watch.Path + String(Info->FileName, Info->FileNameLength / sizeof(WCHAR)))
+                    .LowerCase();
+
+            // Only the C++ files are of interest, but not our own temp files
+            if ((Environment::IsCppFile(FileName) || Environment::IsHppFile(FileName))
+                && !ContainsText(FileName, L"\\__chbld\\"))
+            {
+                ChangedFiles.insert(FileName);
+            }
+
+            if (Info->NextEntryOffset == 0)
+                break;
+
+            Entry += Info->NextEntryOffset;
+        }
+    }
+
+    if (!Overflow && ChangedFiles.empty())
+        return;
+
+    // Begin of interlock
+    {
+        TChBldLockGuard LG(FMutex);
+
+        FChangedFiles.insert(ChangedFiles.begin(), ChangedFiles.end());
+        FOverflow = FOverflow || Overflow;
+    }
+    // End of interlock
+
+    FChangeEvent->SetEvent();
+}
+//---------------------------------------------------------------------------
+
+} // namespace Cherrybuilder
@@ -0,0 +1,116 @@
+﻿/* ===============================================================================
+ * CherryBuilder - The Productivity Extension for C++Builder®
+ * ===============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2017 Florian Koch <flko@mail.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ===============================================================================
+ */
+
+#ifndef cherrybuilder_filewatcherH
+#define cherrybuilder_filewatcherH
+//---------------------------------------------------------------------------
+
+#include <System.SyncObjs.hpp>
+
+#include <vector>
+#include <set>
+#include <memory>
+#include <boost/shared_ptr.hpp>
+
+#include "cherrybuilder_environment.h"
+//---------------------------------------------------------------------------
+
+namespace Cherrybuilder
+{
+
+// A watched directory (with or without its sub directories)
+struct TChBldWatchDirectory
+{
+    String  Path;
+    bool    Subtree;
+};
+//---------------------------------------------------------------------------
+
+typedef std::vector<TChBldWatchDirectory> TChBldWatchDirectories;
+//---------------------------------------------------------------------------
+
+// Collects the changed C++ source and header files below a set of directories (changes
+// made outside of the IDE, like a checkout or a code generator). The changes are collected
+// until they're taken, so a burst of changes is handed over at once and each file only once.
+// The backend uses 'ReadDirectoryChangesW' in a thread of its own.
+class TChBldFileWatcher : public TThread
+{
+public:
+    __fastcall TChBldFileWatcher();
+    __fastcall ~TChBldFileWatcher();
+
+    void SetDirectories(const TChBldWatchDirectories& Directories);
+
+    void TakeChanges(std::set<String>& Files, bool& Overflow);
+
+    // Signaled (auto reset) when a change has been collected
+    __property TEvent* ChangeEvent = {read=GetChangeEvent};
+
+private:
+    // The state of a directory handle with its pending read
+    struct TWatch
+    {
+        String              Path;
+        bool                Subtree;
+        HANDLE              Handle;
+        OVERLAPPED          Overlapped;
+        std::vector<DWORD>  Buffer;
+    };
+
+    typedef boost::shared_ptr<TWatch> TWatchPtr;
+
+    void __fastcall Execute();
+
+    void OpenWatches(std::vector<TWatchPtr>& Watches);
+    static void CloseWatches(std::vector<TWatchPtr>& Watches);
+    static void CloseWatch(TWatch& Watch);
+    static bool StartWatch(TWatch& Watch);
+
+    void CollectChanges(const TWatch& Watch, DWORD Bytes);
+
+    TEvent* GetChangeEvent();
+
+    TMutex *FMutex;
+
+    // The directories to watch, flagged when they've changed (guarded by 'FMutex')
+    TChBldWatchDirectories  FDirectories;
+    bool                    FDirectoriesChanged;
+
+    // The changes which haven't been taken yet (guarded by 'FMutex'), the overflow flag is
+    // set if the changes of a directory got lost
+    std::set<String>    FChangedFiles;
+    bool                FOverflow;
+
+    // Wakes up the thread on termination or new directories
+    std::unique_ptr<TEvent> FWakeEvent;
+    std::unique_ptr<TEvent> FChangeEvent;
+};
+//---------------------------------------------------------------------------
+
+} // namespace Cherrybuilder
+
+#endif
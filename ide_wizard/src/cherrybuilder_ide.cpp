@@ -32,10 +32,13 @@
 
 #include <System.Hash.hpp>
 #include <System.IOUtils.hpp>
+#include <System.StrUtils.hpp>
+#include <System.DateUtils.hpp>
 
 #include <Rtti.hpp>
 
 #include <set>
+#include <cstring>
 
 #include "cherrybuilder_winmode.h"
 #include "cherrybuilder_debugtools.h"
@@ -47,6 +50,12 @@ namespace Cherrybuilder
 {
 
 _di_IBorlandIDEServices IDE::FIDESrv;
+std::vector<char> IDE::FContentBuffer;
+//---------------------------------------------------------------------------
+
+// The time (ms) a changed editor buffer is re-read on each sync, as its change time
+// doesn't tell apart the changes within the same clock tick
+const __int64 kRecentChangeTime = 1000;
 //---------------------------------------------------------------------------
 
 TMenuItem* IDE::AddToolsMenuItem(
@@ -150,7 +159,7 @@ void IDE::GetCurrentPlatformIncludePaths(VString& Paths,
         __try
         {
             // Add the IDE path entries depending on the platform and the compiler
-            if (Configurations->GetActiveConfiguration()->GetValue(L"BCC_UseClassicCompiler") == L"false")
+            if (GetCurrentCompilerFamily() == L"clang")
             {
                 PathList.push_back(Registry->ReadString(L"BrowsingPath_CLang32")); // Typo is intentional
                 PathList.push_back(Registry->ReadString(L"IncludePath_Clang32"));
@@ -336,6 +345,59 @@ String IDE::GetCurrentPlatform()
 }
 //---------------------------------------------------------------------------
 
+String IDE::GetCurrentCompilerFamily()
+{
+    _di_IOTAProject ActiveProject = GetInterface<_di_IOTAModuleServices>()->GetActiveProject();
+
+    if (!ActiveProject)
+        return L"";
+
+    _di_IOTAProjectOptionsConfigurations Configurations =
+        GetInterface<_di_IOTAProjectOptionsConfigurations, _di_IOTAProjectOptions>(
+            ActiveProject->ProjectOptions
+            );
+
+    // The Clang based compilers use other include paths than the classic one
+    if (Configurations->GetActiveConfiguration()->GetValue(L"BCC_UseClassicCompiler") == L"false")
+        return L"clang";
+    else
+        return L"classic";
+}
+//---------------------------------------------------------------------------
+
+String IDE::GetCurrentBuildVariant()
+{
+    _di_IOTAProject ActiveProject = GetInterface<_di_IOTAModuleServices>()->GetActiveProject();
+
+    if (!ActiveProject)
+        return L"";
+
+    _di_IOTAProjectOptionsConfigurations Configurations =
+        GetInterface<_di_IOTAProjectOptionsConfigurations, _di_IOTAProjectOptions>(
+            ActiveProject->ProjectOptions
+            );
+
+    // Get the defines of the active configuration (including the inherited ones)
+    std::unique_ptr<TStringList> Defines(new TStringList);
+    Defines->Delimiter          = L';';
+    Defines->StrictDelimiter    = true;
+
+    Configurations->GetActiveConfiguration()->GetValues(L"Defines", Defines.get(), true);
+
+    // The order of the defines doesn't matter
+    Defines->Sort();
+
+    // Platform, compiler family and define set select the tags of a project - so each
+    // combination gets its own database (e.g. 'win32_clang_1a2b3c4d')
+    return
+        GetCurrentPlatform().LowerCase()
+            + L"_"
+            + GetCurrentCompilerFamily()
+            + L"_"
+            + THashMD5::GetHashString(Defines->DelimitedText).SubString(1, 8).LowerCase();
+}
+//---------------------------------------------------------------------------
+
 int IDE::GetCurrentEditorCppTabWidth()
 {
     int TabWidth = 4;
@@ -420,6 +482,61 @@ int IDE::GetCurrentEditorFontSize()
 }
 //---------------------------------------------------------------------------
 
+// Returns the (lower case) file name of the active source editor or an empty string
+String IDE::GetCurrentEditorFileName()
+{
+    _di_IOTAModule Module = GetInterface<_di_IOTAModuleServices>()->CurrentModule();
+
+    if (!Module)
+        return L"";
+
+    _di_IOTAEditor          Editor = Module->CurrentEditor;
+    _di_IOTASourceEditor    SourceEditor;
+
+    if (Editor && Editor->Supports(SourceEditor))
+        return SourceEditor->GetFileName().LowerCase();
+
+    return L"";
+}
+//---------------------------------------------------------------------------
+
+// Gets the (lower case) C++ source and header files of the active project
+void IDE::GetCurrentProjectFiles(VString& Files)
+{
+    Files.clear();
+
+    _di_IOTAProject ActiveProject = GetInterface<_di_IOTAModuleServices>()->GetActiveProject();
+
+    if (!ActiveProject)
+        return;
+
+    std::set<String> ProjectFiles;
+
+    // Iterate over all modules of the project file
+    for (int i = 0; i < ActiveProject->GetModuleCount(); ++i)
+    {
+        String FileName = ActiveProject->GetModule(i)->FileName.LowerCase();
+
+        if (Environment::IsHppFile(FileName))
+        {
+            ProjectFiles.insert(FileName);
+        }
+        else if (Environment::IsCppFile(FileName))
+        {
+            ProjectFiles.insert(FileName);
+
+            // The header of a unit isn't listed as a module of its own
+            String HeaderFileName = ChangeFileExt(FileName, L".h");
+
+            if (FileExists(HeaderFileName))
+                ProjectFiles.insert(HeaderFileName);
+        }
+    }
+
+    Files.assign(ProjectFiles.begin(), ProjectFiles.end());
+}
+//---------------------------------------------------------------------------
+
 bool IDE::GetCurrentEditorPos(int& Line, int& Column, String& FileName)
 {
     Line        = -1;
@@ -468,39 +585,51 @@ _di_IOTAEditActions IDE::GetCurrentEditActions()
 }
 //---------------------------------------------------------------------------
 
-RawByteString IDE::GetEditorContentUTF8(_di_IOTASourceEditor SourceEditor)
+// Reads the UTF8 encoded editor content into the buffer and returns its length. The chunks
+// are read straight into the buffer, which is only grown (by doubling its size) but never
+// shrunk, so a reused buffer doesn't need any allocation at all.
+int IDE::ReadEditorContentUTF8(_di_IOTASourceEditor SourceEditor, std::vector<char>& Buffer)
 {
-    const int kChunkSize = 1024;
-
-    char Buffer[kChunkSize];
-    std::vector<char> RawStr;
+    const int kChunkSize = 65536;
 
-    int Pos = 0;
+    int Length = 0;
     int BytesRead;
 
     // Get a reader with the editor content
     _di_IOTAEditReader Reader = SourceEditor->CreateReader();
 
-    // Read ANSI/UTF8 encoded editor content in chunks of kChunkSize
     do
     {
+        // Make room for the next chunk
+        if (Buffer.size() < static_cast<std::size_t>(Length + kChunkSize))
+            Buffer.resize(std::max(Buffer.size() * 2, static_cast<std::size_t>(Length + kChunkSize)));
+
         // Read a chunk
-        BytesRead = Reader->GetText(Pos, Buffer, kChunkSize);
+        BytesRead = Reader->GetText(Length, &Buffer[Length], kChunkSize);
 
-        // Append the chunk content to the vector
-        for (int k = 0; k < BytesRead; ++k)
-        {
-            RawStr.push_back(Buffer[k]);
-            ++Pos;
-        }
+        Length += BytesRead;
 
     } while (BytesRead == kChunkSize);
 
-    // Add the NULL termination
-    RawStr.push_back('\0');
+    return Length;
+}
+//---------------------------------------------------------------------------
+
+RawByteString IDE::GetEditorContentUTF8(_di_IOTASourceEditor SourceEditor)
+{
+    int Length = ReadEditorContentUTF8(SourceEditor, FContentBuffer);
+
+    RawByteString Content;
+
+    // Copy it as a whole (which keeps embedded NULs as well)
+    if (Length > 0)
+    {
+        Content.SetLength(Length);
+        std::memcpy(Content.c_str(), &FContentBuffer[0], Length);
+    }
 
     // Return it as a UTF8-encoded RawByteString
-    return &RawStr[0];
+    return Content;
 }
 //---------------------------------------------------------------------------
 
@@ -510,15 +639,24 @@ String IDE::GetEditorContent(_di_IOTASourceEditor SourceEditor)
 }
 //---------------------------------------------------------------------------
 
+// Writes the contents of the changed C++ editors to their temporary files. Only the buffers
+// with a new change time are read, and their content is compared with the hash of the
+// last written content (kept in 'Stamps').
 void IDE::ExtractAllEditorsContent(
-    const String& ProjectPath,
+    TChBldContentStore& ContentStore,
     std::map<String, String>& Results,
+    TChBldEditorStamps& Stamps,
     std::map<String, String>* ChangedFiles
     )
 {
     if (ChangedFiles)
         ChangedFiles->clear();
 
+    unsigned int StartTicks = GetTickCount();
+
+    int             ReadEditors = 0;
+    __int64         ReadBytes   = 0;
+
     _di_IOTAModuleServices ModuleServices = GetInterface<_di_IOTAModuleServices>();
 
     // Iterate over all project modules
@@ -543,63 +681,82 @@ void IDE::ExtractAllEditorsContent(
 
                 if (IsCpp || IsHpp)
                 {
-                    // Read the whole UTF8 editor content to a RawByteString
-                    RawByteString Content = GetEditorContentUTF8(SourceEditor);
-
-                    String ContentFileName;
-
-                    // If we don't have a temporary file name yet
-                    if (Results.count(FileName) == 0)
+                    // Get the time of the last change to the buffer (if the editor has one)
+                    _di_IOTAEditBuffer  EditBuffer;
+                    TDateTime           ChangeTime = 0;
+
+                    if (SourceEditor->Supports(EditBuffer))
+                        ChangeTime = EditBuffer->GetCurrentDate();
+
+                    TChBldEditorStamps::iterator Stamp = Stamps.find(FileName);
+
+                    // We know the content if it was written to a (still existing) slot file
+                    bool IsKnown =
+                        (Stamp != Stamps.end())
+                            && (Results.count(FileName) > 0)
+                            && FileExists(Results[FileName]);
+
+                    // Skip the buffers which haven't been changed since the last sync
+                    if (IsKnown
+                        && (static_cast<double>(ChangeTime) != 0)
+                        && (Stamp->second.ChangeTime == ChangeTime)
+                        && (MilliSecondsBetween(Now(), ChangeTime) > kRecentChangeTime))
                     {
-                        // Create a unique file name
-                        ContentFileName =
-                            ProjectPath
-                            + L"__chbld\\chbld_"
-                            + Environment::CreateGuidString()
-                            + ExtractFileExt(FileName);
-                    }
-                    else
-                    {
-                        // Get the current file name
-                        ContentFileName = Results[FileName];
+                        continue;
                     }
 
-                    bool Changed = true;
+                    // Read the whole UTF8 editor content into the reused buffer
+                    int Length = ReadEditorContentUTF8(SourceEditor, FContentBuffer);
 
-                    // Detect if an existing file differs from the current editor content
-                    if (FileExists(ContentFileName))
-                    {
-                        String EditorHash   = THashMD5::GetHashString(Content);
-                        String FileHash     = THashMD5::GetHashStringFromFile(ContentFileName);
+                    ++ReadEditors;
+                    ReadBytes += Length;
 
-                        if (EditorHash == FileHash)
-                            Changed = false;
-                    }
+                    // A fast non-cryptographic hash is sufficient to detect a change
+                    int Hash = THashBobJenkins::GetHashValue(&FContentBuffer[0], Length, 0);
+
+                    bool Changed =
+                        !IsKnown
+                            || (Stamp->second.Hash != Hash)
+                            || (Stamp->second.Length != Length);
+
+                    TChBldEditorStamp NewStamp = {ChangeTime, Hash, Length};
+
+                    Stamps[FileName] = NewStamp;
+
+                    // Only store a new snapshot if there really was a change in the editor
+                    if (!Changed)
+                        continue;
+
+                    // Store the UTF8 content as it is (without a conversion to UTF16 and
+                    // back), it gets a slot file which isn't used by a running parse job
+                    TChBldContentSnapshotPtr Snapshot =
+                        ContentStore.Add(FileName, &FContentBuffer[0], Length);
 
-                    // Only overwrite the file if there really was a change in the editor
-                    if (Changed)
+                    if (ChangedFiles)
                     {
-                        if (ChangedFiles)
-                        {
-                            // Add the file to the 'changed' list
-                            (*ChangedFiles)[FileName] = ContentFileName;
-                        }
-
-                        // Create a StreamWriter...
-                        std::unique_ptr<TStreamWriter> ContentWriter(
-                            new TStreamWriter(ContentFileName, false)
-                            );
-
-                        // ...and write the content down to the temporary file
-                        ContentWriter->Write(Content);
-
-                        // Add the filename/uniquename relationship to the map
-                        Results[FileName] = ContentFileName;
+                        // Add the file to the 'changed' list
+                        (*ChangedFiles)[FileName] = Snapshot->SlotFile;
                     }
+
+                    // Add the filename/slot file relationship to the map
+                    Results[FileName] = Snapshot->SlotFile;
                 }
             }
         }
     }
+
+    if (ReadEditors > 0)
+    {
+        CS_SEND(
+            L"IDE::ExtractAllEditorsContent(Read "
+                + String(ReadBytes)
+                + L" bytes of "
+                + String(ReadEditors)
+                + L" editors in "
+                + String(GetTickCount() - StartTicks)
+                + L" ms)"
+            );
+    }
 }
 //---------------------------------------------------------------------------
 
@@ -610,8 +767,8 @@ void IDE::RemoveOldTempFiles(const String& ProjectPath)
 
     for (int i = 0; i < TempFiles.Length; ++i)
     {
-        // Don't delete the database...
-        if (TempFiles[i].Pos(kDBFileName) == 0)
+        // Don't delete the databases (they're managed by the project DB)...
+        if (!StartsText(kDBFilePrefix, ExtractFileName(TempFiles[i])))
         {
             // ...but every other temp file
             DeleteFile(TempFiles[i]);
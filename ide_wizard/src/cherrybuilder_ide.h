@@ -38,11 +38,24 @@
 #include <System.Win.Registry.hpp>
 
 #include "cherrybuilder_environment.h"
+#include "cherrybuilder_contentstore.h"
 //---------------------------------------------------------------------------
 
 namespace Cherrybuilder
 {
 
+// The change state of an editor buffer, kept between the syncs of its content
+struct TChBldEditorStamp
+{
+    TDateTime   ChangeTime;
+    int         Hash;
+    int         Length;
+};
+//---------------------------------------------------------------------------
+
+typedef std::map<String, TChBldEditorStamp> TChBldEditorStamps;
+//---------------------------------------------------------------------------
+
 class IDE
 {
 public:
@@ -86,19 +99,29 @@ public:
 
     static String   GetCurrentTargetOS();
     static String   GetCurrentPlatform();
+    static String   GetCurrentCompilerFamily();
+    static String   GetCurrentBuildVariant();
     static int      GetCurrentEditorCppTabWidth();
     static String   GetCurrentEditorFontName();
     static int      GetCurrentEditorFontSize();
     static bool     GetCurrentEditorPos(int& Line, int& Column, String& FileName);
+    static String   GetCurrentEditorFileName();
+    static void     GetCurrentProjectFiles(VString& Files);
 
     static _di_IOTAEditActions GetCurrentEditActions();
 
+    static int              ReadEditorContentUTF8(
+                                _di_IOTASourceEditor SourceEditor,
+                                std::vector<char>& Buffer
+                                );
+
     static RawByteString    GetEditorContentUTF8(_di_IOTASourceEditor SourceEditor);
     static String           GetEditorContent(_di_IOTASourceEditor SourceEditor);
 
     static void     ExtractAllEditorsContent(
-                        const String& ProjectPath,
+                        TChBldContentStore& ContentStore,
                         std::map<String, String>& Results,
+                        TChBldEditorStamps& Stamps,
                         std::map<String, String>* ChangedFiles=NULL
                         );
 
@@ -121,6 +144,10 @@ public:
 
 private:
     static _di_IBorlandIDEServices FIDESrv;
+
+    // The buffer the editor contents are read into, it keeps its size between the reads
+    // (only used by the main thread)
+    static std::vector<char> FContentBuffer;
 };
 
 } // namespace Cherrybuilder
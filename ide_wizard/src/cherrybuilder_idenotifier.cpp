@@ -70,6 +70,10 @@ void __fastcall TChBldIDENotifier::FileNotification(
 
         case ofnFileOpened:
             CS_SEND(L"IDENotifier::FileNotification:ofnFileOpened(" + FileName + L")");
+
+            // Sync the contents of the new editor without waiting for the next poll
+            FAnalyzer->NotifyEdit();
+
         break;
 
         case ofnFileClosing:
@@ -182,12 +186,20 @@ void __fastcall TChBldIDENotifier::BeforeCompile(
             }
         }
     }
+    // A real build holds back the background analysis (it competes for the cores)
+    else
+    {
+        FAnalyzer->NotifyBuild(true);
+    }
 }
 //---------------------------------------------------------------------------
 
 void __fastcall TChBldIDENotifier::AfterCompile(bool Succeeded, bool IsCodeInsight)
 {
     CS_SEND(L"IDENotifier::AfterCompile(bool, bool)");
+
+    if (!IsCodeInsight)
+        FAnalyzer->NotifyBuild(false);
 }
 //---------------------------------------------------------------------------
 
@@ -198,6 +210,9 @@ void __fastcall TChBldIDENotifier::AfterCompile(
     )
 {
     CS_SEND(L"IDENotifier::AfterCompile(_di_IOTAProject, bool, bool)");
+
+    if (!IsCodeInsight)
+        FAnalyzer->NotifyBuild(false);
 }
 //---------------------------------------------------------------------------
 
@@ -225,4 +240,72 @@ void __fastcall TChBldIDENotifier::Modified()
 }
 //---------------------------------------------------------------------------
 
+__fastcall TChBldDebuggerNotifier::TChBldDebuggerNotifier(TChBldAnalyzer* Analyzer)
+    :   FAnalyzer(Analyzer),
+        FProcessCount(IDE::GetInterface<_di_IOTADebuggerServices>()->ProcessCount)
+{
+    CS_SEND(L"DebuggerNotifier::Constructor");
+
+    // A debug session may already run when we're loaded
+    FAnalyzer->NotifyDebugging(FProcessCount > 0);
+}
+//---------------------------------------------------------------------------
+
+__fastcall TChBldDebuggerNotifier::~TChBldDebuggerNotifier()
+{
+    CS_SEND(L"DebuggerNotifier::Destructor");
+}
+//---------------------------------------------------------------------------
+
+void __fastcall TChBldDebuggerNotifier::ProcessCreated(const _di_IOTAProcess Process)
+{
+    CS_SEND(L"DebuggerNotifier::ProcessCreated");
+
+    // Only the first process starts the debug session
+    if (++FProcessCount == 1)
+        FAnalyzer->NotifyDebugging(true);
+}
+//---------------------------------------------------------------------------
+
+void __fastcall TChBldDebuggerNotifier::ProcessDestroyed(const _di_IOTAProcess Process)
+{
+    CS_SEND(L"DebuggerNotifier::ProcessDestroyed");
+
+    // Only the last process ends the debug session
+    if ((FProcessCount > 0) && (--FProcessCount == 0))
+        FAnalyzer->NotifyDebugging(false);
+}
+//---------------------------------------------------------------------------
+
+void __fastcall TChBldDebuggerNotifier::BreakpointAdded(const _di_IOTABreakpoint Breakpoint)
+{
+}
+//---------------------------------------------------------------------------
+
+void __fastcall TChBldDebuggerNotifier::BreakpointDeleted(const _di_IOTABreakpoint Breakpoint)
+{
+}
+//---------------------------------------------------------------------------
+
+void __fastcall TChBldDebuggerNotifier::AfterSave()
+{
+}
+//---------------------------------------------------------------------------
+
+void __fastcall TChBldDebuggerNotifier::BeforeSave()
+{
+}
+//---------------------------------------------------------------------------
+
+void __fastcall TChBldDebuggerNotifier::Destroyed()
+{
+    CS_SEND(L"DebuggerNotifier::Destroyed");
+}
+//---------------------------------------------------------------------------
+
+void __fastcall TChBldDebuggerNotifier::Modified()
+{
+}
+//---------------------------------------------------------------------------
+
 } // namespace Cherrybuilder
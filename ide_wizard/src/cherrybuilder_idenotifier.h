@@ -81,6 +81,34 @@ private:
 };
 
 
+// Tells the analyzer while the debugger runs a process (the background work is held back
+// meanwhile)
+class TChBldDebuggerNotifier : public TCppInterfacedObject<IOTADebuggerNotifier>
+{
+public:
+    __fastcall TChBldDebuggerNotifier(TChBldAnalyzer* Analyzer);
+
+    __fastcall ~TChBldDebuggerNotifier();
+
+private:
+
+    /* IOTADebuggerNotifier */
+    void __fastcall ProcessCreated(const _di_IOTAProcess Process);
+    void __fastcall ProcessDestroyed(const _di_IOTAProcess Process);
+    void __fastcall BreakpointAdded(const _di_IOTABreakpoint Breakpoint);
+    void __fastcall BreakpointDeleted(const _di_IOTABreakpoint Breakpoint);
+
+    /* IOTANotifier */
+    void __fastcall AfterSave();
+    void __fastcall BeforeSave();
+    void __fastcall Destroyed();
+    void __fastcall Modified();
+
+    TChBldAnalyzer              *FAnalyzer;
+    int                         FProcessCount;
+};
+
+
 } // namespace Cherrybuilder
 
 #endif
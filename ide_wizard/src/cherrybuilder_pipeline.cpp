@@ -0,0 +1,795 @@
+﻿/* ===============================================================================
+ * CherryBuilder - The Productivity Extension for C++Builder®
+ * ===============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2017 Florian Koch <flko@mail.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ===============================================================================
+ */
+
+#include <vcl.h>
+#pragma hdrstop
+
+#include "cherrybuilder_pipeline.h"
+
+#include <algorithm>
+#include <set>
+
+#include "cherrybuilder_debugtools.h"
+//---------------------------------------------------------------------------
+
+#pragma package(smart_init)
+
+namespace Cherrybuilder
+{
+
+// The interval (ms) in which the idle writer checks whether the DB maintenance is due
+const unsigned int kMaintainInterval = 1000;
+
+// The maximum number of files tagged by one shard
+const int kShardFiles = 32;
+//---------------------------------------------------------------------------
+
+__fastcall TChBldPipelineWorker::TChBldPipelineWorker(
+    TChBldParsePipeline& Pipeline,
+    TChBldPipelineStageProc StageProc
+    )
+    :   TThread(false),
+        FPipeline(Pipeline),
+        FStageProc(StageProc)
+{
+    //
+}
+//---------------------------------------------------------------------------
+
+void __fastcall TChBldPipelineWorker::Execute()
+{
+    (FPipeline.*FStageProc)();
+}
+//---------------------------------------------------------------------------
+
+TChBldParsePipeline::TChBldParsePipeline(
+    Ctags::TParser& CtagsParser,
+    TChBldProjectDB& ProjectDB,
+    int TaggingWorkers,
+    int QueueDepth
+    )
+    :   FCtagsParser(CtagsParser),
+        FProjectDB(ProjectDB),
+        FTaggingWorkers(TaggingWorkers > 0 ? TaggingWorkers : 1),
+        FIncludeQueue(QueueDepth),
+        FTaggingQueue(QueueDepth * FTaggingWorkers),
+        FPostProcessingQueue(QueueDepth * FTaggingWorkers),
+        FWriterQueue(QueueDepth),
+        FWriterMutex(new TMutex(false)),
+        FJobMutex(new TMutex(false)),
+        FIdleCondition(new TConditionVariableMutex),
+        FClosed(false),
+        FTaggingCondition(new TConditionVariableMutex),
+        FTaggingLimit(FTaggingWorkers),
+        FActiveTaggingWorkers(0),
+        FNextSequence(0),
+        FStatsMutex(new TMutex(false))
+{
+    CS_SEND(L"Pipeline::Constructor");
+
+    for (int i = 0; i < psCount; ++i)
+    {
+        FStageItems[i]      = 0;
+        FStageBusyTime[i]   = 0;
+    }
+
+    // Start the workers (one per stage, except for the tagging which runs in parallel)
+    FWorkers.push_back(new TChBldPipelineWorker(*this, &TChBldParsePipeline::RunIncludeStage));
+
+    for (int i = 0; i < FTaggingWorkers; ++i)
+        FWorkers.push_back(new TChBldPipelineWorker(*this, &TChBldParsePipeline::RunTaggingStage));
+
+    FWorkers.push_back(new TChBldPipelineWorker(*this, &TChBldParsePipeline::RunPostProcessingStage));
+    FWorkers.push_back(new TChBldPipelineWorker(*this, &TChBldParsePipeline::RunWriterStage));
+}
+//---------------------------------------------------------------------------
+
+TChBldParsePipeline::~TChBldParsePipeline()
+{
+    CS_SEND(L"Pipeline::Destructor");
+
+    // Closing the queues ends the workers (the queued jobs are dropped, a running DB
+    // write is finished)
+    FIncludeQueue.Close();
+    FTaggingQueue.Close();
+    FPostProcessingQueue.Close();
+    FWriterQueue.Close();
+
+    // Begin of interlock
+    {
+        TChBldLockGuard LG(FJobMutex);
+
+        FClosed = true;
+        FIdleCondition->ReleaseAll();
+        FTaggingCondition->ReleaseAll();
+    }
+    // End of interlock
+
+    foreach_ (TChBldPipelineWorker* Worker, FWorkers)
+    {
+        Worker->WaitFor();
+        delete Worker;
+    }
+
+    FWorkers.clear();
+
+    delete FStatsMutex;
+    delete FTaggingCondition;
+    delete FIdleCondition;
+    delete FJobMutex;
+    delete FWriterMutex;
+}
+//---------------------------------------------------------------------------
+
+// Blocks while the include stage is full, returns false if the pipeline is closed
+bool TChBldParsePipeline::Submit(const TChBldParseJobPtr& Job)
+{
+    std::pair<String, String> FilenameLookup;
+
+    // The tags are remapped by their temporary file, so look them up in reverse
+    Job->TemporaryFileMap.clear();
+
+    foreach_ (FilenameLookup, Job->FilenameLookupMap)
+        Job->TemporaryFileMap[FilenameLookup.second] = FilenameLookup.first;
+
+    // Begin of interlock
+    {
+        TChBldLockGuard LG(FJobMutex);
+
+        if (FClosed)
+            return false;
+
+        Job->Sequence       = FNextSequence++;
+        Job->SubmitTicks    = GetTickCount();
+
+        FOpenJobs[Job->Sequence] = Job;
+    }
+    // End of interlock
+
+    CS_SEND(
+        L"Pipeline::Submit(Job "
+            + String(Job->Sequence)
+            + L", priority "
+            + String(static_cast<int>(Job->Priority))
+            + L")"
+        );
+
+    if (!FIncludeQueue.Push(Job, Job->Priority))
+    {
+        TChBldLockGuard LG(FJobMutex);
+
+        FOpenJobs.erase(Job->Sequence);
+
+        return false;
+    }
+
+    return true;
+}
+//---------------------------------------------------------------------------
+
+// Waits until all submitted jobs are written to the DB
+void TChBldParsePipeline::WaitIdle()
+{
+    TChBldLockGuard LG(FJobMutex);
+
+    while (!FOpenJobs.empty() && !FClosed)
+        FIdleCondition->WaitFor(FJobMutex, INFINITE);
+}
+//---------------------------------------------------------------------------
+
+// Returns true if no submitted job is waiting to be written (used to hold the background
+// work back while there's interactive work)
+bool TChBldParsePipeline::IsIdle()
+{
+    TChBldLockGuard LG(FJobMutex);
+
+    return FOpenJobs.empty();
+}
+//---------------------------------------------------------------------------
+
+// Limits the number of tagging workers running at once (a running one finishes its shard)
+void TChBldParsePipeline::SetTaggingLimit(int Limit)
+{
+    TChBldLockGuard LG(FJobMutex);
+
+    FTaggingLimit = std::max(1, std::min(Limit, FTaggingWorkers));
+
+    FTaggingCondition->ReleaseAll();
+}
+//---------------------------------------------------------------------------
+
+// Waits until the tagging limit allows another worker to run, returns false if the
+// pipeline is closed
+bool TChBldParsePipeline::AcquireTaggingSlot()
+{
+    TChBldLockGuard LG(FJobMutex);
+
+    while ((FActiveTaggingWorkers >= FTaggingLimit) && !FClosed)
+        FTaggingCondition->WaitFor(FJobMutex, INFINITE);
+
+    if (FClosed)
+        return false;
+
+    ++FActiveTaggingWorkers;
+
+    return true;
+}
+//---------------------------------------------------------------------------
+
+void TChBldParsePipeline::ReleaseTaggingSlot()
+{
+    TChBldLockGuard LG(FJobMutex);
+
+    --FActiveTaggingWorkers;
+
+    FTaggingCondition->ReleaseAll();
+}
+//---------------------------------------------------------------------------
+
+void TChBldParsePipeline::GetStats(std::vector<TChBldPipelineStageStats>& Stats)
+{
+    Stats.clear();
+
+    const wchar_t* StageNames[psCount] = {L"Includes", L"Tagging", L"PostProcessing", L"Writer"};
+
+    TChBldQueueStats QueueStats[psCount] =
+    {
+        FIncludeQueue.GetStats(),
+        FTaggingQueue.GetStats(),
+        FPostProcessingQueue.GetStats(),
+        FWriterQueue.GetStats()
+    };
+
+    TChBldLockGuard LG(FStatsMutex);
+
+    for (int i = 0; i < psCount; ++i)
+    {
+        TChBldPipelineStageStats StageStats;
+
+        StageStats.Name     = StageNames[i];
+        StageStats.Queue    = QueueStats[i];
+        StageStats.Items    = FStageItems[i];
+        StageStats.BusyTime = FStageBusyTime[i];
+
+        Stats.push_back(StageStats);
+    }
+}
+//---------------------------------------------------------------------------
+
+void TChBldParsePipeline::RunIncludeStage()
+{
+    TChBldParseJobPtr Job;
+
+    while (FIncludeQueue.Pop(Job) == qrItem)
+    {
+        unsigned int StartTicks = GetTickCount();
+
+        // The files to be tagged by their tier
+        std::vector<VString> TierFiles(ppCount);
+
+        bool Failed = false;
+
+        try
+        {
+            ResolveIncludes(*Job, TierFiles);
+        }
+        catch (Exception& E)
+        {
+            CS_SEND(L"Pipeline::RunIncludeStage(Failed: " + E.Message + L")");
+
+            Failed = true;
+
+            TierFiles.assign(ppCount, VString());
+        }
+
+        std::vector<TChBldParseShardPtr> ShardList;
+
+        for (int Tier = 0; Tier < ppCount; ++Tier)
+        {
+            const VString& Files = TierFiles[Tier];
+
+            // There's always a part with the job's own files (even without any), so each
+            // job arrives at the writer
+            bool IsEditorPart = (Tier == Job->Priority);
+
+            if (Files.empty() && !IsEditorPart)
+                continue;
+
+            TChBldParsePartPtr Part(new TChBldParsePart);
+
+            Part->Job           = Job;
+            Part->Priority      = static_cast<TChBldParsePriority>(Tier);
+            Part->IsEditorPart  = IsEditorPart;
+            Part->Failed        = Failed;
+
+            // Split the files into (contiguous) shards for the tagging workers
+            int FileCount = Files.size();
+
+            Part->Shards =
+                std::max(
+                    1,
+                    std::max(
+                        std::min(FTaggingWorkers, FileCount),
+                        (FileCount + kShardFiles - 1) / kShardFiles
+                        )
+                    );
+
+            for (int i = 0; i < Part->Shards; ++i)
+            {
+                TChBldParseShardPtr Shard(new TChBldParseShard);
+
+                Shard->Part = Part;
+                Shard->Files.assign(
+                    Files.begin() + (FileCount * i) / Part->Shards,
+                    Files.begin() + (FileCount * (i + 1)) / Part->Shards
+                    );
+
+                ShardList.push_back(Shard);
+            }
+
+            // Begin of interlock
+            {
+                TChBldLockGuard LG(FJobMutex);
+
+                ++Job->Parts;
+            }
+            // End of interlock
+        }
+
+        AddStageWork(psIncludes, StartTicks);
+
+        foreach_ (const TChBldParseShardPtr& Shard, ShardList)
+        {
+            if (!FTaggingQueue.Push(Shard, Shard->Part->Priority))
+                return;
+        }
+    }
+}
+//---------------------------------------------------------------------------
+
+void TChBldParsePipeline::RunTaggingStage()
+{
+    TChBldParseShardPtr Shard;
+
+    // A worker waits for its turn before it takes a shard (so a lowered tagging limit holds
+    // the surplus workers back)
+    while (AcquireTaggingSlot())
+    {
+        if (FTaggingQueue.Pop(Shard) != qrItem)
+        {
+            ReleaseTaggingSlot();
+            return;
+        }
+
+        unsigned int StartTicks = GetTickCount();
+
+        try
+        {
+            if (Shard->Files.size() > 0)
+                FCtagsParser.ParseTags(Shard->Files, Shard->Tags);
+        }
+        catch (Exception& E)
+        {
+            CS_SEND(L"Pipeline::RunTaggingStage(Failed: " + E.Message + L")");
+
+            Shard->Failed = true;
+        }
+
+        AddStageWork(psTagging, StartTicks);
+
+        ReleaseTaggingSlot();
+
+        if (!FPostProcessingQueue.Push(Shard, Shard->Part->Priority))
+            return;
+    }
+}
+//---------------------------------------------------------------------------
+
+void TChBldParsePipeline::RunPostProcessingStage()
+{
+    // The completed parts waiting for the parts they must not overtake
+    std::vector<TChBldParsePartPtr> CompletedParts;
+
+    TChBldParseShardPtr Shard;
+
+    while (FPostProcessingQueue.Pop(Shard) == qrItem)
+    {
+        unsigned int StartTicks = GetTickCount();
+
+        TChBldParsePartPtr Part = Shard->Part;
+
+        if (Shard->Failed)
+            Part->Failed = true;
+
+        ReplaceTemporaryFileNames(*Part->Job, Shard->Tags);
+
+        Part->Tags.insert(Part->Tags.end(), Shard->Tags.begin(), Shard->Tags.end());
+
+        // The shard isn't needed anymore (and holds a reference to the part)
+        Shard.reset();
+
+        if (++Part->ShardsDone == Part->Shards)
+            CompletedParts.push_back(Part);
+
+        AddStageWork(psPostProcessing, StartTicks);
+
+        if (!DispatchParts(CompletedParts))
+            return;
+    }
+}
+//---------------------------------------------------------------------------
+
+// Hands the writable completed parts to the writer, the highest tier first (returns false
+// if the pipeline is closed)
+bool TChBldParsePipeline::DispatchParts(std::vector<TChBldParsePartPtr>& CompletedParts)
+{
+    for (;;)
+    {
+        int NextPart = -1;
+
+        // Begin of interlock
+        {
+            TChBldLockGuard LG(FJobMutex);
+
+            for (std::size_t i = 0; i < CompletedParts.size(); ++i)
+            {
+                const TChBldParsePart& Part = *CompletedParts[i];
+
+                if (!IsPartWritable(Part))
+                    continue;
+
+                if ((NextPart == -1)
+                    || (Part.Priority < CompletedParts[NextPart]->Priority)
+                    || ((Part.Priority == CompletedParts[NextPart]->Priority)
+                        && (Part.Job->Sequence < CompletedParts[NextPart]->Job->Sequence)))
+                {
+                    NextPart = i;
+                }
+            }
+
+            // The parts are written in the order of dispatching, so the state changes now
+            if (NextPart != -1 && CompletedParts[NextPart]->IsEditorPart)
+                CompletedParts[NextPart]->Job->EditorPartPending = false;
+        }
+        // End of interlock
+
+        if (NextPart == -1)
+            return true;
+
+        TChBldParsePartPtr Part = CompletedParts[NextPart];
+
+        CompletedParts.erase(CompletedParts.begin() + NextPart);
+
+        if (!FWriterQueue.Push(Part))
+            return false;
+    }
+}
+//---------------------------------------------------------------------------
+
+// Returns whether the part can be written without overtaking a part it depends on (the
+// caller has to hold 'FJobMutex')
+bool TChBldParsePipeline::IsPartWritable(const TChBldParsePart& Part)
+{
+    const TChBldParseJob& Job = *Part.Job;
+
+    // The includes of a rebuild are added to the database built with the job's own files
+    if (Job.DeepRefresh && !Part.IsEditorPart && Job.EditorPartPending)
+        return false;
+
+    std::map<unsigned int, TChBldParseJobPtr>::const_iterator EarlierJob;
+
+    for (EarlierJob = FOpenJobs.begin();
+         (EarlierJob != FOpenJobs.end()) && (EarlierJob->first < Job.Sequence);
+         ++EarlierJob)
+    {
+        if (!EarlierJob->second->EditorPartPending)
+            continue;
+
+        // Nothing may be written before an earlier rebuild (which replaces the database)...
+        if (EarlierJob->second->DeepRefresh)
+            return false;
+
+        // ...and the diffs of the editor contents keep their order
+        if (Part.IsEditorPart)
+            return false;
+    }
+
+    return true;
+}
+//---------------------------------------------------------------------------
+
+void TChBldParsePipeline::RunWriterStage()
+{
+    for (;;)
+    {
+        TChBldParsePartPtr Part;
+
+        TChBldQueueResult Result = FWriterQueue.Pop(Part, kMaintainInterval);
+
+        if (Result == qrClosed)
+            break;
+
+        // Begin of interlock
+        {
+            TChBldLockGuard LG(FWriterMutex);
+
+            if (Result == qrItem)
+            {
+                unsigned int StartTicks = GetTickCount();
+
+                const TChBldParseJob& Job = *Part->Job;
+
+                if (!Part->Failed)
+                {
+                    try
+                    {
+                        // The job's own files are written with its options, the tags of the
+                        // includes are added
+                        if (Part->IsEditorPart)
+                        {
+                            FProjectDB.Refresh(
+                                Part->Tags,
+                                Job.DeepRefresh,
+                                Job.DeleteFilesContent,
+                                &Job.ContentFiles
+                                );
+                        }
+                        else
+                        {
+                            FProjectDB.Refresh(Part->Tags);
+                        }
+                    }
+                    catch (Exception& E)
+                    {
+                        CS_SEND(L"Pipeline::RunWriterStage(Failed: " + E.Message + L")");
+                    }
+                }
+
+                AddStageWork(psWriter, StartTicks);
+
+                CS_SEND(
+                    L"Pipeline::RunWriterStage(Job "
+                        + String(Job.Sequence)
+                        + L", priority "
+                        + String(static_cast<int>(Part->Priority))
+                        + L" written "
+                        + String(GetTickCount() - Job.SubmitTicks)
+                        + L" ms after submission)"
+                    );
+
+                // The completion in the active file is available now
+                if ((Part->Priority == ppActiveEditor) && (Job.ProjectOpenTicks != 0))
+                {
+                    CS_SEND(
+                        L"Pipeline::RunWriterStage(Active file ready "
+                            + String(GetTickCount() - Job.ProjectOpenTicks)
+                            + L" ms after the project was opened)"
+                        );
+                }
+
+                LogStats();
+
+                FinishPart(*Part);
+            }
+
+            // Checkpoint, vacuum and analyze the DB if it's due (this is the only writing
+            // thread)
+            if (!FProjectDB.ProjectPath.IsEmpty())
+                FProjectDB.Maintain();
+        }
+        // End of interlock
+    }
+}
+//---------------------------------------------------------------------------
+
+// Gets the files to be tagged by their tier: The job's own files (the editor content files
+// and the other files), the direct and transitive includes of the editor content files and
+// the SDK headers among them
+void TChBldParsePipeline::ResolveIncludes(
+    const TChBldParseJob& Job,
+    std::vector<VString>& TierFiles
+    )
+{
+    CS_SEND(L"Pipeline::ResolveIncludes(Begin)");
+    unsigned int StartTicks = GetTickCount();
+
+    // Only the includes of the active editor are preferred to the other editors
+    TChBldParsePriority DirectIncludesTier =
+        (Job.Priority == ppActiveEditor) ? ppDirectIncludes : ppTransitiveIncludes;
+
+    if (Job.EditorContentFiles.size() > 0)
+    {
+        VString EditorContentFiles(Job.EditorContentFiles);
+
+        VString DirectIncludes;
+        VString Includes;
+
+        // Get the direct includes (the first level of the full include file parsing, which
+        // is repeated there, but it's only a small part of it)...
+        FCtagsParser.ParseIncludes(EditorContentFiles, DirectIncludes);
+
+        // ...and do a full include file parsing with the files
+        FCtagsParser.FullParseIncludes(EditorContentFiles, Includes);
+
+        std::set<String> DirectIncludeSet;
+
+        foreach_ (const String& DirectInclude, DirectIncludes)
+            DirectIncludeSet.insert(DirectInclude.LowerCase());
+
+        foreach_ (const String& Include, Includes)
+        {
+            if (FCtagsParser.IsIdeIncludeFile(Include))
+                TierFiles[ppSDKHeaders].push_back(Include);
+            else if (DirectIncludeSet.count(Include.LowerCase()) > 0)
+                TierFiles[DirectIncludesTier].push_back(Include);
+            else
+                TierFiles[ppTransitiveIncludes].push_back(Include);
+        }
+
+        String RtlIncludePath =
+            IncludeTrailingPathDelimiter(GetEnvironmentVariable(L"BDSINCLUDE"))
+                + IDE::GetCurrentTargetOS()
+                + L"\\rtl\\";
+
+        VString& SDKFiles = TierFiles[ppSDKHeaders];
+
+        // Add some system files to the files list (they are needed but not included automatically)
+        SDKFiles.push_back(String(RtlIncludePath + L"systobj.h").LowerCase());
+        SDKFiles.push_back(String(RtlIncludePath + L"sysclass.h").LowerCase());
+        SDKFiles.push_back(String(RtlIncludePath + L"syscomp.h").LowerCase());
+        SDKFiles.push_back(String(RtlIncludePath + L"syscurr.h").LowerCase());
+        SDKFiles.push_back(String(RtlIncludePath + L"sysdefs.h").LowerCase());
+        SDKFiles.push_back(String(RtlIncludePath + L"sysdyn.h").LowerCase());
+        SDKFiles.push_back(String(RtlIncludePath + L"sysmac.h").LowerCase());
+        SDKFiles.push_back(String(RtlIncludePath + L"sysopen.h").LowerCase());
+        SDKFiles.push_back(String(RtlIncludePath + L"sysset.h").LowerCase());
+        SDKFiles.push_back(String(RtlIncludePath + L"systdate.h").LowerCase());
+
+        // Add the IDE editor content files to the files list
+        foreach_ (const String& EditorContentFile, Job.EditorContentFiles)
+            TierFiles[Job.Priority].push_back(EditorContentFile);
+    }
+
+    // Add the other files to the files list (without their includes)
+    foreach_ (const String& OtherFile, Job.OtherFiles)
+    {
+        // Vanished files are only passed to get their tags removed
+        if (FileExists(OtherFile))
+            TierFiles[Job.Priority].push_back(OtherFile);
+    }
+
+    CS_SEND(L"Pipeline::ResolveIncludes(End, " + String(GetTickCount() - StartTicks) + L")");
+}
+//---------------------------------------------------------------------------
+
+void TChBldParsePipeline::ReplaceTemporaryFileNames(const TChBldParseJob& Job, Ctags::VTag& Tags)
+{
+    // The resolved name of each distinct file of the tags (as written by ctags -> correct)
+    std::unordered_map<String, String, TChBldStringHash> ResolvedFiles;
+
+    // Ctags writes the tags file by file, so a run of tags shares the last resolved name
+    String  LastFile;
+    String  LastResolvedFile;
+    bool    HasLastFile = false;
+
+    // Iterate over each tag entry of the parsing results
+    foreach_ (Ctags::TTag& Tag, Tags)
+    {
+        if (HasLastFile && (Tag.File == LastFile))
+        {
+            Tag.File = LastResolvedFile;
+            continue;
+        }
+
+        LastFile    = Tag.File;
+        HasLastFile = true;
+
+        std::unordered_map<String, String, TChBldStringHash>::const_iterator Resolved =
+            ResolvedFiles.find(Tag.File);
+
+        if (Resolved != ResolvedFiles.end())
+        {
+            LastResolvedFile = Resolved->second;
+        }
+        else
+        {
+            // Replace double backslashes with only one
+            LastResolvedFile =
+                StringReplace(
+                    Tag.File,
+                    L"\\\\",
+                    L"\\",
+                    TReplaceFlags() << rfReplaceAll
+                    );
+
+            // Replace temporary file names with the correct ones
+            std::unordered_map<String, String, TChBldStringHash>::const_iterator Original =
+                Job.TemporaryFileMap.find(LastResolvedFile);
+
+            if (Original != Job.TemporaryFileMap.end())
+                LastResolvedFile = Original->second;
+
+            ResolvedFiles[Tag.File] = LastResolvedFile;
+        }
+
+        Tag.File = LastResolvedFile;
+    }
+}
+//---------------------------------------------------------------------------
+
+void TChBldParsePipeline::AddStageWork(TStage Stage, unsigned int StartTicks)
+{
+    TChBldLockGuard LG(FStatsMutex);
+
+    ++FStageItems[Stage];
+    FStageBusyTime[Stage] += GetTickCount() - StartTicks;
+}
+//---------------------------------------------------------------------------
+
+void TChBldParsePipeline::FinishPart(const TChBldParsePart& Part)
+{
+    TChBldLockGuard LG(FJobMutex);
+
+    // The job is done with its last part
+    if (++Part.Job->PartsWritten == Part.Job->Parts)
+    {
+        FOpenJobs.erase(Part.Job->Sequence);
+
+        if (FOpenJobs.empty())
+            FIdleCondition->ReleaseAll();
+    }
+}
+//---------------------------------------------------------------------------
+
+void TChBldParsePipeline::LogStats()
+{
+    std::vector<TChBldPipelineStageStats> Stats;
+
+    GetStats(Stats);
+
+    foreach_ (const TChBldPipelineStageStats& StageStats, Stats)
+    {
+        CS_SEND(
+            L"Pipeline::Stats("
+                + StageStats.Name
+                + L": Queue "
+                + String(StageStats.Queue.Depth)
+                + L"/"
+                + String(StageStats.Queue.Capacity)
+                + L", blocked "
+                + String(StageStats.Queue.BlockedTime)
+                + L" ms, "
+                + String(StageStats.Items)
+                + L" items in "
+                + String(StageStats.BusyTime)
+                + L" ms)"
+            );
+    }
+}
+//---------------------------------------------------------------------------
+
+} // namespace Cherrybuilder
@@ -0,0 +1,452 @@
+﻿/* ===============================================================================
+ * CherryBuilder - The Productivity Extension for C++Builder®
+ * ===============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2017 Florian Koch <flko@mail.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ===============================================================================
+ */
+
+#ifndef cherrybuilder_pipelineH
+#define cherrybuilder_pipelineH
+//---------------------------------------------------------------------------
+
+#include <System.SyncObjs.hpp>
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <boost/shared_ptr.hpp>
+
+#include "cherrybuilder_environment.h"
+#include "cherrybuilder_ctags.h"
+#include "cherrybuilder_projectdb.h"
+#include "cherrybuilder_contentstore.h"
+//---------------------------------------------------------------------------
+
+namespace Cherrybuilder
+{
+
+enum TChBldQueueResult
+{
+    qrItem,
+    qrTimeout,
+    qrClosed
+};
+//---------------------------------------------------------------------------
+
+// The usage of a queue between two pipeline stages
+struct TChBldQueueStats
+{
+    int             Depth;
+    int             Capacity;
+    unsigned int    Pushed;
+    unsigned int    BlockedTime;
+};
+//---------------------------------------------------------------------------
+
+// A queue between two pipeline stages. The items are taken by their priority (the lowest
+// value first) and in FIFO order within the same priority. The producer is blocked while
+// it's full (so a slow stage slows down the stages feeding it instead of piling up work)
+// and the consumer while it's empty. Closing it releases all waiting threads and drops
+// the queued items.
+template <class T>
+class TChBldBoundedQueue
+{
+public:
+    TChBldBoundedQueue(std::size_t ACapacity)
+        :   FMutex(new TMutex(false)),
+            FNotEmpty(new TConditionVariableMutex),
+            FNotFull(new TConditionVariableMutex),
+            FCapacity(ACapacity > 0 ? ACapacity : 1),
+            FCount(0),
+            FClosed(false),
+            FPushed(0),
+            FBlockedTime(0)
+    {
+        //
+    }
+
+    ~TChBldBoundedQueue()
+    {
+        delete FNotFull;
+        delete FNotEmpty;
+        delete FMutex;
+    }
+
+    // Returns false if the queue has been closed
+    bool Push(const T& Item, int Priority=0)
+    {
+        TChBldLockGuard LG(FMutex);
+
+        if (FCount >= FCapacity)
+        {
+            unsigned int StartTicks = GetTickCount();
+
+            while ((FCount >= FCapacity) && !FClosed)
+                FNotFull->WaitFor(FMutex, INFINITE);
+
+            FBlockedTime += GetTickCount() - StartTicks;
+        }
+
+        if (FClosed)
+            return false;
+
+        FItems[Priority].push_back(Item);
+        ++FCount;
+        ++FPushed;
+
+        FNotEmpty->Release();
+
+        return true;
+    }
+
+    TChBldQueueResult Pop(T& Item, unsigned int Timeout=INFINITE)
+    {
+        TChBldLockGuard LG(FMutex);
+
+        while ((FCount == 0) && !FClosed)
+        {
+            FNotEmpty->WaitFor(FMutex, Timeout);
+
+            // (a spurious wake up ends a finite wait early, which is harmless for the
+            // stages polling with a timeout)
+            if ((Timeout != INFINITE) && (FCount == 0) && !FClosed)
+                return qrTimeout;
+        }
+
+        if (FClosed)
+            return qrClosed;
+
+        typename TItemMap::iterator Items = FItems.begin();
+
+        Item = Items->second.front();
+        Items->second.pop_front();
+
+        if (Items->second.empty())
+            FItems.erase(Items);
+
+        --FCount;
+
+        FNotFull->Release();
+
+        return qrItem;
+    }
+
+    void Close()
+    {
+        TChBldLockGuard LG(FMutex);
+
+        FClosed = true;
+        FItems.clear();
+        FCount = 0;
+
+        FNotEmpty->ReleaseAll();
+        FNotFull->ReleaseAll();
+    }
+
+    TChBldQueueStats GetStats()
+    {
+        TChBldLockGuard LG(FMutex);
+
+        TChBldQueueStats Stats;
+
+        Stats.Depth         = FCount;
+        Stats.Capacity      = FCapacity;
+        Stats.Pushed        = FPushed;
+        Stats.BlockedTime   = FBlockedTime;
+
+        return Stats;
+    }
+
+private:
+    typedef std::map<int, std::deque<T> > TItemMap;
+
+    TMutex                  *FMutex;
+    TConditionVariableMutex *FNotEmpty;
+    TConditionVariableMutex *FNotFull;
+
+    TItemMap        FItems;
+    std::size_t     FCapacity;
+    std::size_t     FCount;
+    bool            FClosed;
+
+    unsigned int    FPushed;
+    unsigned int    FBlockedTime;
+};
+//---------------------------------------------------------------------------
+
+// The tiers of the analysis work, the files of a higher tier (lower value) are tagged
+// and written first
+enum TChBldParsePriority
+{
+    ppActiveEditor,
+    ppDirectIncludes,
+    ppOtherEditors,
+    ppTransitiveIncludes,
+    ppSDKHeaders,
+    ppProjectIndex,
+    ppCount
+};
+//---------------------------------------------------------------------------
+
+// A parse request of the analyzer: The editor content files are parsed with their
+// includes, the other files alone, and the results are written to the DB with the given
+// 'Refresh' options
+struct TChBldParseJob
+{
+    TChBldParseJob()
+        :   Sequence(0),
+            Priority(ppOtherEditors),
+            DeepRefresh(false),
+            DeleteFilesContent(false),
+            EditorPartPending(true),
+            Parts(0),
+            PartsWritten(0),
+            SubmitTicks(0),
+            ProjectOpenTicks(0)
+    {
+        //
+    }
+
+    unsigned int Sequence;
+
+    // 'ppActiveEditor' or 'ppOtherEditors' (the tier of the job's own files)
+    TChBldParsePriority Priority;
+
+    VString EditorContentFiles;
+    VString OtherFiles;
+
+    // The temporary files of the editor contents (original file -> temporary file)
+    std::map<String, String> FilenameLookupMap;
+
+    // The reverse of 'FilenameLookupMap' (temporary file -> original file), built on submit
+    std::unordered_map<String, String, TChBldStringHash> TemporaryFileMap;
+
+    // The snapshots behind the temporary files (released when the job is gone)
+    std::vector<TChBldContentSnapshotPtr> Snapshots;
+
+    // The 'Refresh' options (of the part with the job's own files, the include parts are
+    // added to the DB)
+    bool DeepRefresh;
+    bool DeleteFilesContent;
+    std::map<String, String> ContentFiles;
+
+    // The state of the parts (guarded by the job mutex of the pipeline)
+    bool EditorPartPending;
+    int Parts;
+    int PartsWritten;
+
+    unsigned int SubmitTicks;
+
+    // Set for the jobs of a project (re)opening, to log when the active file is ready
+    unsigned int ProjectOpenTicks;
+};
+//---------------------------------------------------------------------------
+
+typedef boost::shared_ptr<TChBldParseJob> TChBldParseJobPtr;
+//---------------------------------------------------------------------------
+
+// The files of a job within the same tier, which are written to the DB as a unit
+struct TChBldParsePart
+{
+    TChBldParsePart()
+        :   Priority(ppOtherEditors),
+            IsEditorPart(false),
+            Shards(0),
+            ShardsDone(0),
+            Failed(false)
+    {
+        //
+    }
+
+    TChBldParseJobPtr   Job;
+    TChBldParsePriority Priority;
+
+    // The part with the job's own files (written with the job's 'Refresh' options)
+    bool IsEditorPart;
+
+    // The tags gathered from the shards
+    Ctags::VTag Tags;
+
+    int Shards;
+    int ShardsDone;
+
+    // Set if a stage failed, so the incomplete results must not be written
+    bool Failed;
+};
+//---------------------------------------------------------------------------
+
+typedef boost::shared_ptr<TChBldParsePart> TChBldParsePartPtr;
+//---------------------------------------------------------------------------
+
+// A slice of the files of a part tagged by one of the tagging workers (they're small, so
+// the work of a higher tier only waits for the running shards)
+struct TChBldParseShard
+{
+    TChBldParseShard()
+        :   Failed(false)
+    {
+        //
+    }
+
+    TChBldParsePartPtr  Part;
+    VString             Files;
+    Ctags::VTag         Tags;
+    bool                Failed;
+};
+//---------------------------------------------------------------------------
+
+typedef boost::shared_ptr<TChBldParseShard> TChBldParseShardPtr;
+//---------------------------------------------------------------------------
+
+// The metrics of a pipeline stage (its input queue and the work done)
+struct TChBldPipelineStageStats
+{
+    String          Name;
+    TChBldQueueStats Queue;
+    unsigned int    Items;
+    unsigned int    BusyTime;
+};
+//---------------------------------------------------------------------------
+
+class TChBldParsePipeline;
+
+typedef void (TChBldParsePipeline::*TChBldPipelineStageProc)();
+//---------------------------------------------------------------------------
+
+// The thread running a stage of the pipeline until its input queue is closed
+class TChBldPipelineWorker : public TThread
+{
+public:
+    __fastcall TChBldPipelineWorker(
+        TChBldParsePipeline& Pipeline,
+        TChBldPipelineStageProc StageProc
+        );
+
+private:
+    void __fastcall Execute();
+
+    TChBldParsePipeline     &FPipeline;
+    TChBldPipelineStageProc FStageProc;
+};
+//---------------------------------------------------------------------------
+
+// Parses the jobs of the analyzer in stages, each running on its own worker:
+// include closure -> tagging shards -> tag post-processing -> DB writer. So a slow DB
+// commit doesn't stall the tagging of the next edit. The files of a job are split into
+// tiers (see 'TChBldParsePriority') and the queues serve the higher tiers first. The
+// writer is the only thread writing to the project DB (and does its maintenance); other
+// threads changing the DB state have to wait for 'WaitIdle' and hold the 'WriterMutex'.
+class TChBldParsePipeline
+{
+public:
+    TChBldParsePipeline(
+        Ctags::TParser& CtagsParser,
+        TChBldProjectDB& ProjectDB,
+        int TaggingWorkers=2,
+        int QueueDepth=4
+        );
+
+    ~TChBldParsePipeline();
+
+    bool Submit(const TChBldParseJobPtr& Job);
+
+    void WaitIdle();
+    bool IsIdle();
+
+    void SetTaggingLimit(int Limit);
+
+    void GetStats(std::vector<TChBldPipelineStageStats>& Stats);
+
+    __property TMutex* WriterMutex = {read=FWriterMutex};
+    __property int TaggingWorkers = {read=FTaggingWorkers};
+
+private:
+    enum TStage
+    {
+        psIncludes,
+        psTagging,
+        psPostProcessing,
+        psWriter,
+        psCount
+    };
+
+    void RunIncludeStage();
+    void RunTaggingStage();
+    void RunPostProcessingStage();
+    void RunWriterStage();
+
+    void ResolveIncludes(const TChBldParseJob& Job, std::vector<VString>& TierFiles);
+    void ReplaceTemporaryFileNames(const TChBldParseJob& Job, Ctags::VTag& Tags);
+
+    bool AcquireTaggingSlot();
+    void ReleaseTaggingSlot();
+
+    bool DispatchParts(std::vector<TChBldParsePartPtr>& CompletedParts);
+    bool IsPartWritable(const TChBldParsePart& Part);
+
+    void AddStageWork(TStage Stage, unsigned int StartTicks);
+    void FinishPart(const TChBldParsePart& Part);
+
+    void LogStats();
+
+    Ctags::TParser  &FCtagsParser;
+    TChBldProjectDB &FProjectDB;
+
+    int FTaggingWorkers;
+
+    TChBldBoundedQueue<TChBldParseJobPtr>   FIncludeQueue;
+    TChBldBoundedQueue<TChBldParseShardPtr> FTaggingQueue;
+    TChBldBoundedQueue<TChBldParseShardPtr> FPostProcessingQueue;
+    TChBldBoundedQueue<TChBldParsePartPtr>  FWriterQueue;
+
+    // Held by the writer while it's writing or maintaining the DB
+    TMutex *FWriterMutex;
+
+    // The submitted jobs which aren't completely written yet, by their sequence (guarded
+    // by 'FJobMutex', like the part state of the jobs)
+    TMutex                                      *FJobMutex;
+    TConditionVariableMutex                     *FIdleCondition;
+    std::map<unsigned int, TChBldParseJobPtr>   FOpenJobs;
+    bool                                        FClosed;
+
+    // The number of tagging workers which may run at once, and the running ones (guarded
+    // by 'FJobMutex' as well)
+    TConditionVariableMutex *FTaggingCondition;
+    int                     FTaggingLimit;
+    int                     FActiveTaggingWorkers;
+
+    unsigned int FNextSequence;
+
+    // The work done per stage (guarded by 'FStatsMutex')
+    TMutex          *FStatsMutex;
+    unsigned int    FStageItems[psCount];
+    unsigned int    FStageBusyTime[psCount];
+
+    std::vector<TChBldPipelineWorker*> FWorkers;
+};
+//---------------------------------------------------------------------------
+
+} // namespace Cherrybuilder
+
+#endif
@@ -31,6 +31,10 @@
 #include "cherrybuilder_projectdb.h"
 
 #include <System.StrUtils.hpp>
+#include <System.IOUtils.hpp>
+#include <System.Hash.hpp>
+
+#include <algorithm>
 
 #include "cherrybuilder_debugtools.h"
 //---------------------------------------------------------------------------
@@ -40,9 +44,120 @@
 namespace Cherrybuilder
 {
 
+// The version of the database schema (stored as 'user_version'), databases of other
+// versions are rebuilt
+const int kDBSchemaVersion = 2;
+
+// The statement adding or updating a file record (the parameters are bound by 'BindFile')
+const String kWriteFileStatement =
+    L"INSERT OR REPLACE INTO Files(ID, Name, MTime, Size, Hash) "
+    L"VALUES(?1, ?2, ?3, ?4, ?5);";
+
+// The statement adding a file record to the SDK database unless another IDE instance has
+// added it already (the parameters are bound by 'BindFile')
+const String kAddSDKFileStatement =
+    L"INSERT OR IGNORE INTO Files(ID, Name, MTime, Size, Hash) "
+    L"VALUES(?1, ?2, ?3, ?4, ?5);";
+
+// The time (ms) to wait for the SDK database while another IDE instance writes it
+const int kSDKBusyTimeout = 10000;
+//---------------------------------------------------------------------------
+
+// The maximum number of cached results per result type
+const std::size_t kQueryCacheSize = 256;
+
+// The default number of variant databases kept in a project
+const int kMaxDBVariants = 4;
+
+// The default number of written rows after which the WAL is checkpointed
+const int kCheckpointRows = 10000;
+
+// The default interval (ms) of updating the statistics of the query planner
+const unsigned int kAnalyzeInterval = 1800000;
+
+// The columns read by 'ReadTagLocation'
+const String kTagLocationColumns = L"TagName, Signature, FileName, LineNo";
+//---------------------------------------------------------------------------
+
+// The kinds of row writes done by an incremental refresh
+enum TChBldTagWriteKind
+{
+    twInsert,
+    twUpdate,
+    twDelete
+};
+
+// A single row write done by an incremental refresh
+struct TChBldTagWrite
+{
+    TChBldTagWriteKind  Kind;
+    __int64             ID;     // The ID of the stored tag to update/delete
+    const Ctags::TTag   *Tag;   // The new tag to insert/update with
+};
+//---------------------------------------------------------------------------
+
+// The statement adding a tag record (the parameters are bound by 'BindTag')
+const String kInsertTagStatement =
+    L"INSERT OR IGNORE INTO Tags("
+        L"Name,"
+        L"QualifiedName,"
+        L"FileID,"
+        L"Address,"
+        L"Kind,"
+        L"LineNo,"
+        L"Namespace,"
+        L"Class,"
+        L"Struct,"
+        L"Access,"
+        L"Implementation,"
+        L"Signature,"
+        L"Typeref_A,"
+        L"Typeref_B,"
+        L"Inherits"
+        L") "
+    L"VALUES("
+        L"?1,"
+        L"?2,"
+        L"?3,"
+        L"?4,"
+        L"?5,"
+        L"?6,"
+        L"?7,"
+        L"?8,"
+        L"?9,"
+        L"?10,"
+        L"?11,"
+        L"?12,"
+        L"?13,"
+        L"?14,"
+        L"?15"
+        L");";
+//---------------------------------------------------------------------------
+
 TChBldProjectDB::TChBldProjectDB()
     :   FProjectPath(L""),
-        FUpdateMutex(new TMutex(false))
+        FVariant(L""),
+        FUpdateMutex(new TMutex(false)),
+        FDBLock(new TMultiReadExclusiveWriteSynchronizer),
+        FDBFileMutex(new TMutex(false)),
+        FDBGeneration(0),
+        FMaxDBVariants(kMaxDBVariants),
+        FWriteChunkRows(5000),
+        FWriteChunkTime(20),
+        FMaxLockWait(0),
+        FCheckpointRows(kCheckpointRows),
+        FAnalyzeInterval(kAnalyzeInterval),
+        FPendingRows(0),
+        FRowsSinceAnalyze(0),
+        FLastAnalyze(GetTickCount()),
+        FRequiresRebuild(true),
+        FLastRefreshStats(),
+        FSymbolIndex(new TChBldSymbolIndex),
+        FSymbolIndexStale(true),
+        FQueryCacheMutex(new TMutex(false)),
+        FQueryGeneration(0),
+        FTagListCache(kQueryCacheSize),
+        FStringListCache(kQueryCacheSize)
 {
     CS_SEND(L"ProjectDB::Constructor");
 }
@@ -58,6 +173,27 @@ TChBldProjectDB::~TChBldProjectDB()
         delete FUpdateMutex;
         FUpdateMutex = NULL;
     }
+
+    // Delete the DB reader/writer lock
+    if (FDBLock)
+    {
+        delete FDBLock;
+        FDBLock = NULL;
+    }
+
+    // Delete the DB file mutex
+    if (FDBFileMutex)
+    {
+        delete FDBFileMutex;
+        FDBFileMutex = NULL;
+    }
+
+    // Delete the query cache mutex
+    if (FQueryCacheMutex)
+    {
+        delete FQueryCacheMutex;
+        FQueryCacheMutex = NULL;
+    }
 }
 //---------------------------------------------------------------------------
 
@@ -76,125 +212,108 @@ void TChBldProjectDB::Refresh(
             + L")"
             );
 
-    // Begin of interlock
-    {
-        TChBldLockGuard LG(FUpdateMutex);
-
-        SQLite::TDatabase DB(SQLite::jmWal);
-
-        // Create the sub-directory '__chbld' if it does not exist
-        CreateWorkingDirIfRequired();
+    unsigned int StartTicks = GetTickCount();
 
-        // Create/open current project database
-        DB.Open(FProjectPath + L"__chbld\\" + kDBFileName);
+    TChBldRefreshStats Stats = {0, 0, 0, 0, 0, 0};
 
-        __try
-        {
-            if (DeleteFilesContent)
-            {
-                String FileNames = L"";
-                std::pair<String, String> ChangedContentFile;
+    Ctags::VTag ProjectTags;
+    Ctags::VTag SDKTags;
 
-                // Generate a comma-seperated string with the file names to update
-                foreach_ (ChangedContentFile, *ChangedContentFiles)
-                    FileNames += L"'" + ChangedContentFile.first + L"',";
+    // The tags of the IDE-wide headers go to the shared SDK database...
+    SplitSDKTags(Tags, ProjectTags, SDKTags);
 
-                // Delete the last comma of the string
-                FileNames.SetLength(FileNames.Length() - 1);
+    // The SDK files and classes added with this refresh (they have to be added to the
+    // symbol index as well) and whether the SDK database has been replaced as a whole
+    std::set<String> SDKFiles;
+    std::set<String> SDKClasses;
+    bool SDKReplaced = false;
 
-                SQLite::TStatement CmdDeleteChangedTags(
-                    DB,
-                    L"DELETE FROM Tags "
-                    L"WHERE FileID IN ("
-                        L"SELECT ID FROM Files "
-                        L"WHERE Name IN ("
-                        + FileNames
-                        + L") );"
-                    );
+    // ...if they can't be added there, they're skipped (and added with the next refresh
+    // which parses them) - storing them in the project database instead would duplicate
+    // them as soon as they're added to the SDK database
+    if (!SDKTags.empty() && !UpdateSDKDB(SDKTags, SDKFiles, SDKClasses, SDKReplaced))
+    {
+        CS_SEND(L"ProjectDB::Refresh(SDK tags skipped)");
 
-                SQLite::TStatement CmdDeleteChangedFiles(
-                    DB,
-                    L"DELETE FROM Files "
-                    L"WHERE Name IN ("
-                    + FileNames
-                    + L");"
-                    );
+        SDKTags.clear();
+    }
 
-                try
-                {
-                    // Begin transaction
-                    DB.BeginTransaction();
+    // A deep refresh builds a complete new database in the background which is swapped
+    // in afterwards, so the current one keeps serving the readers in the meantime
+    if (DeepRefresh)
+    {
+        RebuildShadowDB(ProjectTags, ChangedContentFiles, Stats);
+    }
+    else
+    {
+        SQLite::TDatabase DB(SQLite::jmWal);
 
-                    // Run command 'DeleteChangedTags'
-                    CmdDeleteChangedTags.ExecuteStep();
+        // Create the sub-directory '__chbld' if it does not exist
+        CreateWorkingDirIfRequired();
 
-                    // Run command 'DeleteChangedFiles'
-                    CmdDeleteChangedFiles.ExecuteStep();
+        // Create/open current project database
+        DB.Open(GetDBFilePath());
 
-                    // Commit transaction
-                    DB.CommitTransaction();
-                }
-                catch (Exception& E)
-                {
-                    // On exception, rollback transaction
-                    DB.RollbackTransaction();
+        // Record the statements if the profiling is enabled
+        ProfileDB(DB, L"Refresh");
 
-                    // Throw E again
-                    throw Exception(E.Message);
-                }
-                catch (...)
-                {
-                    // On exception, rollback transaction
-                    DB.RollbackTransaction();
+        __try
+        {
+            // The classes/structs whose inheritance may have changed with this refresh
+            std::set<String> ChangedClasses;
 
-                    // Throw Exception again
-                    throw Exception(L"Unknown exception");
-                }
-            }
+            // The stored tags (and their IDs) of the changed files, looked up by their
+            // stable tag key so we can diff them against the new ones
+            std::multimap<String, std::pair<__int64, Ctags::TTag> > StoredTags;
 
-            if (DeepRefresh)
+            // Reading doesn't need the interlock as we're the only writer
+            if (DeleteFilesContent)
             {
-                // Delete the complete tags table content
-                SQLite::TStatement CmdClearTableTags(
-                    DB,
-                    L"DELETE FROM Tags;"
-                    );
-
-                // Delete the complete file table content
-                SQLite::TStatement CmdClearTableFiles(
+                // Get the stored tags of each changed file in line order, so tags with the
+                // same key are matched in the order they appear within the file (the file
+                // name is bound, as a path may contain any character)
+                SQLite::TStatement QryGetStoredTags(
                     DB,
-                    L"DELETE FROM Files;"
+                    L"SELECT * FROM Common "
+                    L"WHERE FileName = ?1 "
+                    L"ORDER BY LineNo;"
                     );
 
-                try
-                {
-                    // Begin transaction
-                    DB.BeginTransaction();
-
-                    // Run command 'ClearTableTags'
-                    CmdClearTableTags.ExecuteStep();
-
-                    // Run command 'ClearTableFiles'
-                    CmdClearTableFiles.ExecuteStep();
+                std::pair<String, String> ChangedContentFile;
 
-                    // Commit transaction
-                    DB.CommitTransaction();
-                }
-                catch (Exception& E)
+                foreach_ (ChangedContentFile, *ChangedContentFiles)
                 {
-                    // On exception, rollback transaction
-                    DB.RollbackTransaction();
+                    QryGetStoredTags.BindString(1, ChangedContentFile.first);
 
-                    // Throw E again
-                    throw Exception(E.Message);
-                }
-                catch (...)
-                {
-                    // On exception, rollback transaction
-                    DB.RollbackTransaction();
+                    while (QryGetStoredTags.ExecuteStep() != SQLITE_DONE)
+                    {
+                        Ctags::TTag StoredTag;
+
+                        StoredTag.Name              = QryGetStoredTags.GetColumnAsString(1);
+                        StoredTag.QualifiedName     = QryGetStoredTags.GetColumnAsString(2);
+                        StoredTag.File              = QryGetStoredTags.GetColumnAsString(3);
+                        StoredTag.Address           = QryGetStoredTags.GetColumnAsString(4);
+                        StoredTag.Kind              = QryGetStoredTags.GetColumnAsString(5);
+                        StoredTag.LineNo            = QryGetStoredTags.GetColumnAsInt(6);
+                        StoredTag.Namespace         = QryGetStoredTags.GetColumnAsString(7);
+                        StoredTag.Class             = QryGetStoredTags.GetColumnAsString(8);
+                        StoredTag.Struct            = QryGetStoredTags.GetColumnAsString(9);
+                        StoredTag.Access            = QryGetStoredTags.GetColumnAsString(10);
+                        StoredTag.Implementation    = QryGetStoredTags.GetColumnAsString(11);
+                        StoredTag.Signature         = QryGetStoredTags.GetColumnAsString(12);
+                        StoredTag.Typeref_A         = QryGetStoredTags.GetColumnAsString(13);
+                        StoredTag.Typeref_B         = QryGetStoredTags.GetColumnAsString(14);
+                        StoredTag.Inherits          = QryGetStoredTags.GetColumnAsString(15);
+
+                        StoredTags.insert(
+                            std::make_pair(
+                                GetTagKey(StoredTag),
+                                std::make_pair(QryGetStoredTags.GetColumnAsInt64(0), StoredTag)
+                                )
+                            );
+                    }
 
-                    // Throw Exception again
-                    throw Exception(L"Unknown exception");
+                    QryGetStoredTags.Reset();
                 }
             }
 
@@ -210,254 +329,263 @@ void TChBldProjectDB::Refresh(
             while (QryGetFileList.ExecuteStep() != SQLITE_DONE)
                 FileMap[QryGetFileList.GetColumnAsString(1)] = QryGetFileList.GetColumnAsString(0);
 
-
-            // Create a vector of SQLite statement pointers
-            // (Cannot use statements directly as we don't provide an overloaded assignment operator)
-            std::vector<SQLite::TStatement*> SQLiteStatements;
-
-            // Iterate over each tag record
-            for (std::size_t i = 0; i < Tags.size(); ++i)
+            // SDK files which are still in the project database (tagged before the SDK
+            // database has been set up) would be found twice, the next full update rebuilds
+            // the database without them
+            foreach_ (const Ctags::TTag& Tag, SDKTags)
             {
-                // Check, whether the file is not already existent in the map...
-                if (FileMap.find(Tags[i].File) == FileMap.end())
+                if (FileMap.find(Tag.File) != FileMap.end())
                 {
-                    // ...so we have to create an entry with a new GUID
-                    FileMap[Tags[i].File] = Environment::CreateGuidString(true);
-                }
+                    FRequiresRebuild = true;
 
-                // Add the tag record data to database
-                SQLiteStatements.push_back(
-                    new SQLite::TStatement(
-                        DB,
-                        L"INSERT OR IGNORE INTO Tags("
-                            L"Name,"
-                            L"QualifiedName,"
-                            L"FileID,"
-                            L"Address,"
-                            L"Kind,"
-                            L"LineNo,"
-                            L"Namespace,"
-                            L"Class,"
-                            L"Struct,"
-                            L"Access,"
-                            L"Implementation,"
-                            L"Signature,"
-                            L"Typeref_A,"
-                            L"Typeref_B,"
-                            L"Inherits"
-                            L") "
-                        L"VALUES("
-                            L"?1,"
-                            L"?2,"
-                            L"?3,"
-                            L"?4,"
-                            L"?5,"
-                            L"?6,"
-                            L"?7,"
-                            L"?8,"
-                            L"?9,"
-                            L"?10,"
-                            L"?11,"
-                            L"?12,"
-                            L"?13,"
-                            L"?14,"
-                            L"?15"
-                            L");"
-                        )
-                    );
+                    CS_SEND(L"ProjectDB::Refresh(SDK file in project database, rebuild required)");
 
-                SQLiteStatements.back()->BindString(  1, Tags[i].Name);
-                SQLiteStatements.back()->BindString(  2, Tags[i].QualifiedName);
-                SQLiteStatements.back()->BindString(  3, FileMap[Tags[i].File]);
-                SQLiteStatements.back()->BindString(  4, Tags[i].Address);
-                SQLiteStatements.back()->BindString(  5, Tags[i].Kind);
-                SQLiteStatements.back()->BindInt(     6, Tags[i].LineNo);
-                SQLiteStatements.back()->BindString(  7, Tags[i].Namespace);
-                SQLiteStatements.back()->BindString(  8, Tags[i].Class);
-                SQLiteStatements.back()->BindString(  9, Tags[i].Struct);
-                SQLiteStatements.back()->BindString( 10, Tags[i].Access);
-                SQLiteStatements.back()->BindString( 11, Tags[i].Implementation);
-                SQLiteStatements.back()->BindString( 12, Tags[i].Signature);
-                SQLiteStatements.back()->BindString( 13, Tags[i].Typeref_A);
-                SQLiteStatements.back()->BindString( 14, Tags[i].Typeref_B);
-                SQLiteStatements.back()->BindString( 15, Tags[i].Inherits);
+                    break;
+                }
             }
 
-            std::pair<String, String> File;
+            // The rows to write, determined before writing anything so the writing itself
+            // can be split into chunks (grouped by file, as a chunk always ends at a file
+            // boundary - so the readers never see a partly written file)
+            std::map<String, std::vector<TChBldTagWrite> > FileWrites;
+
+            // The files whose record has to be written: New ones and the changed ones
+            // (which get a new stamp)
+            std::set<String> FilesToWrite;
 
-            // Iterate over each file name
-            foreach_ (File, FileMap)
+            if (DeleteFilesContent)
             {
+                std::pair<String, String> ChangedContentFile;
 
-                SQLiteStatements.push_back(
-                    new SQLite::TStatement(
-                        DB,
-                        L"INSERT OR IGNORE INTO Files(ID, Name) "
-                        L"VALUES(?1, ?2);"
-                        )
-                    );
+                foreach_ (ChangedContentFile, *ChangedContentFiles)
+                {
+                    if (FileMap.find(ChangedContentFile.first) == FileMap.end())
+                        FileMap[ChangedContentFile.first] = Environment::CreateGuidString(true);
 
-                SQLiteStatements.back()->BindString(1, File.second);
-                SQLiteStatements.back()->BindString(2, File.first);
+                    FilesToWrite.insert(ChangedContentFile.first);
+                }
             }
 
-            try
+            // Iterate over each tag record
+            for (std::size_t i = 0; i < ProjectTags.size(); ++i)
             {
-                // Begin transaction
-                DB.BeginTransaction();
+                const Ctags::TTag &Tag = ProjectTags[i];
 
-                // Run each statement from SQLitestatements vector
-                for (std::size_t i = 0; i < SQLiteStatements.size(); ++i)
-                    SQLiteStatements[i]->ExecuteStep();
+                bool IsClass = (Tag.Kind == L"class") || (Tag.Kind == L"struct");
 
-                // Commit transaction
-                DB.CommitTransaction();
-            }
-            catch (Exception& E)
-            {
-                // On exception, rollback transaction
-                DB.RollbackTransaction();
+                // Check, whether the file is not already existent in the map...
+                if (FileMap.find(Tag.File) == FileMap.end())
+                {
+                    // ...so we have to create an entry with a new GUID
+                    FileMap[Tag.File] = Environment::CreateGuidString(true);
 
-                // Throw E again
-                //throw Exception(E.Message);   // Don't throw here: If it doesn't work
-                                                // maybe there's an active code completion
-                                                // running
-            }
-            catch (...)
-            {
-                // On exception, rollback transaction
-                DB.RollbackTransaction();
+                    FilesToWrite.insert(Tag.File);
+                }
 
-                // Throw Exception again
-                //throw Exception(L"Unknown exception");    // Don't throw here: If it doesn't work
-                                                            // maybe there's an active code completion
-                                                            // running
-            }
+                // Diff the tags of the changed files against the stored ones
+                if (DeleteFilesContent && (ChangedContentFiles->count(Tag.File) > 0))
+                {
+                    String TagKey = GetTagKey(Tag);
 
-            /*
+                    // Take the first stored tag with the same key (in line order)
+                    std::multimap<String, std::pair<__int64, Ctags::TTag> >::iterator
+                        StoredTag = StoredTags.lower_bound(TagKey);
 
-            // In either case it is necessary to fully qualify the 'Inherits' fields which
-            // we're doing in the next steps
+                    if ((StoredTag != StoredTags.end()) && (StoredTag->first == TagKey))
+                    {
+                        const Ctags::TTag &OldTag = StoredTag->second.second;
+
+                        if (HasSameTagAttributes(Tag, OldTag))
+                        {
+                            ++Stats.Unchanged;
+                        }
+                        else
+                        {
+                            // Update the changed fields (mostly the line number)
+                            TChBldTagWrite TagWrite = {twUpdate, StoredTag->second.first, &Tag};
+                            FileWrites[Tag.File].push_back(TagWrite);
+
+                            // A moved class keeps its ancestor closure
+                            if (IsClass
+                                && ((Tag.QualifiedName != OldTag.QualifiedName)
+                                    || (Tag.Inherits != OldTag.Inherits)))
+                            {
+                                ChangedClasses.insert(OldTag.QualifiedName);
+                                ChangedClasses.insert(Tag.QualifiedName);
+                            }
+                        }
+
+                        StoredTags.erase(StoredTag);
+
+                        continue;
+                    }
 
-            // Get all records with an non-empty inheritance field
-            SQLite::TStatement QryGetTagsWithInheritance(
-                DB,
-                L"SELECT * FROM Common WHERE Inherits <> '';"
-                );
+                    // The tag is new in the file
+                    if (IsClass)
+                        ChangedClasses.insert(Tag.QualifiedName);
+                }
+                else if (!DeleteFilesContent && IsClass)
+                {
+                    ChangedClasses.insert(Tag.QualifiedName);
+                }
 
-            // Iterate over each of it
-            while (QryGetTagsWithInheritance.ExecuteStep() != SQLITE_DONE)
-            {
-                __int64 ID          = QryGetTagsWithInheritance.GetColumnAsInt64(0);
-                String  Inherits    = QryGetTagsWithInheritance.GetColumnAsString(15);
+                // Add the tag record data to database
+                TChBldTagWrite TagWrite = {twInsert, 0, &Tag};
+                FileWrites[Tag.File].push_back(TagWrite);
+            }
 
-                // There may be multiple ancestors which we're seperating here
-                VString Ancestors = Environment::SplitCtagsObjectAncestors(Inherits);
+            // The remaining stored tags have vanished from their files
+            std::pair<String, std::pair<__int64, Ctags::TTag> > StoredTag;
 
-                // We must perform the 'qualification' seperately for each ancestor
-                for (std::size_t i = 0; i < Ancestors.size(); ++i)
-                {
-                    String &Ancestor = Ancestors[i];
+            foreach_ (StoredTag, StoredTags)
+            {
+                TChBldTagWrite TagWrite = {twDelete, StoredTag.second.first, NULL};
+                FileWrites[StoredTag.second.second.File].push_back(TagWrite);
 
-                    // Build the query to get the ancestor tag
-                    SQLite::TStatement QryGetAncestorTag(
-                        DB,
-                        L"SELECT * FROM Tags WHERE QualifiedName LIKE '%" + Ancestor + L"' "
-                            L"AND ((Kind = 'class') OR (Kind = 'struct'));"
-                        );
+                if ((StoredTag.second.second.Kind == L"class")
+                    || (StoredTag.second.second.Kind == L"struct"))
+                    ChangedClasses.insert(StoredTag.second.second.QualifiedName);
+            }
 
-                    // Perform the query - If we have a result...
-                    if (!QryGetAncestorTag.ExecuteStep() != SQLITE_DONE)
-                    {
-                        // ...we get it's qualified name
-                        String QualifiedName = QryGetAncestorTag.GetColumnAsString(2);
+            // The records of new or changed files are written even without any row writes
+            foreach_ (const String& FileName, FilesToWrite)
+                FileWrites.insert(std::make_pair(FileName, std::vector<TChBldTagWrite>()));
 
-                        // Now that we've got a qualified name we have to verify it
+            SQLite::TStatement CmdInsertTag(DB, kInsertTagStatement);
 
+            // The key fields (kind, scope, name and signature) are equal, so only the
+            // remaining fields have to be updated (an identical row replaces this one)
+            SQLite::TStatement CmdUpdateTag(
+                DB,
+                L"UPDATE OR REPLACE Tags SET "
+                    L"QualifiedName     = ?2,"
+                    L"Address           = ?3,"
+                    L"LineNo            = ?4,"
+                    L"Access            = ?5,"
+                    L"Implementation    = ?6,"
+                    L"Typeref_A         = ?7,"
+                    L"Typeref_B         = ?8,"
+                    L"Inherits          = ?9 "
+                L"WHERE ID = ?1;"
+                );
 
-                        Ancestor = QualifiedName;
-                    }
-                }
+            SQLite::TStatement CmdDeleteTag(
+                DB,
+                L"DELETE FROM Tags WHERE ID = ?1;"
+                );
 
-                // At this point 'Ancestors' contains the list of all qualified ancestor names
-                // for the current tag
+            SQLite::TStatement CmdWriteFile(DB, kWriteFileStatement);
 
-                String AncestorList = L"";
+            SQLite::TStatement CmdDeleteFile(
+                DB,
+                L"DELETE FROM Files WHERE Name = ?1;"
+                );
 
-                foreach_ (String Ancestor, Ancestors)
-                    AncestorList = Ancestor + ",";
+            std::map<String, std::vector<TChBldTagWrite> >::const_iterator
+                NextFile = FileWrites.begin();
 
-                if (!AncestorList.IsEmpty())
-                    AncestorList = LeftStr(AncestorList, AncestorList.Length() - 1);
+            bool Failed = false;
 
-                if (AncestorList != QryGetTagsWithInheritance.GetColumnAsString(15))
+            // Write the rows in chunks limited by row count and time, releasing the writer
+            // interlock between them (the readers don't need it as they're working on their
+            // own WAL snapshot)
+            while (NextFile != FileWrites.end())
+            {
+                // Begin of interlock
                 {
-                    SQLite::TStatement CmdUpdateInheritsField(
-                        DB,
-                        L"REPLACE INTO Tags("
-                            L"ID,"
-                            L"Name,"
-                            L"QualifiedName,"
-                            L"FileID,"
-                            L"Address,"
-                            L"Kind,"
-                            L"LineNo,"
-                            L"Namespace,"
-                            L"Class,"
-                            L"Struct,"
-                            L"Access,"
-                            L"Implementation,"
-                            L"Signature,"
-                            L"Typeref_A,"
-                            L"Typeref_B,"
-                            L"Inherits"
-                            L") "
-                        L"VALUES("
-                            L"?1,"
-                            L"?2,"
-                            L"?3,"
-                            L"?4,"
-                            L"?5,"
-                            L"?6,"
-                            L"?7,"
-                            L"?8,"
-                            L"?9,"
-                            L"?10,"
-                            L"?11,"
-                            L"?12,"
-                            L"?13,"
-                            L"?14,"
-                            L"?15,"
-                            L"?16"
-                            L");"
-                        );
-
-                    CmdUpdateInheritsField.BindInt64(   1, ID);
-                    CmdUpdateInheritsField.BindString(  2, QryGetTagsWithInheritance.GetColumnAsString(1));
-                    CmdUpdateInheritsField.BindString(  3, QryGetTagsWithInheritance.GetColumnAsString(2));
-                    CmdUpdateInheritsField.BindString(  4, QryGetTagsWithInheritance.GetColumnAsString(3));
-                    CmdUpdateInheritsField.BindString(  5, QryGetTagsWithInheritance.GetColumnAsString(4));
-                    CmdUpdateInheritsField.BindString(  6, QryGetTagsWithInheritance.GetColumnAsString(5));
-                    CmdUpdateInheritsField.BindString(  7, QryGetTagsWithInheritance.GetColumnAsString(6));
-                    CmdUpdateInheritsField.BindString(  8, QryGetTagsWithInheritance.GetColumnAsString(7));
-                    CmdUpdateInheritsField.BindString(  9, QryGetTagsWithInheritance.GetColumnAsString(8));
-                    CmdUpdateInheritsField.BindString( 10, QryGetTagsWithInheritance.GetColumnAsString(9));
-                    CmdUpdateInheritsField.BindString( 11, QryGetTagsWithInheritance.GetColumnAsString(10));
-                    CmdUpdateInheritsField.BindString( 12, QryGetTagsWithInheritance.GetColumnAsString(11));
-                    CmdUpdateInheritsField.BindString( 13, QryGetTagsWithInheritance.GetColumnAsString(12));
-                    CmdUpdateInheritsField.BindString( 14, QryGetTagsWithInheritance.GetColumnAsString(13));
-                    CmdUpdateInheritsField.BindString( 15, QryGetTagsWithInheritance.GetColumnAsString(14));
-                    CmdUpdateInheritsField.BindString( 16, AncestorList);
+                    TChBldLockGuard LG(FUpdateMutex);
+
+                    unsigned int ChunkStartTicks = GetTickCount();
+                    int ChunkRows = 0;
 
                     try
                     {
                         // Begin transaction
                         DB.BeginTransaction();
 
-                        CmdUpdateInheritsField.ExecuteStep();
+                        // Write whole files until the chunk is full or its time is up (but at
+                        // least one file)
+                        while ((NextFile != FileWrites.end())
+                            && ((ChunkRows == 0)
+                                || (((FWriteChunkRows <= 0) || (ChunkRows < FWriteChunkRows))
+                                    && ((FWriteChunkTime <= 0)
+                                        || (GetTickCount() - ChunkStartTicks
+                                            < static_cast<unsigned int>(FWriteChunkTime))))))
+                        {
+                            const String &FileName = NextFile->first;
+
+                            // The file record is written along with the tags of the file, so
+                            // it's only stamped as tagged if they're written as well
+                            if (FilesToWrite.count(FileName) > 0)
+                            {
+                                // Remove the records of vanished files...
+                                if (!FileExists(GetContentFileName(FileName, ChangedContentFiles)))
+                                {
+                                    CmdDeleteFile.BindString(1, FileName);
+                                    CmdDeleteFile.ExecuteStep();
+                                    CmdDeleteFile.Reset();
+                                }
+                                // ...and add/update the others
+                                else
+                                {
+                                    BindFile(CmdWriteFile, FileMap[FileName], FileName, ChangedContentFiles);
+                                    CmdWriteFile.ExecuteStep();
+                                    CmdWriteFile.Reset();
+                                }
+                            }
+
+                            foreach_ (const TChBldTagWrite& TagWrite, NextFile->second)
+                            {
+                                switch (TagWrite.Kind)
+                                {
+                                    case twInsert:
+                                        BindTag(CmdInsertTag, *TagWrite.Tag, FileMap[FileName]);
+                                        CmdInsertTag.ExecuteStep();
+                                        CmdInsertTag.Reset();
+
+                                        // Tags of unchanged (included) files are mostly ignored
+                                        // as they exist already
+                                        Stats.Inserted += DB.GetChanges();
+                                    break;
+
+                                    case twUpdate:
+                                        CmdUpdateTag.BindInt64(  1, TagWrite.ID);
+                                        CmdUpdateTag.BindString( 2, TagWrite.Tag->QualifiedName);
+                                        CmdUpdateTag.BindString( 3, TagWrite.Tag->Address);
+                                        CmdUpdateTag.BindInt(    4, TagWrite.Tag->LineNo);
+                                        CmdUpdateTag.BindString( 5, TagWrite.Tag->Access);
+                                        CmdUpdateTag.BindString( 6, TagWrite.Tag->Implementation);
+                                        CmdUpdateTag.BindString( 7, TagWrite.Tag->Typeref_A);
+                                        CmdUpdateTag.BindString( 8, TagWrite.Tag->Typeref_B);
+                                        CmdUpdateTag.BindString( 9, TagWrite.Tag->Inherits);
+                                        CmdUpdateTag.ExecuteStep();
+                                        CmdUpdateTag.Reset();
+
+                                        ++Stats.Updated;
+                                    break;
+
+                                    case twDelete:
+                                        CmdDeleteTag.BindInt64(1, TagWrite.ID);
+                                        CmdDeleteTag.ExecuteStep();
+                                        CmdDeleteTag.Reset();
+
+                                        ++Stats.Deleted;
+                                    break;
+                                }
+
+                                ++ChunkRows;
+                            }
+
+                            ++NextFile;
+                        }
 
                         // Commit transaction
                         DB.CommitTransaction();
+
+                        // The readers see the chunk from now on
+                        InvalidateQueryCache();
+
+                        ++Stats.Chunks;
                     }
                     catch (Exception& E)
                     {
@@ -468,6 +596,11 @@ void TChBldProjectDB::Refresh(
                         //throw Exception(E.Message);   // Don't throw here: If it doesn't work
                                                         // maybe there's an active code completion
                                                         // running
+
+                        // Skip the remaining chunks
+                        Failed = true;
+
+                        break;
                     }
                     catch (...)
                     {
@@ -478,98 +611,247 @@ void TChBldProjectDB::Refresh(
                         //throw Exception(L"Unknown exception");    // Don't throw here: If it doesn't work
                                                                     // maybe there's an active code completion
                                                                     // running
+
+                        // Skip the remaining chunks
+                        Failed = true;
+
+                        break;
                     }
                 }
+                // End of interlock
+            }
+
+            // After a failed chunk the refresh is only partly written: The ancestors and the
+            // symbol index aren't refreshed from it, the next full update rebuilds the database
+            // instead
+            if (Failed)
+            {
+                FRequiresRebuild = true;
+
+                CS_SEND(L"ProjectDB::Refresh(Chunk failed, rebuild required)");
+            }
+            else
+            {
+                // The ancestors of the project classes may be found in the SDK database
+                AttachSDKDB(DB);
+
+                // The classes whose ancestor closure has been rebuilt
+                std::set<String> RefreshedClasses(SDKClasses);
+
+                // Begin of interlock
+                {
+                    TChBldLockGuard LG(FUpdateMutex);
+
+                    // The 'Inherits' fields of the changed classes have to be resolved to the
+                    // qualified ancestors, which we're materializing in the ancestor closure table
+                    RefreshAncestors(DB, &ChangedClasses, &RefreshedClasses);
+                }
+                // End of interlock
+
+                // The files whose tags may have changed with this refresh
+                std::set<String> ChangedFiles;
+
+                foreach_ (const Ctags::TTag& Tag, ProjectTags)
+                    ChangedFiles.insert(Tag.File);
+
+                ChangedFiles.insert(SDKFiles.begin(), SDKFiles.end());
+
+                if (DeleteFilesContent)
+                {
+                    std::pair<String, String> ChangedContentFile;
+
+                    foreach_ (ChangedContentFile, *ChangedContentFiles)
+                        ChangedFiles.insert(ChangedContentFile.first);
+                }
+
+                boost::shared_ptr<TChBldSymbolIndex> SymbolIndex(new TChBldSymbolIndex);
+
+                // A replaced SDK database requires a complete new symbol index, otherwise
+                // it's built from the current one by reloading only the tags of the changed
+                // files and the closures of the refreshed classes
+                if (SDKReplaced)
+                    SymbolIndex->Load(DB);
+                else
+                    SymbolIndex->Load(*GetSymbolIndex(), DB, ChangedFiles, RefreshedClasses);
+
+                PublishSymbolIndex(SymbolIndex);
             }
-            */
         }
         __finally
         {
             DB.Close();
         }
     }
-    // End of interlock
+
+    Stats.Duration      = GetTickCount() - StartTicks;
+    FLastRefreshStats   = Stats;
+
+    // A rebuilt database is already checkpointed and analyzed, otherwise the written rows
+    // count for the next maintenance
+    if (DeepRefresh)
+    {
+        FPendingRows        = 0;
+        FRowsSinceAnalyze   = 0;
+    }
+    else
+    {
+        FPendingRows        += Stats.Inserted + Stats.Updated + Stats.Deleted;
+        FRowsSinceAnalyze   += Stats.Inserted + Stats.Updated + Stats.Deleted;
+    }
+
+    CS_SEND(
+        L"ProjectDB::Refresh(End, inserted: "
+            + String(Stats.Inserted)
+            + L", updated: "
+            + String(Stats.Updated)
+            + L", deleted: "
+            + String(Stats.Deleted)
+            + L", unchanged: "
+            + String(Stats.Unchanged)
+            + L", chunks: "
+            + String(Stats.Chunks)
+            + L", "
+            + String(Stats.Duration)
+            + L")"
+        );
+
+    TChBldQueryCacheStats CacheStats = GetQueryCacheStats();
+
+    CS_SEND(
+        L"ProjectDB::Refresh(Query cache hits: "
+            + String(CacheStats.Hits)
+            + L", misses: "
+            + String(CacheStats.Misses)
+            + L", generation: "
+            + String(CacheStats.Generation)
+            + L")"
+        );
 }
 //---------------------------------------------------------------------------
 
-void  TChBldProjectDB::GetMatchingIdentifierList(const String& Query, Ctags::VTag& List, bool ClearList)
+void  TChBldProjectDB::GetMatchingIdentifierList(
+    const String& Query,
+    Ctags::VTag& List,
+    bool ClearList,
+    TChBldSymbolKeys* Keys
+    )
 {
     CS_SEND(L"ProjectDB::GetMatchingIdentifierList(" + Query + L")");
 
-    SQLite::TDatabase DB(SQLite::jmWal);
-
     // Clear the list if requested
     if (ClearList)
+    {
         List.clear();
 
-    // Create the sub-directory '__chbld' if it does not exist
-    CreateWorkingDirIfRequired();
+        if (Keys)
+            Keys->clear();
+    }
 
-    // Create/open current project database
-    DB.Open(FProjectPath + L"__chbld\\" + kDBFileName);
+    TChBldSymbolKeys LocalKeys;
 
-    __try
+    // Without the keys of a previous call we have to get the keys of the symbols
+    // already in the list
+    if (!Keys)
     {
-        SQLite::TStatement QryGetMatchingIdentifiers(
-            DB,
-            Query
-            );
+        Keys = &LocalKeys;
+        TChBldSymbolIndex::GetSymbolKeys(List, LocalKeys);
+    }
 
-        while (QryGetMatchingIdentifiers.ExecuteStep() != SQLITE_DONE)
-        {
-            Ctags::TTag Symbol;
+    String CacheKey = GetQueryCacheKey(L"MatchingIdentifiers", Query);
 
-            Symbol.Name             = QryGetMatchingIdentifiers.GetColumnAsString(1);
-            Symbol.QualifiedName    = QryGetMatchingIdentifiers.GetColumnAsString(2);
-            Symbol.File             = QryGetMatchingIdentifiers.GetColumnAsString(3);
-            Symbol.Address          = QryGetMatchingIdentifiers.GetColumnAsString(4);
-            Symbol.Kind             = QryGetMatchingIdentifiers.GetColumnAsString(5);
-            Symbol.LineNo           = QryGetMatchingIdentifiers.GetColumnAsInt(6);
-            Symbol.Namespace        = QryGetMatchingIdentifiers.GetColumnAsString(7);
-            Symbol.Class            = QryGetMatchingIdentifiers.GetColumnAsString(8);
-            Symbol.Struct           = QryGetMatchingIdentifiers.GetColumnAsString(9);
-            Symbol.Access           = QryGetMatchingIdentifiers.GetColumnAsString(10);
-            Symbol.Implementation   = QryGetMatchingIdentifiers.GetColumnAsString(11);
-            Symbol.Signature        = QryGetMatchingIdentifiers.GetColumnAsString(12);
-            Symbol.Typeref_A        = QryGetMatchingIdentifiers.GetColumnAsString(13);
-            Symbol.Typeref_B        = QryGetMatchingIdentifiers.GetColumnAsString(14);
-            Symbol.Inherits         = QryGetMatchingIdentifiers.GetColumnAsString(15);
-
-            bool CanInsert = true;
-
-            if (Symbol.Kind == L"property")
-            {
-                if (Symbol.Typeref_B.IsEmpty())
-                    CanInsert = false;
-            }
+    Ctags::VTag Symbols;
+    bool IsCached;
 
-            if (CanInsert)
-            {
-                bool Exists = false;
+    // Begin of interlock
+    {
+        TChBldLockGuard LG(FQueryCacheMutex);
 
-                for (std::size_t i = 0; i < List.size(); ++i)
-                {
-                    if (    (List[i].Name == Symbol.Name) &&
-                            (List[i].Kind == Symbol.Kind) &&
-                            (List[i].Typeref_B == Symbol.Typeref_B)
-                            )
-                    {
-                        Exists = true;
-                        break;
-                    }
+        IsCached = FTagListCache.Find(CacheKey, Symbols);
+    }
+    // End of interlock
 
-                }
+    if (!IsCached)
+    {
+        // Get shared access to the DB
+        TChBldReadLockGuard LG(FDBLock);
+
+        SQLite::TDatabase DB(SQLite::jmWal);
+
+        // Create the sub-directory '__chbld' if it does not exist
+        CreateWorkingDirIfRequired();
+
+        // Create/open current project database
+        DB.Open(GetDBFilePath());
+
+        // Record the statements if the profiling is enabled
+        ProfileDB(DB, L"GetMatchingIdentifierList");
+
+        __try
+        {
+            // Make the tags of the shared SDK database available
+            AttachSDKDB(DB);
 
-                if (!Exists)
-                    List.push_back(Symbol);
+            SQLite::TStatement QryGetMatchingIdentifiers(
+                DB,
+                Query
+                );
+
+            // The keys of the symbols of this query
+            TChBldSymbolKeys QueryKeys;
+
+            // The key columns are read into reused buffers, the complete symbol is only
+            // materialized if it's not a duplicate
+            Ctags::TTag Symbol;
+
+            while (QryGetMatchingIdentifiers.ExecuteStep() != SQLITE_DONE)
+            {
+                QryGetMatchingIdentifiers.GetColumnAsString(1, Symbol.Name);
+                QryGetMatchingIdentifiers.GetColumnAsString(5, Symbol.Kind);
+                QryGetMatchingIdentifiers.GetColumnAsString(14, Symbol.Typeref_B);
+
+                // Properties without a type are not shown
+                if ((Symbol.Kind == L"property") && Symbol.Typeref_B.IsEmpty())
+                    continue;
+
+                if (!QueryKeys.insert(TChBldSymbolIndex::GetSymbolKey(Symbol)).second)
+                    continue;
+
+                Symbol.QualifiedName    = QryGetMatchingIdentifiers.GetColumnAsString(2);
+                Symbol.File             = QryGetMatchingIdentifiers.GetColumnAsString(3);
+                Symbol.Address          = QryGetMatchingIdentifiers.GetColumnAsString(4);
+                Symbol.LineNo           = QryGetMatchingIdentifiers.GetColumnAsInt(6);
+                Symbol.Namespace        = QryGetMatchingIdentifiers.GetColumnAsString(7);
+                Symbol.Class            = QryGetMatchingIdentifiers.GetColumnAsString(8);
+                Symbol.Struct           = QryGetMatchingIdentifiers.GetColumnAsString(9);
+                Symbol.Access           = QryGetMatchingIdentifiers.GetColumnAsString(10);
+                Symbol.Implementation   = QryGetMatchingIdentifiers.GetColumnAsString(11);
+                Symbol.Signature        = QryGetMatchingIdentifiers.GetColumnAsString(12);
+                Symbol.Typeref_A        = QryGetMatchingIdentifiers.GetColumnAsString(13);
+                Symbol.Inherits         = QryGetMatchingIdentifiers.GetColumnAsString(15);
+
+                Symbols.push_back(Symbol);
             }
         }
+        __finally
+        {
+            // Close the connection to database
+            DB.Close();
+        }
+
+        // Begin of interlock
+        {
+            TChBldLockGuard LG(FQueryCacheMutex);
 
+            FTagListCache.Add(CacheKey, Symbols);
+        }
+        // End of interlock
     }
-    __finally
+
+    // Add each symbol only once
+    foreach_ (const Ctags::TTag& Symbol, Symbols)
     {
-        // Close the connection to database
-        DB.Close();
+        if (Keys->insert(TChBldSymbolIndex::GetSymbolKey(Symbol)).second)
+            List.push_back(Symbol);
     }
 }
 //---------------------------------------------------------------------------
@@ -583,37 +865,67 @@ void TChBldProjectDB::GetPosNamespaces(
 {
     CS_SEND(L"ProjectDB::GetPosNamespaces");
 
-    SQLite::TDatabase DB(SQLite::jmWal);
-
     // Clear the namespaces
     Namespaces.clear();
 
-    // Create the sub-directory '__chbld' if it does not exist
-    CreateWorkingDirIfRequired();
-
-    // Create/open current project database
-    DB.Open(FProjectPath + L"__chbld\\" + kDBFileName);
+    String CacheKey = GetQueryCacheKey(L"PosNamespaces", FileName + L"\n" + String(Line));
+
+    // Begin of interlock
+    {
+        TChBldLockGuard CLG(FQueryCacheMutex);
+
+        if (FStringListCache.Find(CacheKey, Namespaces))
+            return;
+    }
+    // End of interlock
+
+    // Get shared access to the DB
+    TChBldReadLockGuard LG(FDBLock);
+
+    SQLite::TDatabase DB(SQLite::jmWal);
+
+    // Create the sub-directory '__chbld' if it does not exist
+    CreateWorkingDirIfRequired();
+
+    // Create/open current project database
+    DB.Open(GetDBFilePath());
+
+    // Record the statements if the profiling is enabled
+    ProfileDB(DB, L"GetPosNamespaces");
 
     __try
     {
+        // Make the tags of the shared SDK database available
+        AttachSDKDB(DB);
+
         SQLite::TStatement QryGetNamespaces(
             DB,
-            L"SELECT * FROM Common "
-            L"WHERE FileName = '"
-            + FileName + L"' "
+            L"SELECT TagName FROM Common "
+            L"WHERE FileName = ?1 "
             L"AND Kind = 'namespace' "
-            L"AND LineNo <= " + Line + L" "
+            L"AND LineNo <= ?2 "
             L"ORDER BY LineNo ASC;"
             );
 
+        QryGetNamespaces.BindString(1, FileName);
+        QryGetNamespaces.BindInt(   2, Line);
+
         while (QryGetNamespaces.ExecuteStep() != SQLITE_DONE)
-            Namespaces.push_back(QryGetNamespaces.GetColumnAsString(1));
+            Namespaces.push_back(QryGetNamespaces.GetColumnAsString(0));
     }
     __finally
     {
         // Close the connection to database
         DB.Close();
     }
+
+    // Begin of interlock
+    {
+        TChBldLockGuard CLG(FQueryCacheMutex);
+
+        FStringListCache.Add(CacheKey, Namespaces);
+    }
+    // End of interlock
 }
 //---------------------------------------------------------------------------
 
@@ -626,6 +938,9 @@ void TChBldProjectDB::GetPosClassesAndStructs(
 {
     CS_SEND(L"ProjectDB::GetPosClassesAndStructs");
 
+    // Get shared access to the DB
+    TChBldReadLockGuard LG(FDBLock);
+
     SQLite::TDatabase DB(SQLite::jmWal);
 
     // Clear the classes
@@ -635,7 +950,10 @@ void TChBldProjectDB::GetPosClassesAndStructs(
     CreateWorkingDirIfRequired();
 
     // Create/open current project database
-    DB.Open(FProjectPath + L"__chbld\\" + kDBFileName);
+    DB.Open(GetDBFilePath());
+
+    // Record the statements if the profiling is enabled
+    ProfileDB(DB, L"GetPosClassesAndStructs");
 
     __try
     {
@@ -655,42 +973,64 @@ Ctags::TTag TChBldProjectDB::GetPosSymbol(const String& SymbolText)
 
     Ctags::TTag Symbol;
 
+    Symbol.LineNo = 0;
+
+    String CacheKey = GetQueryCacheKey(L"PosSymbol", SymbolText);
+
+    // The symbol is looked up again and again while hovering over it
+    // Begin of interlock
+    {
+        TChBldLockGuard CLG(FQueryCacheMutex);
+
+        Ctags::VTag CachedSymbols;
+
+        if (FTagListCache.Find(CacheKey, CachedSymbols))
+            return CachedSymbols.empty() ? Symbol : CachedSymbols.front();
+    }
+    // End of interlock
+
+    // Get shared access to the DB
+    TChBldReadLockGuard LG(FDBLock);
+
     SQLite::TDatabase DB(SQLite::jmWal);
 
     // Create the sub-directory '__chbld' if it does not exist
     CreateWorkingDirIfRequired();
 
     // Create/open current project database
-    DB.Open(FProjectPath + L"__chbld\\" + kDBFileName);
+    DB.Open(GetDBFilePath());
+
+    // Record the statements if the profiling is enabled
+    ProfileDB(DB, L"GetPosSymbol");
 
     __try
     {
+        // Make the tags of the shared SDK database available
+        AttachSDKDB(DB);
+
+        // Only the fields shown by the symbol hint or needed for browsing are fetched
         SQLite::TStatement QryGetSymbol(
             DB,
-            L"SELECT * FROM Common "
-            L"WHERE TagName = '" + SymbolText + L"' "
+            L"SELECT TagName, QualifiedName, FileName, Kind, LineNo, Signature, Typeref_B "
+            L"FROM Common "
+            L"WHERE TagName = ?1 "
             L"AND ((Kind = 'variable') OR (Kind = 'local') OR (Kind = 'function') OR (Kind = 'class') "
             L"OR (Kind = 'struct') OR (Kind = 'namespace') OR (Kind = 'typedef') OR "
-            L"(Kind = 'enumerator') OR (Kind = 'enum') OR (Kind = 'constructor') OR (Kind = 'destructor'))"
+            L"(Kind = 'enumerator') OR (Kind = 'enum') OR (Kind = 'constructor') OR (Kind = 'destructor')) "
+            L"LIMIT 1;"
             );
 
+        QryGetSymbol.BindString(1, SymbolText);
+
         if (QryGetSymbol.ExecuteStep() != SQLITE_DONE)
         {
-            Symbol.Name             = QryGetSymbol.GetColumnAsString(1);
-            Symbol.QualifiedName    = QryGetSymbol.GetColumnAsString(2);
-            Symbol.File             = QryGetSymbol.GetColumnAsString(3);
-            Symbol.Address          = QryGetSymbol.GetColumnAsString(4);
-            Symbol.Kind             = QryGetSymbol.GetColumnAsString(5);
-            Symbol.LineNo           = QryGetSymbol.GetColumnAsInt(6);
-            Symbol.Namespace        = QryGetSymbol.GetColumnAsString(7);
-            Symbol.Class            = QryGetSymbol.GetColumnAsString(8);
-            Symbol.Struct           = QryGetSymbol.GetColumnAsString(9);
-            Symbol.Access           = QryGetSymbol.GetColumnAsString(10);
-            Symbol.Implementation   = QryGetSymbol.GetColumnAsString(11);
-            Symbol.Signature        = QryGetSymbol.GetColumnAsString(12);
-            Symbol.Typeref_A        = QryGetSymbol.GetColumnAsString(13);
-            Symbol.Typeref_B        = QryGetSymbol.GetColumnAsString(14);
-            Symbol.Inherits         = QryGetSymbol.GetColumnAsString(15);
+            Symbol.Name             = QryGetSymbol.GetColumnAsString(0);
+            Symbol.QualifiedName    = QryGetSymbol.GetColumnAsString(1);
+            Symbol.File             = QryGetSymbol.GetColumnAsString(2);
+            Symbol.Kind             = QryGetSymbol.GetColumnAsString(3);
+            Symbol.LineNo           = QryGetSymbol.GetColumnAsInt(4);
+            Symbol.Signature        = QryGetSymbol.GetColumnAsString(5);
+            Symbol.Typeref_B        = QryGetSymbol.GetColumnAsString(6);
         }
     }
     __finally
@@ -699,54 +1039,83 @@ Ctags::TTag TChBldProjectDB::GetPosSymbol(const String& SymbolText)
         DB.Close();
     }
 
+    // Begin of interlock
+    {
+        TChBldLockGuard CLG(FQueryCacheMutex);
+
+        // Unknown symbols are cached as well (as empty list)
+        FTagListCache.Add(
+            CacheKey,
+            Symbol.Name.IsEmpty() ? Ctags::VTag() : Ctags::VTag(1, Symbol)
+            );
+    }
+    // End of interlock
+
     return Symbol;
 }
 //---------------------------------------------------------------------------
 
-Ctags::TTag TChBldProjectDB::GetPosImplementation(const String& FileName, const int Line, const int Column)
+void TChBldProjectDB::FindSymbols(const String& Query, Ctags::VTag& List, int MaxResults)
+{
+    CS_SEND(L"ProjectDB::FindSymbols(" + Query + L")");
+    unsigned int StartTicks = GetTickCount();
+
+    List.clear();
+
+    // The substring and camel-case search is served by the trigram index of the symbol
+    // index (the implementations are found via their prototypes)
+    GetSymbolIndex()->FindSymbols(Query, ~static_cast<unsigned int>(tkImplementation), MaxResults, List);
+
+    CS_SEND(
+        L"ProjectDB::FindSymbols(End, "
+            + String(static_cast<int>(List.size()))
+            + L" symbols, "
+            + String(GetTickCount() - StartTicks)
+            + L")"
+        );
+}
+//---------------------------------------------------------------------------
+
+TChBldTagLocation TChBldProjectDB::GetPosImplementation(const String& FileName, const int Line, const int Column)
 {
     CS_SEND(L"ProjectDB::GetPosImplementation");
 
+    // Get shared access to the DB
+    TChBldReadLockGuard LG(FDBLock);
+
     SQLite::TDatabase DB(SQLite::jmWal);
 
-    Ctags::TTag Symbol;
+    TChBldTagLocation Location = TChBldTagLocation();
 
     // Create the sub-directory '__chbld' if it does not exist
     CreateWorkingDirIfRequired();
 
     // Create/open current project database
-    DB.Open(FProjectPath + L"__chbld\\" + kDBFileName);
+    DB.Open(GetDBFilePath());
+
+    // Record the statements if the profiling is enabled
+    ProfileDB(DB, L"GetPosImplementation");
 
     __try
     {
+        // Make the tags of the shared SDK database available
+        AttachSDKDB(DB);
+
         SQLite::TStatement QryGetEnclosedFunction(
             DB,
-            L"SELECT * FROM Common "
-            L"WHERE FileName = '"
-            + FileName + L"' "
+            L"SELECT " + kTagLocationColumns + L" FROM Common "
+            L"WHERE FileName = ?1 "
             L"AND Kind = 'implementation' "
-            L"AND LineNo <= " + Line + L" "
-            L"ORDER BY LineNo DESC;"
+            L"AND LineNo <= ?2 "
+            L"ORDER BY LineNo DESC "
+            L"LIMIT 1;"
             );
 
+        QryGetEnclosedFunction.BindString(1, FileName);
+        QryGetEnclosedFunction.BindInt(   2, Line);
+
         if (QryGetEnclosedFunction.ExecuteStep() != SQLITE_DONE)
-        {
-            Symbol.Name             = QryGetEnclosedFunction.GetColumnAsString(1);
-            Symbol.QualifiedName    = QryGetEnclosedFunction.GetColumnAsString(2);
-            Symbol.File             = QryGetEnclosedFunction.GetColumnAsString(3);
-            Symbol.Address          = QryGetEnclosedFunction.GetColumnAsString(4);
-            Symbol.Kind             = QryGetEnclosedFunction.GetColumnAsString(5);
-            Symbol.LineNo           = QryGetEnclosedFunction.GetColumnAsInt(6);
-            Symbol.Namespace        = QryGetEnclosedFunction.GetColumnAsString(7);
-            Symbol.Class            = QryGetEnclosedFunction.GetColumnAsString(8);
-            Symbol.Struct           = QryGetEnclosedFunction.GetColumnAsString(9);
-            Symbol.Access           = QryGetEnclosedFunction.GetColumnAsString(10);
-            Symbol.Implementation   = QryGetEnclosedFunction.GetColumnAsString(11);
-            Symbol.Signature        = QryGetEnclosedFunction.GetColumnAsString(12);
-            Symbol.Typeref_A        = QryGetEnclosedFunction.GetColumnAsString(13);
-            Symbol.Typeref_B        = QryGetEnclosedFunction.GetColumnAsString(14);
-            Symbol.Inherits         = QryGetEnclosedFunction.GetColumnAsString(15);
-        }
+            ReadTagLocation(QryGetEnclosedFunction, Location);
     }
     __finally
     {
@@ -754,53 +1123,49 @@ Ctags::TTag TChBldProjectDB::GetPosImplementation(const String& FileName, const
         DB.Close();
     }
 
-    return Symbol;
+    return Location;
 }
 //---------------------------------------------------------------------------
 
-Ctags::TTag TChBldProjectDB::GetPosHeader(const String& FileName, const int Line, const int Column)
+TChBldTagLocation TChBldProjectDB::GetPosHeader(const String& FileName, const int Line, const int Column)
 {
     CS_SEND(L"ProjectDB::GetPosHeader");
 
+    // Get shared access to the DB
+    TChBldReadLockGuard LG(FDBLock);
+
     SQLite::TDatabase DB(SQLite::jmWal);
 
-    Ctags::TTag Symbol;
+    TChBldTagLocation Location = TChBldTagLocation();
 
     // Create the sub-directory '__chbld' if it does not exist
     CreateWorkingDirIfRequired();
 
     // Create/open current project database
-    DB.Open(FProjectPath + L"__chbld\\" + kDBFileName);
+    DB.Open(GetDBFilePath());
+
+    // Record the statements if the profiling is enabled
+    ProfileDB(DB, L"GetPosHeader");
 
     __try
     {
+        // Make the tags of the shared SDK database available
+        AttachSDKDB(DB);
+
         SQLite::TStatement QryGetHeader(
             DB,
-            L"SELECT * FROM Common "
+            L"SELECT " + kTagLocationColumns + L" FROM Common "
             L"WHERE ((Kind = 'function') OR (Kind = 'constructor') OR (Kind = 'destructor')) "
-            L"AND FileName = '" + FileName + L"' "
-            L"AND LineNo = " + String(Line) + L" "
-            L"ORDER BY LineNo DESC;"
+            L"AND FileName = ?1 "
+            L"AND LineNo = ?2 "
+            L"LIMIT 1;"
             );
 
+        QryGetHeader.BindString(1, FileName);
+        QryGetHeader.BindInt(   2, Line);
+
         if (QryGetHeader.ExecuteStep() != SQLITE_DONE)
-        {
-            Symbol.Name             = QryGetHeader.GetColumnAsString(1);
-            Symbol.QualifiedName    = QryGetHeader.GetColumnAsString(2);
-            Symbol.File             = QryGetHeader.GetColumnAsString(3);
-            Symbol.Address          = QryGetHeader.GetColumnAsString(4);
-            Symbol.Kind             = QryGetHeader.GetColumnAsString(5);
-            Symbol.LineNo           = QryGetHeader.GetColumnAsInt(6);
-            Symbol.Namespace        = QryGetHeader.GetColumnAsString(7);
-            Symbol.Class            = QryGetHeader.GetColumnAsString(8);
-            Symbol.Struct           = QryGetHeader.GetColumnAsString(9);
-            Symbol.Access           = QryGetHeader.GetColumnAsString(10);
-            Symbol.Implementation   = QryGetHeader.GetColumnAsString(11);
-            Symbol.Signature        = QryGetHeader.GetColumnAsString(12);
-            Symbol.Typeref_A        = QryGetHeader.GetColumnAsString(13);
-            Symbol.Typeref_B        = QryGetHeader.GetColumnAsString(14);
-            Symbol.Inherits         = QryGetHeader.GetColumnAsString(15);
-        }
+            ReadTagLocation(QryGetHeader, Location);
     }
     __finally
     {
@@ -808,52 +1173,49 @@ Ctags::TTag TChBldProjectDB::GetPosHeader(const String& FileName, const int Line
         DB.Close();
     }
 
-    return Symbol;
+    return Location;
 }
 //---------------------------------------------------------------------------
 
-Ctags::TTag TChBldProjectDB::GetPosHeaderTarget(Ctags::TTag& Symbol)
+TChBldTagLocation TChBldProjectDB::GetPosHeaderTarget(const TChBldTagLocation& Symbol)
 {
     CS_SEND(L"ProjectDB::GetPosHeaderTarget");
 
+    // Get shared access to the DB
+    TChBldReadLockGuard LG(FDBLock);
+
     SQLite::TDatabase DB(SQLite::jmWal);
 
-    Ctags::TTag HeaderSymbol;
+    TChBldTagLocation HeaderLocation = TChBldTagLocation();
 
     // Create the sub-directory '__chbld' if it does not exist
     CreateWorkingDirIfRequired();
 
     // Create/open current project database
-    DB.Open(FProjectPath + L"__chbld\\" + kDBFileName);
+    DB.Open(GetDBFilePath());
+
+    // Record the statements if the profiling is enabled
+    ProfileDB(DB, L"GetPosHeaderTarget");
 
     __try
     {
+        // Make the tags of the shared SDK database available
+        AttachSDKDB(DB);
+
         SQLite::TStatement QryGetMatchingHeader(
             DB,
-            L"SELECT * FROM Common "
+            L"SELECT " + kTagLocationColumns + L" FROM Common "
             L"WHERE ((Kind = 'function') OR (Kind = 'constructor') OR (Kind = 'destructor')) "
-            L"AND TagName = '" + Symbol.Name + L"' "
-            L"AND Signature = '" + Symbol.Signature + L"';"
+            L"AND TagName = ?1 "
+            L"AND Signature = ?2 "
+            L"LIMIT 1;"
             );
 
+        QryGetMatchingHeader.BindString(1, Symbol.Name);
+        QryGetMatchingHeader.BindString(2, Symbol.Signature);
+
         if (QryGetMatchingHeader.ExecuteStep() != SQLITE_DONE)
-        {
-            HeaderSymbol.Name             = QryGetMatchingHeader.GetColumnAsString(1);
-            HeaderSymbol.QualifiedName    = QryGetMatchingHeader.GetColumnAsString(2);
-            HeaderSymbol.File             = QryGetMatchingHeader.GetColumnAsString(3);
-            HeaderSymbol.Address          = QryGetMatchingHeader.GetColumnAsString(4);
-            HeaderSymbol.Kind             = QryGetMatchingHeader.GetColumnAsString(5);
-            HeaderSymbol.LineNo           = QryGetMatchingHeader.GetColumnAsInt(6);
-            HeaderSymbol.Namespace        = QryGetMatchingHeader.GetColumnAsString(7);
-            HeaderSymbol.Class            = QryGetMatchingHeader.GetColumnAsString(8);
-            HeaderSymbol.Struct           = QryGetMatchingHeader.GetColumnAsString(9);
-            HeaderSymbol.Access           = QryGetMatchingHeader.GetColumnAsString(10);
-            HeaderSymbol.Implementation   = QryGetMatchingHeader.GetColumnAsString(11);
-            HeaderSymbol.Signature        = QryGetMatchingHeader.GetColumnAsString(12);
-            HeaderSymbol.Typeref_A        = QryGetMatchingHeader.GetColumnAsString(13);
-            HeaderSymbol.Typeref_B        = QryGetMatchingHeader.GetColumnAsString(14);
-            HeaderSymbol.Inherits         = QryGetMatchingHeader.GetColumnAsString(15);
-        }
+            ReadTagLocation(QryGetMatchingHeader, HeaderLocation);
     }
     __finally
     {
@@ -861,52 +1223,49 @@ Ctags::TTag TChBldProjectDB::GetPosHeaderTarget(Ctags::TTag& Symbol)
         DB.Close();
     }
 
-    return HeaderSymbol;
+    return HeaderLocation;
 }
 //---------------------------------------------------------------------------
 
-Ctags::TTag TChBldProjectDB::GetPosImplementationTarget(Ctags::TTag& Symbol)
+TChBldTagLocation TChBldProjectDB::GetPosImplementationTarget(const TChBldTagLocation& Symbol)
 {
     CS_SEND(L"ProjectDB::GetPosImplementationTarget");
 
+    // Get shared access to the DB
+    TChBldReadLockGuard LG(FDBLock);
+
     SQLite::TDatabase DB(SQLite::jmWal);
 
-    Ctags::TTag ImplementationSymbol;
+    TChBldTagLocation ImplementationLocation = TChBldTagLocation();
 
     // Create the sub-directory '__chbld' if it does not exist
     CreateWorkingDirIfRequired();
 
     // Create/open current project database
-    DB.Open(FProjectPath + L"__chbld\\" + kDBFileName);
+    DB.Open(GetDBFilePath());
+
+    // Record the statements if the profiling is enabled
+    ProfileDB(DB, L"GetPosImplementationTarget");
 
     __try
     {
+        // Make the tags of the shared SDK database available
+        AttachSDKDB(DB);
+
         SQLite::TStatement QryGetMatchingImplementation(
             DB,
-            L"SELECT * FROM Common "
+            L"SELECT " + kTagLocationColumns + L" FROM Common "
             L"WHERE Kind = 'implementation' "
-            L"AND TagName = '" + Symbol.Name + L"' "
-            L"AND Signature = '" + Symbol.Signature + L"';"
+            L"AND TagName = ?1 "
+            L"AND Signature = ?2 "
+            L"LIMIT 1;"
             );
 
+        QryGetMatchingImplementation.BindString(1, Symbol.Name);
+        QryGetMatchingImplementation.BindString(2, Symbol.Signature);
+
         if (QryGetMatchingImplementation.ExecuteStep() != SQLITE_DONE)
-        {
-            ImplementationSymbol.Name           = QryGetMatchingImplementation.GetColumnAsString(1);
-            ImplementationSymbol.QualifiedName  = QryGetMatchingImplementation.GetColumnAsString(2);
-            ImplementationSymbol.File           = QryGetMatchingImplementation.GetColumnAsString(3);
-            ImplementationSymbol.Address        = QryGetMatchingImplementation.GetColumnAsString(4);
-            ImplementationSymbol.Kind           = QryGetMatchingImplementation.GetColumnAsString(5);
-            ImplementationSymbol.LineNo         = QryGetMatchingImplementation.GetColumnAsInt(6);
-            ImplementationSymbol.Namespace      = QryGetMatchingImplementation.GetColumnAsString(7);
-            ImplementationSymbol.Class          = QryGetMatchingImplementation.GetColumnAsString(8);
-            ImplementationSymbol.Struct         = QryGetMatchingImplementation.GetColumnAsString(9);
-            ImplementationSymbol.Access         = QryGetMatchingImplementation.GetColumnAsString(10);
-            ImplementationSymbol.Implementation = QryGetMatchingImplementation.GetColumnAsString(11);
-            ImplementationSymbol.Signature      = QryGetMatchingImplementation.GetColumnAsString(12);
-            ImplementationSymbol.Typeref_A      = QryGetMatchingImplementation.GetColumnAsString(13);
-            ImplementationSymbol.Typeref_B      = QryGetMatchingImplementation.GetColumnAsString(14);
-            ImplementationSymbol.Inherits       = QryGetMatchingImplementation.GetColumnAsString(15);
-        }
+            ReadTagLocation(QryGetMatchingImplementation, ImplementationLocation);
     }
     __finally
     {
@@ -914,48 +1273,34 @@ Ctags::TTag TChBldProjectDB::GetPosImplementationTarget(Ctags::TTag& Symbol)
         DB.Close();
     }
 
-    return ImplementationSymbol;
+    return ImplementationLocation;
 }
 //---------------------------------------------------------------------------
 
-void TChBldProjectDB::CreateWorkingDirIfRequired()
+void TChBldProjectDB::ReadTagLocation(SQLite::TStatement& Query, TChBldTagLocation& Location)
 {
-    //CS_SEND(L"ProjectDB::CreateWorkingDirIfRequired");
-
-    // If the working dir does does not exist...
-    if (!DirectoryExists(FProjectPath + L"__chbld"))
-    {
-        // ...create it...
-        ForceDirectories(FProjectPath + L"__chbld");
+    // The columns are selected by 'kTagLocationColumns'
+    Query.GetColumnAsString(0, Location.Name);
+    Query.GetColumnAsString(1, Location.Signature);
+    Query.GetColumnAsString(2, Location.File);
 
-        // ...and the hide it
-        FileSetAttr(FProjectPath + L"__chbld", faHidden, false);
-    }
+    Location.LineNo = Query.GetColumnAsInt(3);
 }
 //---------------------------------------------------------------------------
 
-void TChBldProjectDB::SetProjectPath(const String& AProjectPath)
+void TChBldProjectDB::GetStaleFiles(
+    const std::map<String, String>& ContentFiles,
+    std::map<String, String>& StaleFiles,
+    const VString* ProjectFiles
+    )
 {
-    CS_SEND(L"ProjectDB::SetProjectPath(" + AProjectPath + L")");
-
-    // If the project path has REALLY changed
-    if (AProjectPath != FProjectPath)
-    {
-        if (!AProjectPath.IsEmpty())
-        {
-            // Assign the project path
-            FProjectPath = AProjectPath;
+    CS_SEND(L"ProjectDB::GetStaleFiles(Begin)");
+    unsigned int StartTicks = GetTickCount();
 
-            // Change the DB context to the new project
-            ChangeProjectContext();
-        }
-    }
-}
-//---------------------------------------------------------------------------
+    StaleFiles.clear();
 
-void TChBldProjectDB::ChangeProjectContext()
-{
-    CS_SEND(L"ProjectDB::ChangeProjectContext");
+    // Get shared access to the DB
+    TChBldReadLockGuard LG(FDBLock);
 
     SQLite::TDatabase DB(SQLite::jmWal);
 
@@ -963,177 +1308,1914 @@ void TChBldProjectDB::ChangeProjectContext()
     CreateWorkingDirIfRequired();
 
     // Create/open current project database
-    DB.Open(FProjectPath + L"__chbld\\" + kDBFileName);
+    DB.Open(GetDBFilePath());
+
+    // Record the statements if the profiling is enabled
+    ProfileDB(DB, L"GetStaleFiles");
 
     __try
     {
-        // Create table 'Tags' (if non existent)
-        SQLite::TStatement CmdAddTableTags(
-            DB,
-            L"CREATE TABLE IF NOT EXISTS Tags("
-                L"ID                INTEGER NOT NULL PRIMARY KEY AUTOINCREMENT,"
-                L"Name              TEXT    NOT NULL,"
-                L"QualifiedName     TEXT    NOT NULL,"
-                L"FileID            TEXT    NOT NULL,"
-                L"Address           TEXT    NOT NULL,"
-                L"Kind              TEXT    NOT NULL,"
-                L"LineNo            INT,"
-                L"Namespace         TEXT,"
-                L"Class             TEXT,"
-                L"Struct            TEXT,"
-                L"Access            TEXT,"
-                L"Implementation    TEXT,"
-                L"Signature         TEXT,"
-                L"Typeref_A         TEXT,"
-                L"Typeref_B         TEXT,"
-                L"Inherits          TEXT"
-                L");"
-            );
-
-        // Create table 'Files' (if non existent)
-        SQLite::TStatement CmdAddTableFiles(
-            DB,
-            L"CREATE TABLE IF NOT EXISTS Files("
-                L"ID        TEXT    NOT NULL PRIMARY KEY,"
-                L"Name      TEXT    NOT NULL UNIQUE"
-                L");"
-            );
+        std::set<String> KnownFiles;
 
-        // Create view 'Common' (if non existent)
-        SQLite::TStatement CmdAddViewCommon(
+        SQLite::TStatement QryGetFiles(
             DB,
-            L"CREATE VIEW IF NOT EXISTS Common AS "
-                L"SELECT "
-                    L"Tags.ID AS ID,"
-                    L"Tags.Name AS TagName,"
-                    L"Tags.QualifiedName AS QualifiedName,"
-                    L"Files.Name AS FileName,"
-                    L"Tags.Address AS Address,"
-                    L"Tags.Kind AS Kind,"
-                    L"Tags.LineNo AS LineNo,"
-                    L"Tags.Namespace AS Namespace,"
-                    L"Tags.Class AS Class,"
-                    L"Tags.Struct AS Struct,"
-                    L"Tags.Access AS Access,"
-                    L"Tags.Implementation AS Implementation,"
-                    L"Tags.Signature AS Signature,"
-                    L"Tags.Typeref_A AS Typeref_A,"
-                    L"Tags.Typeref_B AS Typeref_B,"
-                    L"Tags.Inherits AS Inherits "
-                L"FROM "
-                    L"Tags "
-                L"INNER JOIN "
-                    L"Files ON Files.ID = Tags.FileID"
-            L";"
+            L"SELECT Name, MTime, Size, Hash FROM Files;"
             );
 
-        try
+        while (QryGetFiles.ExecuteStep() != SQLITE_DONE)
         {
-            // Begin transaction
-            DB.BeginTransaction();
+            String  FileName    = QryGetFiles.GetColumnAsString(0);
+            __int64 StoredMTime = QryGetFiles.GetColumnAsInt64(1);
+            __int64 StoredSize  = QryGetFiles.GetColumnAsInt64(2);
+            String  StoredHash  = QryGetFiles.GetColumnAsString(3);
 
-            // Run command 'AddTableTags'
-            CmdAddTableTags.ExecuteStep();
+            KnownFiles.insert(FileName);
 
-            // Run command 'AddTableFiles'
-            CmdAddTableFiles.ExecuteStep();
+            std::map<String, String>::const_iterator ContentFile = ContentFiles.find(FileName);
 
-            // Run command 'AddViewCommon'
-            CmdAddViewCommon.ExecuteStep();
+            // The editor contents may differ from the files on disk, so they're compared by hash
+            if (ContentFile != ContentFiles.end())
+            {
+                if (!FileExists(ContentFile->second)
+                    || (THashMD5::GetHashStringFromFile(ContentFile->second) != StoredHash))
+                    StaleFiles[FileName] = ContentFile->second;
 
-            // Commit transaction
-            DB.CommitTransaction();
-        }
-        catch (Exception& E)
-        {
-            // On exception, rollback transaction
-            DB.RollbackTransaction();
+                continue;
+            }
+
+            __int64 MTime;
+            __int64 Size;
+
+            // Vanished files are stale, too (re-tagging removes their tags)
+            if (!Environment::GetFileStamp(FileName, MTime, Size))
+            {
+                StaleFiles[FileName] = FileName;
+                continue;
+            }
+
+            if ((MTime == StoredMTime) && (Size == StoredSize))
+                continue;
 
-            // Throw E again
-            throw Exception(E.Message);
+            // A file with a new stamp but the same size may be unchanged (e.g. after a checkout),
+            // so the content decides
+            if ((Size == StoredSize) && (THashMD5::GetHashStringFromFile(FileName) == StoredHash))
+                continue;
+
+            StaleFiles[FileName] = FileName;
         }
-        catch (...)
+
+        std::pair<String, String> ContentFile;
+
+        // Editor contents which have never been tagged are stale as well
+        foreach_ (ContentFile, ContentFiles)
         {
-            // On exception, rollback transaction
-            DB.RollbackTransaction();
+            if (KnownFiles.count(ContentFile.first) == 0)
+                StaleFiles[ContentFile.first] = ContentFile.second;
+        }
 
-            // Throw Exception again
-            throw Exception(L"Unknown exception");
+        // ...as well as the (existing) project files
+        if (ProjectFiles)
+        {
+            foreach_ (const String& ProjectFile, *ProjectFiles)
+            {
+                if ((KnownFiles.count(ProjectFile) == 0)
+                    && (ContentFiles.count(ProjectFile) == 0)
+                    && FileExists(ProjectFile))
+                {
+                    StaleFiles[ProjectFile] = ProjectFile;
+                }
+            }
         }
+    }
+    __finally
+    {
+        DB.Close();
+    }
 
-        // Create unique index for table 'Tags'
-        SQLite::TStatement CmdAddUniqueIndexTags(
-            DB,
-            L"CREATE UNIQUE INDEX IF NOT EXISTS UniqueIndex "
-            L"ON Tags ("
-                L"Name,"
-                L"QualifiedName,"
-                L"FileID,"
-                L"Address,"
-                L"Kind,"
-                L"LineNo,"
-                L"Namespace,"
-                L"Class,"
-                L"Struct,"
-                L"Access,"
-                L"Implementation,"
-                L"Signature,"
-                L"Typeref_A,"
-                L"Typeref_B,"
-                L"Inherits"
-                L");"
-            );
+    CS_SEND(
+        L"ProjectDB::GetStaleFiles(End, "
+            + String(static_cast<int>(StaleFiles.size()))
+            + L" stale, "
+            + String(GetTickCount() - StartTicks)
+            + L")"
+        );
+}
+//---------------------------------------------------------------------------
 
-        // Delete the content of 'Tags'
-        SQLite::TStatement CmdClearTableTags(
-            DB,
-            L"DELETE FROM Tags;"
-            );
+TChBldSymbolIndexPtr TChBldProjectDB::GetSymbolIndex()
+{
+    // The index itself is immutable, so the readers only have to get the pointer atomically
+    return boost::atomic_load(&FSymbolIndex);
+}
+//---------------------------------------------------------------------------
 
-        // Delete the content of 'Files'
-        SQLite::TStatement CmdClearTableFiles(
-            DB,
-            L"DELETE FROM Files;"
-            );
+void TChBldProjectDB::PublishSymbolIndex(const TChBldSymbolIndexPtr& SymbolIndex)
+{
+    // Readers still using the old index keep it alive until they're done
+    boost::atomic_store(&FSymbolIndex, SymbolIndex);
 
-        try
-        {
-            // Begin transaction
-            DB.BeginTransaction();
+    // A new index comes with a changed database
+    InvalidateQueryCache();
+}
+//---------------------------------------------------------------------------
 
-            // Run command 'ClearTableTags'
-            CmdClearTableTags.ExecuteStep();
+TChBldQueryCacheStats TChBldProjectDB::GetQueryCacheStats()
+{
+    TChBldLockGuard LG(FQueryCacheMutex);
 
-            // Run command 'ClearTableFiles'
-            CmdClearTableFiles.ExecuteStep();
+    TChBldQueryCacheStats Stats;
 
-            // Run command 'AddUniqueIndexTags'
-            CmdAddUniqueIndexTags.ExecuteStep();
+    Stats.Hits          = FTagListCache.Hits + FStringListCache.Hits;
+    Stats.Misses        = FTagListCache.Misses + FStringListCache.Misses;
+    Stats.Generation    = FQueryGeneration;
 
-            // Commit transaction
-            DB.CommitTransaction();
-        }
-        catch (Exception& E)
+    return Stats;
+}
+//---------------------------------------------------------------------------
+
+void TChBldProjectDB::InvalidateQueryCache()
+{
+    TChBldLockGuard LG(FQueryCacheMutex);
+
+    // The keys of the cached results contain the generation, so they won't match anymore...
+    ++FQueryGeneration;
+
+    // ...but there's no need to keep them
+    FTagListCache.Clear();
+    FStringListCache.Clear();
+}
+//---------------------------------------------------------------------------
+
+String TChBldProjectDB::GetQueryCacheKey(const String& QueryKind, const String& Arguments)
+{
+    TChBldLockGuard LG(FQueryCacheMutex);
+
+    return QueryKind + L"\n" + String(FQueryGeneration) + L"\n" + Arguments;
+}
+//---------------------------------------------------------------------------
+
+void TChBldProjectDB::RegisterLockWait(unsigned int WaitTime)
+{
+    // Report each new worst case
+    if (WaitTime > FMaxLockWait)
+    {
+        FMaxLockWait = WaitTime;
+
+        CS_SEND(L"ProjectDB::RegisterLockWait(New worst case: " + String(WaitTime) + L")");
+    }
+}
+//---------------------------------------------------------------------------
+
+void TChBldProjectDB::Maintain()
+{
+    if (FProjectPath.IsEmpty())
+        return;
+
+    // Checkpoint after large commits, so the WAL doesn't grow with each refresh and the
+    // readers don't have to scan it...
+    bool DoCheckpoint = (FCheckpointRows > 0) && (FPendingRows >= static_cast<unsigned int>(FCheckpointRows));
+
+    // ...and keep the statistics of the query planner up to date
+    bool DoAnalyze =
+        (FRowsSinceAnalyze > 0) && ((GetTickCount() - FLastAnalyze) > FAnalyzeInterval);
+
+    if (!DoCheckpoint && !DoAnalyze)
+        return;
+
+    unsigned int StartTicks = GetTickCount();
+
+    String DBFilePath = GetDBFilePath();
+
+    __int64 ModificationTime;
+    __int64 WalSizeBefore   = 0;
+    __int64 WalSizeAfter    = 0;
+
+    Environment::GetFileStamp(DBFilePath + L"-wal", ModificationTime, WalSizeBefore);
+
+    int FreePages       = 0;
+    int VacuumedPages   = 0;
+
+    bool RebuildRequested = false;
+
+    try
+    {
+        SQLite::TDatabase DB(SQLite::jmWal);
+
+        // Create/open current project database
+        DB.Open(DBFilePath);
+
+        __try
         {
-            // On exception, rollback transaction
-            DB.RollbackTransaction();
+            if (DoCheckpoint)
+            {
+                int Busy            = 1;
+                int LogPages        = 0;
+                int CheckpointPages = 0;
+
+                // A passive checkpoint copies as much of the WAL back to the database as
+                // possible without waiting for the readers...
+                {
+                    SQLite::TStatement CmdCheckpoint(DB, L"PRAGMA wal_checkpoint(PASSIVE);");
+
+                    if (CmdCheckpoint.ExecuteStep() == SQLITE_ROW)
+                    {
+                        Busy            = CmdCheckpoint.GetColumnAsInt(0);
+                        LogPages        = CmdCheckpoint.GetColumnAsInt(1);
+                        CheckpointPages = CmdCheckpoint.GetColumnAsInt(2);
+                    }
+                }
+
+                // ...if it got everything, the WAL can be truncated (this only waits for the
+                // readers which are still using the end of the WAL)
+                if ((Busy == 0) && (LogPages == CheckpointPages))
+                {
+                    SQLite::TStatement CmdCheckpoint(DB, L"PRAGMA wal_checkpoint(TRUNCATE);");
+
+                    CmdCheckpoint.ExecuteStep();
+                }
+
+                FPendingRows = 0;
+
+                // The deleted tags leave free pages behind
+                FreePages = GetPragmaValue(DB, L"freelist_count");
+
+                // Begin of interlock
+                {
+                    TChBldLockGuard LG(FUpdateMutex);
+
+                    if (FreePages > 0)
+                    {
+                        // Databases of older versions have no auto vacuum yet: Once there's a
+                        // lot of free space, the next full update rebuilds them (the shadow
+                        // database is created with auto vacuum and swapped in under a short
+                        // lock, whereas a VACUUM in place would block the readers throughout)
+                        if (GetPragmaValue(DB, L"auto_vacuum") != 2)
+                        {
+                            if ((FreePages * 4) > GetPragmaValue(DB, L"page_count"))
+                            {
+                                FRequiresRebuild = true;
+
+                                RebuildRequested = true;
+                            }
+                        }
+                        // Otherwise the free pages are simply released
+                        else
+                        {
+                            SQLite::TStatement CmdIncrementalVacuum(DB, L"PRAGMA incremental_vacuum;");
+
+                            while (CmdIncrementalVacuum.ExecuteStep() != SQLITE_DONE)
+                                ;
+                        }
+
+                        VacuumedPages = FreePages - GetPragmaValue(DB, L"freelist_count");
+                    }
+                }
+                // End of interlock
+            }
+
+            if (DoAnalyze)
+            {
+                // Begin of interlock
+                {
+                    TChBldLockGuard LG(FUpdateMutex);
 
-            // Throw E again
-            throw Exception(E.Message);
+                    SQLite::TStatement CmdAnalyze(DB, L"ANALYZE;");
+
+                    CmdAnalyze.ExecuteStep();
+                }
+                // End of interlock
+
+                FRowsSinceAnalyze   = 0;
+                FLastAnalyze        = GetTickCount();
+            }
         }
-        catch (...)
+        __finally
         {
-            // On exception, rollback transaction
-            DB.RollbackTransaction();
-
-            // Throw Exception again
-            throw Exception(L"Unknown exception");
+            DB.Close();
         }
     }
-    __finally
+    catch (Exception& E)
     {
-        // Close the connection to database
-        DB.Close();
+        // Maintenance is retried with the next large commit
+        CS_SEND(L"ProjectDB::Maintain(Failed: " + E.Message + L")");
+
+        return;
+    }
+
+    Environment::GetFileStamp(DBFilePath + L"-wal", ModificationTime, WalSizeAfter);
+
+    CS_SEND(
+        L"ProjectDB::Maintain(Checkpoint: "
+            + String((int)DoCheckpoint)
+            + L", WAL: "
+            + String(WalSizeBefore / 1024)
+            + L" -> "
+            + String(WalSizeAfter / 1024)
+            + L" KB, free pages: "
+            + String(FreePages)
+            + L", vacuumed: "
+            + String(VacuumedPages)
+            + (RebuildRequested ? L" (rebuild requested)" : L"")
+            + L", analyze: "
+            + String((int)DoAnalyze)
+            + L", "
+            + String(GetTickCount() - StartTicks)
+            + L")"
+        );
+}
+//---------------------------------------------------------------------------
+
+void TChBldProjectDB::ProfileDB(SQLite::TDatabase& DB, const String& Method)
+{
+    // The statements are only measured while the profiler is enabled
+    if (FQueryProfiler.Enabled)
+        DB.SetProfiler(&FQueryProfiler, Method);
+}
+//---------------------------------------------------------------------------
+
+TChBldQueryProfiler* TChBldProjectDB::GetQueryProfiler()
+{
+    return &FQueryProfiler;
+}
+//---------------------------------------------------------------------------
+
+void TChBldProjectDB::CreateWorkingDirIfRequired()
+{
+    //CS_SEND(L"ProjectDB::CreateWorkingDirIfRequired");
+
+    // If the working dir does does not exist...
+    if (!DirectoryExists(FProjectPath + L"__chbld"))
+    {
+        // ...create it...
+        ForceDirectories(FProjectPath + L"__chbld");
+
+        // ...and the hide it
+        FileSetAttr(FProjectPath + L"__chbld", faHidden, false);
+    }
+
+    // Create the folder of the current variant database
+    if (!DirectoryExists(GetDBFolder()))
+        ForceDirectories(GetDBFolder());
+}
+//---------------------------------------------------------------------------
+
+String TChBldProjectDB::GetDBFolder()
+{
+    // Each build variant has its own sub-directory (without a variant, e.g. when there's
+    // no active project, the database is kept directly in '__chbld')
+    if (FVariant.IsEmpty())
+        return FProjectPath + L"__chbld\\";
+    else
+        return FProjectPath + L"__chbld\\" + FVariant + L"\\";
+}
+//---------------------------------------------------------------------------
+
+String TChBldProjectDB::GetDBFilePath()
+{
+    // Begin of interlock
+    {
+        TChBldLockGuard LG(FDBFileMutex);
+
+        return GetDBFilePath(FDBGeneration);
+    }
+    // End of interlock
+}
+//---------------------------------------------------------------------------
+
+String TChBldProjectDB::GetDBFilePath(int Generation)
+{
+    // The first generation uses the plain DB file name, later ones (created by deep
+    // refreshes) get their generation number appended
+    if (Generation == 0)
+        return GetDBFolder() + kDBFileName;
+    else
+        return
+            GetDBFolder()
+            + kDBFilePrefix
+            + L"_"
+            + String(Generation)
+            + ExtractFileExt(kDBFileName);
+}
+//---------------------------------------------------------------------------
+
+int TChBldProjectDB::FindDBGeneration()
+{
+    int Generation = 0;
+
+    TStringDynArray DBFiles =
+        TDirectory::GetFiles(GetDBFolder(), kDBFilePrefix + L"_*");
+
+    // Get the highest generation of a complete database file (aborted shadow databases
+    // still have their temporary file extension)
+    for (int i = 0; i < DBFiles.Length; ++i)
+    {
+        String FileName = ExtractFileName(DBFiles[i]);
+
+        if (!EndsText(ExtractFileExt(kDBFileName), FileName))
+            continue;
+
+        int FileGeneration = StrToIntDef(
+            FileName.SubString(
+                kDBFilePrefix.Length() + 2,
+                FileName.Length() - kDBFilePrefix.Length() - 1 - ExtractFileExt(kDBFileName).Length()
+                ),
+            0
+            );
+
+        if (FileGeneration > Generation)
+            Generation = FileGeneration;
+    }
+
+    return Generation;
+}
+//---------------------------------------------------------------------------
+
+void TChBldProjectDB::DeleteOldDBFiles()
+{
+    String CurrentDBFileName = ExtractFileName(GetDBFilePath());
+
+    TStringDynArray DBFiles =
+        TDirectory::GetFiles(GetDBFolder(), kDBFilePrefix + L"*");
+
+    for (int i = 0; i < DBFiles.Length; ++i)
+    {
+        // Delete everything except the current database and its journal files
+        // (this fails silently for files which are still in use)
+        if (!StartsText(CurrentDBFileName, ExtractFileName(DBFiles[i])))
+            DeleteFile(DBFiles[i]);
+    }
+}
+//---------------------------------------------------------------------------
+
+void TChBldProjectDB::PruneDBVariants()
+{
+    String WorkingDir = FProjectPath + L"__chbld\\";
+
+    // Mark the current variant as the most recently used one
+    if (!FVariant.IsEmpty())
+        TDirectory::SetLastWriteTime(GetDBFolder(), Now());
+
+    // Remove the databases of the versions without variants, which were kept directly in
+    // the working dir (this fails silently for files which are still in use)
+    if (!FVariant.IsEmpty())
+    {
+        TStringDynArray OldDBFiles = TDirectory::GetFiles(WorkingDir, kDBFilePrefix + L"*");
+
+        for (int i = 0; i < OldDBFiles.Length; ++i)
+            DeleteFile(OldDBFiles[i]);
+    }
+
+    TStringDynArray VariantDirs = TDirectory::GetDirectories(WorkingDir);
+
+    if (VariantDirs.Length <= FMaxDBVariants)
+        return;
+
+    // Sort the variants by their last usage (the newest first)
+    std::vector<std::pair<TDateTime, String> > Variants;
+
+    for (int i = 0; i < VariantDirs.Length; ++i)
+    {
+        Variants.push_back(
+            std::make_pair(TDirectory::GetLastWriteTime(VariantDirs[i]), VariantDirs[i])
+            );
+    }
+
+    std::sort(Variants.begin(), Variants.end());
+    std::reverse(Variants.begin(), Variants.end());
+
+    // Delete the least recently used variants
+    for (std::size_t i = std::max(FMaxDBVariants, 1); i < Variants.size(); ++i)
+    {
+        if (SameText(IncludeTrailingPathDelimiter(Variants[i].second), GetDBFolder()))
+            continue;
+
+        CS_SEND(L"ProjectDB::PruneDBVariants(" + ExtractFileName(Variants[i].second) + L")");
+
+        try
+        {
+            TDirectory::Delete(Variants[i].second, true);
+        }
+        catch (...)
+        {
+            // The variant may be in use by another IDE instance, so try again next time
+        }
+    }
+}
+//---------------------------------------------------------------------------
+
+int TChBldProjectDB::GetPragmaValue(SQLite::TDatabase& DB, const String& Pragma)
+{
+    SQLite::TStatement QryGetPragmaValue(DB, L"PRAGMA " + Pragma + L";");
+
+    if (QryGetPragmaValue.ExecuteStep() == SQLITE_ROW)
+        return QryGetPragmaValue.GetColumnAsInt(0);
+    else
+        return 0;
+}
+//---------------------------------------------------------------------------
+
+void TChBldProjectDB::BindTag(SQLite::TStatement& Statement, const Ctags::TTag& Tag, const String& FileID)
+{
+    Statement.BindString(  1, Tag.Name);
+    Statement.BindString(  2, Tag.QualifiedName);
+    Statement.BindString(  3, FileID);
+    Statement.BindString(  4, Tag.Address);
+    Statement.BindString(  5, Tag.Kind);
+    Statement.BindInt(     6, Tag.LineNo);
+    Statement.BindString(  7, Tag.Namespace);
+    Statement.BindString(  8, Tag.Class);
+    Statement.BindString(  9, Tag.Struct);
+    Statement.BindString( 10, Tag.Access);
+    Statement.BindString( 11, Tag.Implementation);
+    Statement.BindString( 12, Tag.Signature);
+    Statement.BindString( 13, Tag.Typeref_A);
+    Statement.BindString( 14, Tag.Typeref_B);
+    Statement.BindString( 15, Tag.Inherits);
+}
+//---------------------------------------------------------------------------
+
+String TChBldProjectDB::GetContentFileName(
+    const String& FileName,
+    const std::map<String, String>* ContentFiles
+    )
+{
+    // Editor contents are tagged from their temporary file...
+    if (ContentFiles)
+    {
+        std::map<String, String>::const_iterator ContentFile = ContentFiles->find(FileName);
+
+        if (ContentFile != ContentFiles->end())
+            return ContentFile->second;
+    }
+
+    // ...all other files directly
+    return FileName;
+}
+//---------------------------------------------------------------------------
+
+void TChBldProjectDB::BindFile(
+    SQLite::TStatement& Statement,
+    const String& FileID,
+    const String& FileName,
+    const std::map<String, String>* ContentFiles
+    )
+{
+    __int64 ModificationTime    = 0;
+    __int64 Size                = 0;
+
+    // Get the stamp of the file on disk
+    Environment::GetFileStamp(FileName, ModificationTime, Size);
+
+    // Get the hash of the content which was tagged
+    String ContentFileName = GetContentFileName(FileName, ContentFiles);
+
+    String Hash = FileExists(ContentFileName) ? THashMD5::GetHashStringFromFile(ContentFileName) : String(L"");
+
+    Statement.BindString(1, FileID);
+    Statement.BindString(2, FileName);
+    Statement.BindInt64( 3, ModificationTime);
+    Statement.BindInt64( 4, Size);
+    Statement.BindString(5, Hash);
+}
+//---------------------------------------------------------------------------
+
+void TChBldProjectDB::RebuildShadowDB(
+    const Ctags::VTag& Tags,
+    const std::map<String, String>* ContentFiles,
+    TChBldRefreshStats& Stats
+    )
+{
+    CS_SEND(L"ProjectDB::RebuildShadowDB(Begin)");
+
+    // Create the sub-directory '__chbld' if it does not exist
+    CreateWorkingDirIfRequired();
+
+    int ShadowGeneration;
+
+    // Begin of interlock
+    {
+        TChBldLockGuard LG(FDBFileMutex);
+
+        ShadowGeneration = FDBGeneration + 1;
+    }
+    // End of interlock
+
+    String ShadowFilePath       = GetDBFilePath(ShadowGeneration);
+    String ShadowTempFilePath   = ShadowFilePath + L".tmp";
+
+    // Remove the remains of an aborted rebuild
+    DeleteFile(ShadowTempFilePath);
+
+    bool Succeeded = false;
+
+    // The symbol index of the shadow database
+    boost::shared_ptr<TChBldSymbolIndex> SymbolIndex(new TChBldSymbolIndex);
+
+    // Begin of shadow database scope
+    {
+        // No journal is needed as the shadow database is simply thrown away on failure
+        SQLite::TDatabase DB(SQLite::jmOff);
+
+        // Create the shadow database
+        DB.Open(ShadowTempFilePath);
+
+        try
+        {
+            // Write the tags (the ancestors may be found in the SDK database)
+            WriteTagDB(DB, Tags, ContentFiles, true);
+
+            // The readers open the database in WAL mode
+            {
+                SQLite::TStatement CmdSetJournalMode(DB, L"PRAGMA main.journal_mode = WAL;");
+
+                CmdSetJournalMode.ExecuteStep();
+            }
+
+            // Get the number of the tags finally added
+            {
+                SQLite::TStatement QryGetTagCount(DB, L"SELECT COUNT(*) FROM Tags;");
+
+                if (QryGetTagCount.ExecuteStep() == SQLITE_ROW)
+                    Stats.Inserted = QryGetTagCount.GetColumnAsInt(0);
+            }
+
+            // Build the symbol index while we've got the database open anyway
+            SymbolIndex->Load(DB);
+
+            Succeeded = true;
+        }
+        catch (Exception& E)
+        {
+            CS_SEND(L"ProjectDB::RebuildShadowDB(Failed: " + E.Message + L")");
+        }
+        catch (...)
+        {
+            CS_SEND(L"ProjectDB::RebuildShadowDB(Failed)");
+        }
+
+        DB.Close();
+    }
+    // End of shadow database scope
+
+    // Give the complete shadow database its final name (this can't be done while it's open)
+    if (!Succeeded || !RenameFile(ShadowTempFilePath, ShadowFilePath))
+    {
+        // Keep the current database if anything went wrong
+        DeleteFile(ShadowTempFilePath);
+
+        return;
+    }
+
+    // Swap the shadow database in: The exclusive access waits for the running readers
+    // to finish their work with the old one, every reader from now on gets the new one
+    // Begin of interlock
+    {
+        TChBldWriteLockGuard WLG(FDBLock);
+        TChBldLockGuard LG(FDBFileMutex);
+
+        FDBGeneration = ShadowGeneration;
+    }
+    // End of interlock
+
+    PublishSymbolIndex(SymbolIndex);
+
+    FRequiresRebuild = false;
+
+    // Remove the old database (if it's still in use, it's removed with the next project change)
+    DeleteOldDBFiles();
+
+    CS_SEND(L"ProjectDB::RebuildShadowDB(End, Generation " + String(ShadowGeneration) + L")");
+}
+//---------------------------------------------------------------------------
+
+void TChBldProjectDB::WriteTagDB(
+    SQLite::TDatabase& DB,
+    const Ctags::VTag& Tags,
+    const std::map<String, String>* ContentFiles,
+    bool WithSDK
+    )
+{
+    // Use the bulk load settings: no syncing and a large (64 MB) page cache
+    {
+        SQLite::TStatement CmdSetSynchronous(DB, L"PRAGMA synchronous = OFF;");
+        SQLite::TStatement CmdSetCacheSize(DB, L"PRAGMA cache_size = -65536;");
+        SQLite::TStatement CmdSetTempStore(DB, L"PRAGMA temp_store = MEMORY;");
+
+        CmdSetSynchronous.ExecuteStep();
+        CmdSetCacheSize.ExecuteStep();
+        CmdSetTempStore.ExecuteStep();
+    }
+
+    // Release the pages of deleted tags by the maintenance (see 'Maintain'), this has to
+    // be set before the first table is created
+    {
+        SQLite::TStatement CmdSetAutoVacuum(DB, L"PRAGMA auto_vacuum = INCREMENTAL;");
+
+        CmdSetAutoVacuum.ExecuteStep();
+    }
+
+    // Create the tables and views
+    CreateTables(DB);
+
+    // Add all tags and files
+    {
+        SQLite::TStatement CmdInsertTag(DB, kInsertTagStatement);
+
+        SQLite::TStatement CmdWriteFile(DB, kWriteFileStatement);
+
+        // Create a map for the file name/ID relations
+        std::map<String, String> FileMap;
+
+        DB.BeginTransaction();
+
+        // Iterate over each tag record
+        for (std::size_t i = 0; i < Tags.size(); ++i)
+        {
+            // Check, whether the file is not already existent in the map...
+            if (FileMap.find(Tags[i].File) == FileMap.end())
+            {
+                // ...so we have to create an entry with a new GUID
+                FileMap[Tags[i].File] = Environment::CreateGuidString(true);
+            }
+
+            // Add the tag record data to database
+            BindTag(CmdInsertTag, Tags[i], FileMap[Tags[i].File]);
+            CmdInsertTag.ExecuteStep();
+            CmdInsertTag.Reset();
+        }
+
+        std::pair<String, String> File;
+
+        // Iterate over each file name
+        foreach_ (File, FileMap)
+        {
+            BindFile(CmdWriteFile, File.second, File.first, ContentFiles);
+            CmdWriteFile.ExecuteStep();
+            CmdWriteFile.Reset();
+        }
+
+        DB.CommitTransaction();
+    }
+
+    // Remove the duplicate tags (this is usually done by the unique index, but it's
+    // not existent yet)
+    {
+        SQLite::TStatement CmdDeleteDuplicateTags(
+            DB,
+            L"DELETE FROM Tags WHERE ID NOT IN ("
+                L"SELECT MIN(ID) FROM Tags GROUP BY "
+                    L"Name,"
+                    L"QualifiedName,"
+                    L"FileID,"
+                    L"Address,"
+                    L"Kind,"
+                    L"LineNo,"
+                    L"Namespace,"
+                    L"Class,"
+                    L"Struct,"
+                    L"Access,"
+                    L"Implementation,"
+                    L"Signature,"
+                    L"Typeref_A,"
+                    L"Typeref_B,"
+                    L"Inherits"
+                L");"
+            );
+
+        CmdDeleteDuplicateTags.ExecuteStep();
+    }
+
+    // Create the indexes after loading, which is much faster than updating them
+    // with each inserted row
+    CreateIndexes(DB);
+
+    // The ancestors of the project classes may be found in the SDK database
+    if (WithSDK)
+        AttachSDKDB(DB);
+
+    // Materialize the ancestor closure of all classes/structs
+    RefreshAncestors(DB, NULL);
+
+    // Collect the statistics for the query planner
+    {
+        SQLite::TStatement CmdAnalyze(DB, L"ANALYZE;");
+
+        CmdAnalyze.ExecuteStep();
+    }
+
+    // Stamp the database with the current schema version
+    {
+        SQLite::TStatement CmdSetSchemaVersion(
+            DB,
+            L"PRAGMA user_version = " + String(kDBSchemaVersion) + L";"
+            );
+
+        CmdSetSchemaVersion.ExecuteStep();
+    }
+}
+//---------------------------------------------------------------------------
+
+void TChBldProjectDB::SetSDK(const String& SDKDBFilePath, const VString& SDKIncludePaths)
+{
+    // Begin of interlock
+    {
+        TChBldLockGuard LG(FDBFileMutex);
+
+        if ((SDKDBFilePath == FSDKDBFilePath) && (SDKIncludePaths == FSDKIncludePaths))
+            return;
+
+        FSDKDBFilePath      = SDKDBFilePath;
+        FSDKIncludePaths    = SDKIncludePaths;
+
+        // The symbol index has to contain the tags of the (other) SDK database
+        FSymbolIndexStale   = true;
+    }
+    // End of interlock
+
+    CS_SEND(L"ProjectDB::SetSDK(" + SDKDBFilePath + L")");
+}
+//---------------------------------------------------------------------------
+
+// Loads the complete symbol index of the project (including the tags of the SDK database)
+// if the project context or the SDK has changed since the last load. This has to be called
+// on a background thread holding the 'WriterMutex' of the pipeline, as the incremental
+// refreshes build on the published index.
+void TChBldProjectDB::LoadSymbolIndex()
+{
+    // Begin of interlock
+    {
+        TChBldLockGuard LG(FDBFileMutex);
+
+        if (!FSymbolIndexStale || FProjectPath.IsEmpty())
+            return;
+
+        FSymbolIndexStale = false;
+    }
+    // End of interlock
+
+    CS_SEND(L"ProjectDB::LoadSymbolIndex(Begin)");
+    unsigned int StartTicks = GetTickCount();
+
+    boost::shared_ptr<TChBldSymbolIndex> SymbolIndex(new TChBldSymbolIndex);
+
+    try
+    {
+        // Begin of interlock
+        {
+            // Get shared access to the DB
+            TChBldReadLockGuard LG(FDBLock);
+
+            SQLite::TDatabase DB(SQLite::jmWal);
+
+            // Create the sub-directory '__chbld' if it does not exist
+            CreateWorkingDirIfRequired();
+
+            // Create/open current project database
+            DB.Open(GetDBFilePath());
+
+            __try
+            {
+                // Make the tags of the shared SDK database available
+                AttachSDKDB(DB);
+
+                SymbolIndex->Load(DB);
+            }
+            __finally
+            {
+                // Close the connection to database
+                DB.Close();
+            }
+        }
+        // End of interlock
+    }
+    catch (Exception& E)
+    {
+        CS_SEND(L"ProjectDB::LoadSymbolIndex(Failed: " + E.Message + L")");
+
+        // Retry with the next full update
+        // Begin of interlock
+        {
+            TChBldLockGuard LG(FDBFileMutex);
+
+            FSymbolIndexStale = true;
+        }
+        // End of interlock
+
+        return;
+    }
+
+    PublishSymbolIndex(SymbolIndex);
+
+    CS_SEND(L"ProjectDB::LoadSymbolIndex(End, " + String(GetTickCount() - StartTicks) + L")");
+}
+//---------------------------------------------------------------------------
+
+String TChBldProjectDB::GetSDKDBFilePath()
+{
+    TChBldLockGuard LG(FDBFileMutex);
+
+    return FSDKDBFilePath;
+}
+//---------------------------------------------------------------------------
+
+void TChBldProjectDB::AttachSDKDB(SQLite::TDatabase& DB)
+{
+    String SDKDBFilePath = GetSDKDBFilePath();
+
+    // Without a shared SDK database all tags are in the project database
+    if (SDKDBFilePath.IsEmpty() || !FileExists(SDKDBFilePath))
+        return;
+
+    // The SDK database is only written by 'UpdateSDKDB' (of any IDE instance, so we have
+    // to wait for its commits)
+    DB.SetBusyTimeout(kSDKBusyTimeout);
+    DB.Attach(SDKDBFilePath, L"sdk", true);
+
+    // Unify the tags and ancestor closures of both databases under the names used by
+    // the queries (the temporary views hide the ones of the project database)
+    SQLite::TStatement CmdCreateCommonView(
+        DB,
+        L"CREATE TEMP VIEW Common AS "
+            L"SELECT * FROM main.Common "
+            L"UNION ALL "
+            L"SELECT * FROM sdk.Common;"
+        );
+
+    SQLite::TStatement CmdCreateAncestorsView(
+        DB,
+        L"CREATE TEMP VIEW Ancestors AS "
+            L"SELECT * FROM main.Ancestors "
+            L"UNION ALL "
+            L"SELECT * FROM sdk.Ancestors;"
+        );
+
+    CmdCreateCommonView.ExecuteStep();
+    CmdCreateAncestorsView.ExecuteStep();
+}
+//---------------------------------------------------------------------------
+
+void TChBldProjectDB::SplitSDKTags(
+    const Ctags::VTag& Tags,
+    Ctags::VTag& ProjectTags,
+    Ctags::VTag& SDKTags
+    )
+{
+    VString SDKIncludePaths;
+
+    // Begin of interlock
+    {
+        TChBldLockGuard LG(FDBFileMutex);
+
+        // Without a shared SDK database all tags are project tags
+        if (!FSDKDBFilePath.IsEmpty())
+        {
+            foreach_ (const String& SDKIncludePath, FSDKIncludePaths)
+                SDKIncludePaths.push_back(IncludeTrailingPathDelimiter(SDKIncludePath));
+        }
+    }
+    // End of interlock
+
+    // The include path of the last SDK tag (the tags of a file come in a row)
+    String LastFile     = L"";
+    bool LastIsSDKFile  = false;
+
+    foreach_ (const Ctags::TTag& Tag, Tags)
+    {
+        if (Tag.File != LastFile)
+        {
+            LastFile        = Tag.File;
+            LastIsSDKFile   = false;
+
+            foreach_ (const String& SDKIncludePath, SDKIncludePaths)
+            {
+                if (StartsText(SDKIncludePath, Tag.File))
+                {
+                    LastIsSDKFile = true;
+                    break;
+                }
+            }
+        }
+
+        if (LastIsSDKFile)
+            SDKTags.push_back(Tag);
+        else
+            ProjectTags.push_back(Tag);
+    }
+}
+//---------------------------------------------------------------------------
+
+// Adds the tags of the files which are not stored yet to the SDK database (creating or
+// replacing it if required). Returns the written files, the classes whose ancestor closure
+// has been rebuilt and whether the database has been replaced (the files are reported even
+// if building their closures has failed afterwards).
+bool TChBldProjectDB::UpdateSDKDB(
+    const Ctags::VTag& SDKTags,
+    std::set<String>& WrittenFiles,
+    std::set<String>& RefreshedClasses,
+    bool& Replaced
+    )
+{
+    String SDKDBFilePath = GetSDKDBFilePath();
+
+    WrittenFiles.clear();
+    RefreshedClasses.clear();
+    Replaced = false;
+
+    try
+    {
+        bool SDKDBExists = FileExists(SDKDBFilePath);
+
+        // The files which are already in the SDK database
+        std::set<String> StoredFiles;
+
+        if (SDKDBExists)
+        {
+            SQLite::TDatabase DB(SQLite::jmDelete);
+
+            DB.Open(SDKDBFilePath);
+            DB.SetBusyTimeout(kSDKBusyTimeout);
+
+            __try
+            {
+                int SchemaVersion = 0;
+
+                // Get the schema version of the database
+                {
+                    SQLite::TStatement QryGetSchemaVersion(DB, L"PRAGMA user_version;");
+
+                    if (QryGetSchemaVersion.ExecuteStep() == SQLITE_ROW)
+                        SchemaVersion = QryGetSchemaVersion.GetColumnAsInt(0);
+                }
+
+                // Databases of other versions are replaced
+                if (SchemaVersion == kDBSchemaVersion)
+                {
+                    SQLite::TStatement QryGetFiles(DB, L"SELECT Name FROM Files;");
+
+                    while (QryGetFiles.ExecuteStep() != SQLITE_DONE)
+                        StoredFiles.insert(QryGetFiles.GetColumnAsString(0));
+                }
+                else
+                {
+                    SDKDBExists = false;
+                }
+            }
+            __finally
+            {
+                DB.Close();
+            }
+        }
+
+        // The tags of the files which are not stored yet
+        Ctags::VTag NewTags;
+
+        foreach_ (const Ctags::TTag& Tag, SDKTags)
+        {
+            if (StoredFiles.count(Tag.File) == 0)
+                NewTags.push_back(Tag);
+        }
+
+        if (NewTags.empty())
+            return true;
+
+        CS_SEND(L"ProjectDB::UpdateSDKDB(" + String(static_cast<int>(NewTags.size())) + L" new tags)");
+
+        if (!SDKDBExists)
+        {
+            // Build the SDK database in a temporary file (another IDE instance may build
+            // its own at the same time)
+            String TempFilePath = SDKDBFilePath + L"." + String(GetCurrentProcessId()) + L".tmp";
+
+            ForceDirectories(ExtractFilePath(SDKDBFilePath));
+            DeleteFile(TempFilePath);
+
+            try
+            {
+                // No journal is needed as the file is simply thrown away on failure
+                SQLite::TDatabase DB(SQLite::jmOff);
+
+                DB.Open(TempFilePath);
+
+                __try
+                {
+                    WriteTagDB(DB, NewTags, NULL, false);
+                }
+                __finally
+                {
+                    DB.Close();
+                }
+            }
+            catch (...)
+            {
+                DeleteFile(TempFilePath);
+                throw;
+            }
+
+            bool Renamed;
+
+            // Replace the old database, which must not be attached by our readers meanwhile
+            // (if it's used by another IDE instance, it can't be replaced now)
+            // Begin of interlock
+            {
+                TChBldWriteLockGuard WLG(FDBLock);
+
+                if (FileExists(SDKDBFilePath))
+                    DeleteFile(SDKDBFilePath);
+
+                Renamed = RenameFile(TempFilePath, SDKDBFilePath);
+            }
+            // End of interlock
+
+            if (!Renamed)
+            {
+                DeleteFile(TempFilePath);
+                return false;
+            }
+
+            Replaced = true;
+
+            // Report the files whose tags have been written
+            foreach_ (const Ctags::TTag& Tag, NewTags)
+                WrittenFiles.insert(Tag.File);
+        }
+        else
+        {
+            // Add the new files to the existing database
+            SQLite::TDatabase DB(SQLite::jmDelete);
+
+            DB.Open(SDKDBFilePath);
+            DB.SetBusyTimeout(kSDKBusyTimeout);
+
+            __try
+            {
+                SQLite::TStatement CmdInsertTag(DB, kInsertTagStatement);
+                SQLite::TStatement CmdAddFile(DB, kAddSDKFileStatement);
+
+                // The new tags grouped by file
+                std::map<String, std::vector<const Ctags::TTag*> > NewFiles;
+
+                foreach_ (const Ctags::TTag& Tag, NewTags)
+                    NewFiles[Tag.File].push_back(&Tag);
+
+                // The classes of the added files
+                std::set<String> NewClasses;
+
+                // The files added by this transaction
+                std::set<String> AddedFiles;
+
+                try
+                {
+                    // Begin transaction
+                    DB.BeginTransaction();
+
+                    std::pair<String, std::vector<const Ctags::TTag*> > NewFile;
+
+                    foreach_ (NewFile, NewFiles)
+                    {
+                        String FileID = Environment::CreateGuidString(true);
+
+                        BindFile(CmdAddFile, FileID, NewFile.first, NULL);
+                        CmdAddFile.ExecuteStep();
+                        CmdAddFile.Reset();
+
+                        // Another IDE instance may have added the file since we've read the
+                        // stored files, its tags are only written along with a new record
+                        if (DB.GetChanges() == 0)
+                            continue;
+
+                        AddedFiles.insert(NewFile.first);
+
+                        foreach_ (const Ctags::TTag* Tag, NewFile.second)
+                        {
+                            BindTag(CmdInsertTag, *Tag, FileID);
+                            CmdInsertTag.ExecuteStep();
+                            CmdInsertTag.Reset();
+
+                            if ((Tag->Kind == L"class") || (Tag->Kind == L"struct"))
+                                NewClasses.insert(Tag->QualifiedName);
+                        }
+                    }
+
+                    // Commit transaction
+                    DB.CommitTransaction();
+                }
+                catch (...)
+                {
+                    // On exception, rollback transaction
+                    DB.RollbackTransaction();
+
+                    throw;
+                }
+
+                // Report the files whose tags have been written
+                WrittenFiles.swap(AddedFiles);
+
+                // Build the closures of the new classes
+                RefreshAncestors(DB, &NewClasses, &RefreshedClasses);
+            }
+            __finally
+            {
+                DB.Close();
+            }
+        }
+    }
+    catch (Exception& E)
+    {
+        CS_SEND(L"ProjectDB::UpdateSDKDB(Failed: " + E.Message + L")");
+
+        return false;
+    }
+
+    return true;
+}
+//---------------------------------------------------------------------------
+
+String TChBldProjectDB::GetTagKey(const Ctags::TTag& Tag)
+{
+    // The kind, scope, name and signature identify a tag within its file, independent
+    // of its position (the fields are tab-separated by ctags, so there are no tabs inside)
+    return
+        Tag.Kind
+        + L"\t" + Tag.Namespace
+        + L"\t" + Tag.Class
+        + L"\t" + Tag.Struct
+        + L"\t" + Tag.Name
+        + L"\t" + Tag.Signature;
+}
+//---------------------------------------------------------------------------
+
+bool TChBldProjectDB::HasSameTagAttributes(const Ctags::TTag& Tag, const Ctags::TTag& OtherTag)
+{
+    return
+        (Tag.QualifiedName      == OtherTag.QualifiedName)
+        && (Tag.Address         == OtherTag.Address)
+        && (Tag.LineNo          == OtherTag.LineNo)
+        && (Tag.Access          == OtherTag.Access)
+        && (Tag.Implementation  == OtherTag.Implementation)
+        && (Tag.Typeref_A       == OtherTag.Typeref_A)
+        && (Tag.Typeref_B       == OtherTag.Typeref_B)
+        && (Tag.Inherits        == OtherTag.Inherits);
+}
+//---------------------------------------------------------------------------
+
+void TChBldProjectDB::RefreshAncestors(
+    SQLite::TDatabase& DB,
+    const std::set<String>* ChangedClasses,
+    std::set<String>* RefreshedClasses
+    )
+{
+    CS_SEND(L"ProjectDB::RefreshAncestors(Begin)");
+    unsigned int StartTicks = GetTickCount();
+
+    // The raw (unresolved) 'Inherits' entries of each class/struct
+    std::map<String, VString> ClassInherits;
+
+    // The qualified names of each class/struct, looked up by its unqualified name
+    std::map<String, VString> ClassesByName;
+
+    // Get all classes/structs with their inheritance (including the ones of the SDK
+    // database if it's attached)
+    SQLite::TStatement QryGetClasses(
+        DB,
+        L"SELECT QualifiedName, TagName, Inherits FROM Common "
+        L"WHERE (Kind = 'class') OR (Kind = 'struct');"
+        );
+
+    while (QryGetClasses.ExecuteStep() != SQLITE_DONE)
+    {
+        String QualifiedName    = QryGetClasses.GetColumnAsString(0);
+        String Inherits         = QryGetClasses.GetColumnAsString(2);
+
+        // The same class may be found more than once (e.g. in different files), so we
+        // only register it once...
+        if (ClassInherits.count(QualifiedName) == 0)
+        {
+            ClassInherits[QualifiedName] = VString();
+            ClassesByName[QryGetClasses.GetColumnAsString(1)].push_back(QualifiedName);
+        }
+
+        // ...but take the first non-empty inheritance we get for it
+        if (ClassInherits[QualifiedName].empty() && !Inherits.IsEmpty())
+            ClassInherits[QualifiedName] = Environment::SplitCtagsObjectAncestors(Inherits);
+    }
+
+    // Determine the classes/structs whose closure has to be (re)built
+    std::set<String> AffectedClasses;
+
+    if (!ChangedClasses)
+    {
+        // On a deep refresh every class of this database is affected (the ones of the
+        // SDK database have their own closures)
+        SQLite::TStatement QryGetOwnClasses(
+            DB,
+            L"SELECT DISTINCT QualifiedName FROM main.Tags "
+            L"WHERE (Kind = 'class') OR (Kind = 'struct');"
+            );
+
+        while (QryGetOwnClasses.ExecuteStep() != SQLITE_DONE)
+            AffectedClasses.insert(QryGetOwnClasses.GetColumnAsString(0));
+    }
+    else
+    {
+        // The changed classes themselves are affected...
+        AffectedClasses = *ChangedClasses;
+
+        // ...as well as each class which is derived from one of them (the class name is
+        // bound, as it's taken from the sources)...
+        SQLite::TStatement QryGetDerivedClasses(
+            DB,
+            L"SELECT DISTINCT Class FROM main.Ancestors "
+            L"WHERE Ancestor = ?1;"
+            );
+
+        foreach_ (const String& ChangedClass, *ChangedClasses)
+        {
+            QryGetDerivedClasses.BindString(1, ChangedClass);
+
+            while (QryGetDerivedClasses.ExecuteStep() != SQLITE_DONE)
+                AffectedClasses.insert(QryGetDerivedClasses.GetColumnAsString(0));
+
+            QryGetDerivedClasses.Reset();
+        }
+
+        // ...and each class which has no closure yet (e.g. from a newly included header)
+        SQLite::TStatement QryGetNewClasses(
+            DB,
+            L"SELECT DISTINCT QualifiedName FROM main.Tags "
+            L"WHERE ((Kind = 'class') OR (Kind = 'struct')) "
+            L"AND QualifiedName NOT IN (SELECT Class FROM main.Ancestors);"
+            );
+
+        while (QryGetNewClasses.ExecuteStep() != SQLITE_DONE)
+            AffectedClasses.insert(QryGetNewClasses.GetColumnAsString(0));
+    }
+
+    SQLite::TStatement CmdDeleteClosure(
+        DB,
+        L"DELETE FROM main.Ancestors WHERE Class = ?1;"
+        );
+
+    SQLite::TStatement CmdInsertClosure(
+        DB,
+        L"INSERT INTO main.Ancestors(Class, ClassName, Ancestor, Depth) "
+        L"VALUES(?1, ?2, ?3, ?4);"
+        );
+
+    // The resolved direct ancestors of each class (filled on demand)
+    std::map<String, VString> DirectAncestors;
+
+    int ClosureRows = 0;
+
+    try
+    {
+        // Begin transaction
+        DB.BeginTransaction();
+
+        foreach_ (const String& AffectedClass, AffectedClasses)
+        {
+            // Remove the old closure of the class
+            if (ChangedClasses)
+            {
+                CmdDeleteClosure.BindString(1, AffectedClass);
+                CmdDeleteClosure.ExecuteStep();
+                CmdDeleteClosure.Reset();
+            }
+
+            // Deleted classes don't get a new closure
+            if (ClassInherits.count(AffectedClass) == 0)
+                continue;
+
+            String ClassName = Environment::ExtractToken(AffectedClass);
+
+            std::vector<std::pair<String, int> >    Queue;
+            std::set<String>                        Visited;
+
+            // The class is its own ancestor with depth 0, so its own members are found
+            // by the same join as the inherited ones
+            Queue.push_back(std::make_pair(AffectedClass, 0));
+            Visited.insert(AffectedClass);
+
+            // Walk breadth-first along the inheritance graph
+            for (std::size_t i = 0; i < Queue.size(); ++i)
+            {
+                String  Current = Queue[i].first;
+                int     Depth   = Queue[i].second;
+
+                CmdInsertClosure.BindString(1, AffectedClass);
+                CmdInsertClosure.BindString(2, ClassName);
+                CmdInsertClosure.BindString(3, Current);
+                CmdInsertClosure.BindInt(   4, Depth);
+                CmdInsertClosure.ExecuteStep();
+                CmdInsertClosure.Reset();
+
+                ++ClosureRows;
+
+                // Unresolved ancestors (e.g. from headers which were not parsed) end here
+                if (ClassInherits.count(Current) == 0)
+                    continue;
+
+                // Resolve the direct ancestors of the current class if not done yet
+                if (DirectAncestors.count(Current) == 0)
+                {
+                    VString &Resolved = DirectAncestors[Current];
+
+                    foreach_ (const String& Ancestor, ClassInherits[Current])
+                        Resolved.push_back(ResolveAncestor(Ancestor, Current, ClassesByName));
+                }
+
+                foreach_ (const String& Ancestor, DirectAncestors[Current])
+                {
+                    // Protect against cyclic or diamond-shaped inheritance
+                    if (Visited.insert(Ancestor).second)
+                        Queue.push_back(std::make_pair(Ancestor, Depth + 1));
+                }
+            }
+        }
+
+        // Commit transaction
+        DB.CommitTransaction();
+    }
+    catch (Exception& E)
+    {
+        // On exception, rollback transaction
+        DB.RollbackTransaction();
+
+        // Throw E again
+        //throw Exception(E.Message);   // Don't throw here: If it doesn't work
+                                        // maybe there's an active code completion
+                                        // running
+    }
+    catch (...)
+    {
+        // On exception, rollback transaction
+        DB.RollbackTransaction();
+
+        // Throw Exception again
+        //throw Exception(L"Unknown exception");    // Don't throw here: If it doesn't work
+                                                    // maybe there's an active code completion
+                                                    // running
+    }
+
+    // Report the classes whose closure has been rebuilt (or removed)
+    if (RefreshedClasses)
+        RefreshedClasses->insert(AffectedClasses.begin(), AffectedClasses.end());
+
+    CS_SEND(
+        L"ProjectDB::RefreshAncestors(End, "
+            + String(static_cast<int>(AffectedClasses.size()))
+            + L" classes, "
+            + String(ClosureRows)
+            + L" rows, "
+            + String(GetTickCount() - StartTicks)
+            + L")"
+        );
+}
+//---------------------------------------------------------------------------
+
+String TChBldProjectDB::ResolveAncestor(
+    const String& Ancestor,
+    const String& Derived,
+    const std::map<String, VString>& ClassesByName
+    )
+{
+    String Name = Ancestor.Trim();
+
+    // Cut off template arguments as they are not part of the class tag names
+    if (Name.Pos(L"<") > 0)
+        Name = Name.SubString(1, Name.Pos(L"<") - 1).Trim();
+
+    // Cut off a leading global scope operator
+    if (LeftStr(Name, 2) == L"::")
+        Name = Name.SubString(3, Name.Length() - 2);
+
+    std::map<String, VString>::const_iterator Candidates =
+        ClassesByName.find(Environment::ExtractToken(Name));
+
+    // If there is no class with that name we keep it unresolved
+    if (Candidates == ClassesByName.end())
+        return Name;
+
+    // Try to find the ancestor within the enclosing scopes of the derived class, from the
+    // innermost to the global one, just as the compiler would do
+    String Scope = Derived;
+
+    while (true)
+    {
+        int ScopeEnd = 0;
+
+        for (int i = Scope.Length() - 1; i > 0; --i)
+        {
+            if ((Scope[i] == L':') && (Scope[i+1] == L':'))
+            {
+                ScopeEnd = i;
+                break;
+            }
+        }
+
+        Scope = (ScopeEnd > 0) ? Scope.SubString(1, ScopeEnd - 1) : String(L"");
+
+        String QualifiedName = Scope.IsEmpty() ? Name : Scope + L"::" + Name;
+
+        foreach_ (const String& Candidate, Candidates->second)
+        {
+            if ((Candidate == QualifiedName) && (Candidate != Derived))
+                return Candidate;
+        }
+
+        if (Scope.IsEmpty())
+            break;
+    }
+
+    // Otherwise take the first class ending with the (maybe partially qualified) name
+    foreach_ (const String& Candidate, Candidates->second)
+    {
+        if (Candidate == Derived)
+            continue;
+
+        if ((Candidate == Name) || (RightStr(Candidate, Name.Length() + 2) == L"::" + Name))
+            return Candidate;
+    }
+
+    return Name;
+}
+//---------------------------------------------------------------------------
+
+void TChBldProjectDB::SetProjectPath(const String& AProjectPath)
+{
+    SetProjectContext(AProjectPath, FVariant);
+}
+//---------------------------------------------------------------------------
+
+void TChBldProjectDB::SetProjectContext(const String& AProjectPath, const String& AVariant)
+{
+    CS_SEND(L"ProjectDB::SetProjectContext(" + AProjectPath + L", " + AVariant + L")");
+
+    // If the project path or the build variant has REALLY changed
+    if ((AProjectPath != FProjectPath) || (AVariant != FVariant))
+    {
+        if (!AProjectPath.IsEmpty())
+        {
+            // Assign the project path and the variant
+            // Begin of interlock
+            {
+                TChBldLockGuard LG(FDBFileMutex);
+
+                FProjectPath    = AProjectPath;
+                FVariant        = AVariant;
+            }
+            // End of interlock
+
+            // Change the DB context to the new project (or the other variant database of it)
+            ChangeProjectContext();
+        }
+    }
+}
+//---------------------------------------------------------------------------
+
+void TChBldProjectDB::ChangeProjectContext()
+{
+    CS_SEND(L"ProjectDB::ChangeProjectContext");
+
+    // Get exclusive access to the DB as we're changing its schema
+    TChBldWriteLockGuard LG(FDBLock);
+
+    SQLite::TDatabase DB(SQLite::jmWal);
+
+    // Create the sub-directory '__chbld' if it does not exist
+    CreateWorkingDirIfRequired();
+
+    // Continue with the newest complete database generation of the project...
+    int Generation = FindDBGeneration();
+
+    // Begin of interlock
+    {
+        TChBldLockGuard LG(FDBFileMutex);
+
+        FDBGeneration = Generation;
+    }
+    // End of interlock
+
+    // ...and remove the older ones as well as aborted shadow databases
+    DeleteOldDBFiles();
+
+    // Keep only the databases of the recently used variants
+    PruneDBVariants();
+
+    // Create/open current project database
+    DB.Open(GetDBFilePath());
+
+    __try
+    {
+        int SchemaVersion = 0;
+
+        // Get the schema version of the database (0 for a new one)
+        {
+            SQLite::TStatement QryGetSchemaVersion(DB, L"PRAGMA user_version;");
+
+            if (QryGetSchemaVersion.ExecuteStep() == SQLITE_ROW)
+                SchemaVersion = QryGetSchemaVersion.GetColumnAsInt(0);
+        }
+
+        // Create the tables and views (if non existent)
+        CreateTables(DB);
+
+        // Add the columns which are missing in databases of older versions
+        MigrateTables(DB);
+
+        // Create the indexes (if non existent)
+        CreateIndexes(DB);
+
+        int FileCount       = 0;
+        int AncestorCount   = 0;
+
+        // Get the number of files and ancestor closure rows
+        {
+            SQLite::TStatement QryGetFileCount(DB, L"SELECT COUNT(*) FROM Files;");
+            SQLite::TStatement QryGetAncestorCount(DB, L"SELECT COUNT(*) FROM Ancestors;");
+
+            if (QryGetFileCount.ExecuteStep() == SQLITE_ROW)
+                FileCount = QryGetFileCount.GetColumnAsInt(0);
+
+            if (QryGetAncestorCount.ExecuteStep() == SQLITE_ROW)
+                AncestorCount = QryGetAncestorCount.GetColumnAsInt(0);
+        }
+
+        // The content is kept across the sessions, so only the stale files have to be
+        // re-tagged - unless the database is empty or of another version, which requires a
+        // rebuild (in the meantime the old content keeps serving the readers)
+        FRequiresRebuild = (FileCount == 0) || (SchemaVersion != kDBSchemaVersion);
+
+        // Make the tags of the shared SDK database available
+        AttachSDKDB(DB);
+
+        // Databases of older versions may have no ancestor closure yet
+        if ((FileCount > 0) && (AncestorCount == 0))
+            RefreshAncestors(DB, NULL);
+
+        // The symbol index of the old context is dropped, the one of the new context is
+        // loaded by the analyzer thread (see 'LoadSymbolIndex')
+        PublishSymbolIndex(TChBldSymbolIndexPtr(new TChBldSymbolIndex));
+
+        // Begin of interlock
+        {
+            TChBldLockGuard LG(FDBFileMutex);
+
+            FSymbolIndexStale = true;
+        }
+        // End of interlock
+
+        CS_SEND(
+            L"ProjectDB::ChangeProjectContext(Version: "
+                + String(SchemaVersion)
+                + L", Files: "
+                + String(FileCount)
+                + L", RequiresRebuild: "
+                + String((int)FRequiresRebuild)
+                + L")"
+            );
+    }
+    __finally
+    {
+        // Close the connection to database
+        DB.Close();
+    }
+}
+//---------------------------------------------------------------------------
+
+void TChBldProjectDB::CreateTables(SQLite::TDatabase& DB)
+{
+    // Create table 'Tags' (if non existent)
+    SQLite::TStatement CmdAddTableTags(
+        DB,
+        L"CREATE TABLE IF NOT EXISTS Tags("
+            L"ID                INTEGER NOT NULL PRIMARY KEY AUTOINCREMENT,"
+            L"Name              TEXT    NOT NULL,"
+            L"QualifiedName     TEXT    NOT NULL,"
+            L"FileID            TEXT    NOT NULL,"
+            L"Address           TEXT    NOT NULL,"
+            L"Kind              TEXT    NOT NULL,"
+            L"LineNo            INT,"
+            L"Namespace         TEXT,"
+            L"Class             TEXT,"
+            L"Struct            TEXT,"
+            L"Access            TEXT,"
+            L"Implementation    TEXT,"
+            L"Signature         TEXT,"
+            L"Typeref_A         TEXT,"
+            L"Typeref_B         TEXT,"
+            L"Inherits          TEXT"
+            L");"
+        );
+
+    // Create table 'Files' (if non existent)
+    SQLite::TStatement CmdAddTableFiles(
+        DB,
+        L"CREATE TABLE IF NOT EXISTS Files("
+            L"ID        TEXT    NOT NULL PRIMARY KEY,"
+            L"Name      TEXT    NOT NULL UNIQUE,"
+            L"MTime     INTEGER,"
+            L"Size      INTEGER,"
+            L"Hash      TEXT"
+            L");"
+        );
+
+    // Create table 'Ancestors' (if non existent) which holds the inheritance
+    // closure of each class/struct (including the class itself with depth 0)
+    SQLite::TStatement CmdAddTableAncestors(
+        DB,
+        L"CREATE TABLE IF NOT EXISTS Ancestors("
+            L"Class     TEXT    NOT NULL,"
+            L"ClassName TEXT    NOT NULL,"
+            L"Ancestor  TEXT    NOT NULL,"
+            L"Depth     INT     NOT NULL"
+            L");"
+        );
+
+    // Create view 'Common' (if non existent)
+    SQLite::TStatement CmdAddViewCommon(
+        DB,
+        L"CREATE VIEW IF NOT EXISTS Common AS "
+            L"SELECT "
+                L"Tags.ID AS ID,"
+                L"Tags.Name AS TagName,"
+                L"Tags.QualifiedName AS QualifiedName,"
+                L"Files.Name AS FileName,"
+                L"Tags.Address AS Address,"
+                L"Tags.Kind AS Kind,"
+                L"Tags.LineNo AS LineNo,"
+                L"Tags.Namespace AS Namespace,"
+                L"Tags.Class AS Class,"
+                L"Tags.Struct AS Struct,"
+                L"Tags.Access AS Access,"
+                L"Tags.Implementation AS Implementation,"
+                L"Tags.Signature AS Signature,"
+                L"Tags.Typeref_A AS Typeref_A,"
+                L"Tags.Typeref_B AS Typeref_B,"
+                L"Tags.Inherits AS Inherits "
+            L"FROM "
+                L"Tags "
+            L"INNER JOIN "
+                L"Files ON Files.ID = Tags.FileID"
+        L";"
+        );
+
+    try
+    {
+        // Begin transaction
+        DB.BeginTransaction();
+
+        // Run command 'AddTableTags'
+        CmdAddTableTags.ExecuteStep();
+
+        // Run command 'AddTableFiles'
+        CmdAddTableFiles.ExecuteStep();
+
+        // Run command 'AddTableAncestors'
+        CmdAddTableAncestors.ExecuteStep();
+
+        // Run command 'AddViewCommon'
+        CmdAddViewCommon.ExecuteStep();
+
+        // Commit transaction
+        DB.CommitTransaction();
+    }
+    catch (Exception& E)
+    {
+        // On exception, rollback transaction
+        DB.RollbackTransaction();
+
+        // Throw E again
+        throw Exception(E.Message);
+    }
+    catch (...)
+    {
+        // On exception, rollback transaction
+        DB.RollbackTransaction();
+
+        // Throw Exception again
+        throw Exception(L"Unknown exception");
+    }
+}
+//---------------------------------------------------------------------------
+
+void TChBldProjectDB::MigrateTables(SQLite::TDatabase& DB)
+{
+    std::set<String> FileColumns;
+
+    // Get the current columns of table 'Files'
+    {
+        SQLite::TStatement QryGetFileColumns(DB, L"PRAGMA table_info(Files);");
+
+        while (QryGetFileColumns.ExecuteStep() != SQLITE_DONE)
+            FileColumns.insert(QryGetFileColumns.GetColumnAsString(1));
+    }
+
+    // Add the file stamp columns (the stamps of the existing records stay empty, which
+    // makes those files stale)
+    if (FileColumns.count(L"MTime") == 0)
+    {
+        SQLite::TStatement CmdAddColumn(DB, L"ALTER TABLE Files ADD COLUMN MTime INTEGER;");
+        CmdAddColumn.ExecuteStep();
+    }
+
+    if (FileColumns.count(L"Size") == 0)
+    {
+        SQLite::TStatement CmdAddColumn(DB, L"ALTER TABLE Files ADD COLUMN Size INTEGER;");
+        CmdAddColumn.ExecuteStep();
+    }
+
+    if (FileColumns.count(L"Hash") == 0)
+    {
+        SQLite::TStatement CmdAddColumn(DB, L"ALTER TABLE Files ADD COLUMN Hash TEXT;");
+        CmdAddColumn.ExecuteStep();
+    }
+}
+//---------------------------------------------------------------------------
+
+void TChBldProjectDB::CreateIndexes(SQLite::TDatabase& DB)
+{
+    // Create unique index for table 'Tags'
+    SQLite::TStatement CmdAddUniqueIndexTags(
+        DB,
+        L"CREATE UNIQUE INDEX IF NOT EXISTS UniqueIndex "
+        L"ON Tags ("
+            L"Name,"
+            L"QualifiedName,"
+            L"FileID,"
+            L"Address,"
+            L"Kind,"
+            L"LineNo,"
+            L"Namespace,"
+            L"Class,"
+            L"Struct,"
+            L"Access,"
+            L"Implementation,"
+            L"Signature,"
+            L"Typeref_A,"
+            L"Typeref_B,"
+            L"Inherits"
+            L");"
+        );
+
+    // Create the indexes used by the member completion join
+    SQLite::TStatement CmdAddIndexTagsClass(
+        DB,
+        L"CREATE INDEX IF NOT EXISTS TagsClassIndex ON Tags (Class);"
+        );
+
+    SQLite::TStatement CmdAddIndexTagsStruct(
+        DB,
+        L"CREATE INDEX IF NOT EXISTS TagsStructIndex ON Tags (Struct);"
+        );
+
+    SQLite::TStatement CmdAddIndexAncestorsClass(
+        DB,
+        L"CREATE INDEX IF NOT EXISTS AncestorsClassIndex ON Ancestors (Class);"
+        );
+
+    SQLite::TStatement CmdAddIndexAncestorsClassName(
+        DB,
+        L"CREATE INDEX IF NOT EXISTS AncestorsClassNameIndex ON Ancestors (ClassName);"
+        );
+
+    SQLite::TStatement CmdAddIndexAncestorsAncestor(
+        DB,
+        L"CREATE INDEX IF NOT EXISTS AncestorsAncestorIndex ON Ancestors (Ancestor);"
+        );
+
+    try
+    {
+        // Begin transaction
+        DB.BeginTransaction();
+
+        // Run command 'AddUniqueIndexTags'
+        CmdAddUniqueIndexTags.ExecuteStep();
+
+        // Run the commands adding the member completion indexes
+        CmdAddIndexTagsClass.ExecuteStep();
+        CmdAddIndexTagsStruct.ExecuteStep();
+        CmdAddIndexAncestorsClass.ExecuteStep();
+        CmdAddIndexAncestorsClassName.ExecuteStep();
+        CmdAddIndexAncestorsAncestor.ExecuteStep();
+
+        // Commit transaction
+        DB.CommitTransaction();
+    }
+    catch (Exception& E)
+    {
+        // On exception, rollback transaction
+        DB.RollbackTransaction();
+
+        // Throw E again
+        throw Exception(E.Message);
+    }
+    catch (...)
+    {
+        // On exception, rollback transaction
+        DB.RollbackTransaction();
+
+        // Throw Exception again
+        throw Exception(L"Unknown exception");
     }
 }
 //---------------------------------------------------------------------------
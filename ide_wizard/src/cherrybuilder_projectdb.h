@@ -31,15 +31,51 @@
 
 #include <vector>
 #include <map>
+#include <set>
 
 #include "cherrybuilder_environment.h"
 #include "cherrybuilder_sqlite.h"
 #include "cherrybuilder_ctags.h"
+#include "cherrybuilder_symbolindex.h"
+#include "cherrybuilder_querycache.h"
+#include "cherrybuilder_queryprofiler.h"
 //---------------------------------------------------------------------------
 
 namespace Cherrybuilder
 {
 
+// The number of tag rows touched by the last refresh
+struct TChBldRefreshStats
+{
+    int             Inserted;
+    int             Updated;
+    int             Deleted;
+    int             Unchanged;
+    int             Chunks;
+    unsigned int    Duration;
+};
+//---------------------------------------------------------------------------
+
+// The usage of the query result cache
+struct TChBldQueryCacheStats
+{
+    unsigned int    Hits;
+    unsigned int    Misses;
+    unsigned int    Generation;
+};
+//---------------------------------------------------------------------------
+
+// A small handle to a tag: Enough to show it in the editor and to find its counterpart
+// (header <-> implementation)
+struct TChBldTagLocation
+{
+    String  Name;
+    String  Signature;
+    String  File;
+    int     LineNo;
+};
+//---------------------------------------------------------------------------
+
 class TChBldProjectDB
 {
 public:
@@ -53,7 +89,12 @@ public:
         const std::map<String, String>* ChangedContentFiles=NULL
         );
 
-    void GetMatchingIdentifierList(const String& Query, Ctags::VTag& List, bool ClearList=true);
+    void GetMatchingIdentifierList(
+        const String& Query,
+        Ctags::VTag& List,
+        bool ClearList=true,
+        TChBldSymbolKeys* Keys=NULL
+        );
 
     void GetPosNamespaces(
         const String& FileName, const int Line, const int Column, VString& Namespaces
@@ -65,26 +106,184 @@ public:
 
     Ctags::TTag GetPosSymbol(const String& SymbolText);
 
-    Ctags::TTag GetPosImplementation(const String& FileName, const int Line, const int Column);
-    Ctags::TTag GetPosHeader(const String& FileName, const int Line, const int Column);
+    void FindSymbols(const String& Query, Ctags::VTag& List, int MaxResults=100);
+
+    TChBldTagLocation GetPosImplementation(const String& FileName, const int Line, const int Column);
+    TChBldTagLocation GetPosHeader(const String& FileName, const int Line, const int Column);
 
-    Ctags::TTag GetPosHeaderTarget(Ctags::TTag& Symbol);
-    Ctags::TTag GetPosImplementationTarget(Ctags::TTag& Symbol);
+    TChBldTagLocation GetPosHeaderTarget(const TChBldTagLocation& Symbol);
+    TChBldTagLocation GetPosImplementationTarget(const TChBldTagLocation& Symbol);
+
+    void GetStaleFiles(
+        const std::map<String, String>& ContentFiles,
+        std::map<String, String>& StaleFiles,
+        const VString* ProjectFiles=NULL
+        );
+
+    void SetProjectContext(const String& AProjectPath, const String& AVariant);
+
+    void SetSDK(const String& SDKDBFilePath, const VString& SDKIncludePaths);
+
+    void LoadSymbolIndex();
+
+    TChBldSymbolIndexPtr GetSymbolIndex();
+
+    TChBldQueryCacheStats GetQueryCacheStats();
+
+    void RegisterLockWait(unsigned int WaitTime);
+
+    void Maintain();
 
     __property String ProjectPath = {read=FProjectPath, write=SetProjectPath};
-    __property TMutex* UpdateMutex = {read= FUpdateMutex};
+    __property String Variant = {read=FVariant};
+    __property int MaxDBVariants = {read=FMaxDBVariants, write=FMaxDBVariants};
+    __property TMultiReadExclusiveWriteSynchronizer* DBLock = {read=FDBLock};
+    __property TChBldRefreshStats LastRefreshStats = {read=FLastRefreshStats};
+    __property int WriteChunkRows = {read=FWriteChunkRows, write=FWriteChunkRows};
+    __property int WriteChunkTime = {read=FWriteChunkTime, write=FWriteChunkTime};
+    __property unsigned int MaxLockWait = {read=FMaxLockWait};
+    __property int CheckpointRows = {read=FCheckpointRows, write=FCheckpointRows};
+    __property unsigned int AnalyzeInterval = {read=FAnalyzeInterval, write=FAnalyzeInterval};
+    __property bool RequiresRebuild = {read=FRequiresRebuild};
+    __property TChBldQueryProfiler* QueryProfiler = {read=GetQueryProfiler};
 
 private:
 
     void CreateWorkingDirIfRequired();
 
+    void ProfileDB(SQLite::TDatabase& DB, const String& Method);
+    TChBldQueryProfiler* GetQueryProfiler();
+
+    String GetDBFolder();
+    String GetDBFilePath();
+    String GetDBFilePath(int Generation);
+    int FindDBGeneration();
+    void DeleteOldDBFiles();
+    void PruneDBVariants();
+
+    void CreateTables(SQLite::TDatabase& DB);
+    void MigrateTables(SQLite::TDatabase& DB);
+    void CreateIndexes(SQLite::TDatabase& DB);
+
+    static int GetPragmaValue(SQLite::TDatabase& DB, const String& Pragma);
+
+    static void ReadTagLocation(SQLite::TStatement& Query, TChBldTagLocation& Location);
+
+    static void BindTag(SQLite::TStatement& Statement, const Ctags::TTag& Tag, const String& FileID);
+
+    static String GetContentFileName(
+        const String& FileName,
+        const std::map<String, String>* ContentFiles
+        );
+
+    static void BindFile(
+        SQLite::TStatement& Statement,
+        const String& FileID,
+        const String& FileName,
+        const std::map<String, String>* ContentFiles
+        );
+
+    void WriteTagDB(
+        SQLite::TDatabase& DB,
+        const Ctags::VTag& Tags,
+        const std::map<String, String>* ContentFiles,
+        bool WithSDK
+        );
+
+    String GetSDKDBFilePath();
+    void AttachSDKDB(SQLite::TDatabase& DB);
+    void SplitSDKTags(const Ctags::VTag& Tags, Ctags::VTag& ProjectTags, Ctags::VTag& SDKTags);
+    bool UpdateSDKDB(
+        const Ctags::VTag& SDKTags,
+        std::set<String>& WrittenFiles,
+        std::set<String>& RefreshedClasses,
+        bool& Replaced
+        );
+
+    void RebuildShadowDB(
+        const Ctags::VTag& Tags,
+        const std::map<String, String>* ContentFiles,
+        TChBldRefreshStats& Stats
+        );
+
+    void RefreshAncestors(
+        SQLite::TDatabase& DB,
+        const std::set<String>* ChangedClasses,
+        std::set<String>* RefreshedClasses=NULL
+        );
+
+    void PublishSymbolIndex(const TChBldSymbolIndexPtr& SymbolIndex);
+
+    void InvalidateQueryCache();
+    String GetQueryCacheKey(const String& QueryKind, const String& Arguments);
+
+    static String GetTagKey(const Ctags::TTag& Tag);
+    static bool HasSameTagAttributes(const Ctags::TTag& Tag, const Ctags::TTag& OtherTag);
+
+    static String ResolveAncestor(
+        const String& Ancestor,
+        const String& Derived,
+        const std::map<String, VString>& ClassesByName
+        );
+
     void SetProjectPath(const String& AProjectPath);
 
     void ChangeProjectContext();
 
     String FProjectPath;
 
+    // The build variant (platform, compiler family and defines) selecting the database
+    String FVariant;
+
     TMutex *FUpdateMutex;
+    TMultiReadExclusiveWriteSynchronizer *FDBLock;
+    TMutex *FDBFileMutex;
+
+    int FDBGeneration;
+
+    // The number of variant databases kept in the project (the least recently used ones
+    // are deleted)
+    int FMaxDBVariants;
+
+    // The shared database with the tags of the IDE include paths (guarded by 'FDBFileMutex')
+    String FSDKDBFilePath;
+    VString FSDKIncludePaths;
+
+    int FWriteChunkRows;
+    int FWriteChunkTime;
+
+    unsigned int FMaxLockWait;
+
+    // The maintenance settings and the rows written since the last checkpoint and
+    // statistics update (only accessed by the writing thread)
+    int FCheckpointRows;
+    unsigned int FAnalyzeInterval;
+    unsigned int FPendingRows;
+    unsigned int FRowsSinceAnalyze;
+    unsigned int FLastAnalyze;
+
+    bool FRequiresRebuild;
+
+    TChBldRefreshStats FLastRefreshStats;
+
+    // The in-memory image of the database serving the completion lookups
+    // (only accessed via 'GetSymbolIndex' and 'PublishSymbolIndex')
+    TChBldSymbolIndexPtr FSymbolIndex;
+
+    // Whether the project context or the SDK has changed since the symbol index has been
+    // loaded by 'LoadSymbolIndex' (guarded by 'FDBFileMutex')
+    bool FSymbolIndexStale;
+
+    // The cached query results are keyed by the generation of the database content, which
+    // is increased by each commit (so outdated results are never found again)
+    TMutex *FQueryCacheMutex;
+    unsigned int FQueryGeneration;
+
+    TChBldQueryCache<Ctags::VTag> FTagListCache;
+    TChBldQueryCache<VString> FStringListCache;
+
+    // Records the statements of the DB methods (if enabled)
+    TChBldQueryProfiler FQueryProfiler;
 };
 //---------------------------------------------------------------------------
 
@@ -0,0 +1,124 @@
+﻿/* ===============================================================================
+ * CherryBuilder - The Productivity Extension for C++Builder®
+ * ===============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2017 Florian Koch <flko@mail.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ===============================================================================
+ */
+
+#ifndef cherrybuilder_querycacheH
+#define cherrybuilder_querycacheH
+//---------------------------------------------------------------------------
+
+#include <list>
+#include <unordered_map>
+
+#include "cherrybuilder_symbolindex.h"
+//---------------------------------------------------------------------------
+
+namespace Cherrybuilder
+{
+
+// A bounded cache of query results which drops the least recently used entry when it's
+// full. It's not thread-safe, so the owner has to serialize the access.
+template <class TValue>
+class TChBldQueryCache
+{
+public:
+    TChBldQueryCache(std::size_t ACapacity)
+        :   FCapacity(ACapacity),
+            FHits(0),
+            FMisses(0)
+    {
+        //
+    }
+
+    bool Find(const String& Key, TValue& Value)
+    {
+        typename TEntryMap::iterator Entry = FEntryMap.find(Key);
+
+        if (Entry == FEntryMap.end())
+        {
+            ++FMisses;
+            return false;
+        }
+
+        // Move the entry to the front as it's the most recently used one now
+        FEntries.splice(FEntries.begin(), FEntries, Entry->second);
+
+        Value = Entry->second->second;
+
+        ++FHits;
+        return true;
+    }
+
+    void Add(const String& Key, const TValue& Value)
+    {
+        typename TEntryMap::iterator Entry = FEntryMap.find(Key);
+
+        // Replace an existing entry...
+        if (Entry != FEntryMap.end())
+        {
+            Entry->second->second = Value;
+            FEntries.splice(FEntries.begin(), FEntries, Entry->second);
+
+            return;
+        }
+
+        // ...or add a new one and drop the least recently used one if the cache is full
+        FEntries.push_front(std::make_pair(Key, Value));
+        FEntryMap[Key] = FEntries.begin();
+
+        if (FEntries.size() > FCapacity)
+        {
+            FEntryMap.erase(FEntries.back().first);
+            FEntries.pop_back();
+        }
+    }
+
+    void Clear()
+    {
+        FEntries.clear();
+        FEntryMap.clear();
+    }
+
+    __property unsigned int Hits = {read=FHits};
+    __property unsigned int Misses = {read=FMisses};
+
+private:
+    typedef std::list<std::pair<String, TValue> > TEntryList;
+    typedef std::unordered_map<String, typename TEntryList::iterator, TChBldStringHash> TEntryMap;
+
+    // The entries, most recently used first
+    TEntryList      FEntries;
+    TEntryMap       FEntryMap;
+
+    std::size_t     FCapacity;
+
+    unsigned int    FHits;
+    unsigned int    FMisses;
+};
+//---------------------------------------------------------------------------
+
+} // namespace Cherrybuilder
+
+#endif
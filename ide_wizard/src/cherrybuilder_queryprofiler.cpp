@@ -0,0 +1,317 @@
+﻿/* ===============================================================================
+ * CherryBuilder - The Productivity Extension for C++Builder®
+ * ===============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2017 Florian Koch <flko@mail.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ===============================================================================
+ */
+
+#include <vcl.h>
+#pragma hdrstop
+
+#include "cherrybuilder_queryprofiler.h"
+
+#include <System.StrUtils.hpp>
+
+#include <memory>
+
+#include "cherrybuilder_debugtools.h"
+//---------------------------------------------------------------------------
+
+#pragma package(smart_init)
+
+namespace Cherrybuilder
+{
+
+TChBldQueryProfiler::TChBldQueryProfiler(int Capacity)
+    :   FMutex(new TMutex(false)),
+        FEnabled(false),
+        FSlowQueryTime(50.0),
+        FCapacity(Capacity > 0 ? Capacity : 1),
+        FNext(0)
+{
+    FProfiles.reserve(FCapacity);
+}
+//---------------------------------------------------------------------------
+
+TChBldQueryProfiler::~TChBldQueryProfiler()
+{
+    // Delete the profile mutex
+    if (FMutex)
+    {
+        delete FMutex;
+        FMutex = NULL;
+    }
+}
+//---------------------------------------------------------------------------
+
+void TChBldQueryProfiler::StatementExecuted(
+    SQLite::TDatabase& Database,
+    const String& StatementText,
+    double Duration,
+    int RowsReturned,
+    int RowsScanned
+    )
+{
+    TChBldQueryProfile Profile;
+
+    Profile.Time            = Now();
+    Profile.Method          = Database.GetProfileContext();
+    Profile.Statement       = StatementText;
+    Profile.Duration        = Duration;
+    Profile.RowsReturned    = RowsReturned;
+    Profile.RowsScanned     = RowsScanned;
+    Profile.QueryPlan       = L"";
+
+    // Explain the slow queries (outside of the interlock, as this runs another query)
+    if (Duration >= GetSlowQueryTime())
+    {
+        Profile.QueryPlan = GetQueryPlan(Database, StatementText);
+
+        CS_SEND(
+            L"QueryProfiler::SlowQuery("
+                + Profile.Method
+                + L", "
+                + FormatFloat(L"0.00", Duration)
+                + L" ms, "
+                + Profile.QueryPlan
+                + L")"
+            );
+    }
+
+    // Begin of interlock
+    {
+        TChBldLockGuard LG(FMutex);
+
+        // Fill the buffer, then overwrite the oldest profile
+        if (FProfiles.size() < FCapacity)
+            FProfiles.push_back(Profile);
+        else
+            FProfiles[FNext] = Profile;
+
+        FNext = (FNext + 1) % FCapacity;
+    }
+    // End of interlock
+}
+//---------------------------------------------------------------------------
+
+void TChBldQueryProfiler::GetProfiles(std::vector<TChBldQueryProfile>& Profiles)
+{
+    TChBldLockGuard LG(FMutex);
+
+    Profiles.clear();
+
+    // Return the profiles from the oldest to the newest
+    if (FProfiles.size() < FCapacity)
+    {
+        Profiles = FProfiles;
+    }
+    else
+    {
+        Profiles.insert(Profiles.end(), FProfiles.begin() + FNext, FProfiles.end());
+        Profiles.insert(Profiles.end(), FProfiles.begin(), FProfiles.begin() + FNext);
+    }
+}
+//---------------------------------------------------------------------------
+
+void TChBldQueryProfiler::Clear()
+{
+    TChBldLockGuard LG(FMutex);
+
+    FProfiles.clear();
+    FNext = 0;
+}
+//---------------------------------------------------------------------------
+
+void TChBldQueryProfiler::ExportCSV(const String& FileName)
+{
+    std::vector<TChBldQueryProfile> Profiles;
+
+    GetProfiles(Profiles);
+
+    std::unique_ptr<TStringList> Lines(new TStringList);
+
+    Lines->Add(L"Time;Method;Duration (ms);Rows Returned;Rows Scanned;Statement;Query Plan");
+
+    foreach_ (const TChBldQueryProfile& Profile, Profiles)
+    {
+        Lines->Add(
+            QuoteCSV(FormatDateTime(L"yyyy-mm-dd hh:nn:ss.zzz", Profile.Time))
+                + L";"
+                + QuoteCSV(Profile.Method)
+                + L";"
+                + FormatFloat(L"0.000", Profile.Duration)
+                + L";"
+                + String(Profile.RowsReturned)
+                + L";"
+                + String(Profile.RowsScanned)
+                + L";"
+                + QuoteCSV(Profile.Statement)
+                + L";"
+                + QuoteCSV(Profile.QueryPlan)
+            );
+    }
+
+    Lines->SaveToFile(FileName, TEncoding::UTF8);
+}
+//---------------------------------------------------------------------------
+
+void TChBldQueryProfiler::ExportJSON(const String& FileName)
+{
+    std::vector<TChBldQueryProfile> Profiles;
+
+    GetProfiles(Profiles);
+
+    // Numbers are always written with a decimal point
+    TFormatSettings FormatSettings = TFormatSettings::Invariant();
+
+    std::unique_ptr<TStringList> Lines(new TStringList);
+
+    Lines->Add(L"[");
+
+    for (std::size_t i = 0; i < Profiles.size(); ++i)
+    {
+        const TChBldQueryProfile &Profile = Profiles[i];
+
+        Lines->Add(
+            L"  {"
+                L"\"time\": "
+                + QuoteJSON(FormatDateTime(L"yyyy-mm-dd\"T\"hh:nn:ss.zzz", Profile.Time))
+                + L", \"method\": "
+                + QuoteJSON(Profile.Method)
+                + L", \"duration\": "
+                + FormatFloat(L"0.000", Profile.Duration, FormatSettings)
+                + L", \"rowsReturned\": "
+                + String(Profile.RowsReturned)
+                + L", \"rowsScanned\": "
+                + String(Profile.RowsScanned)
+                + L", \"statement\": "
+                + QuoteJSON(Profile.Statement)
+                + L", \"queryPlan\": "
+                + QuoteJSON(Profile.QueryPlan)
+                + L"}"
+                + ((i + 1 < Profiles.size()) ? L"," : L"")
+            );
+    }
+
+    Lines->Add(L"]");
+
+    Lines->SaveToFile(FileName, TEncoding::UTF8);
+}
+//---------------------------------------------------------------------------
+
+String TChBldQueryProfiler::GetQueryPlan(SQLite::TDatabase& Database, const String& StatementText)
+{
+    String QueryPlan = L"";
+
+    sqlite3_stmt *Explain = NULL;
+
+    // Use the plain API, so the explanation isn't profiled itself (the parameters don't
+    // need to be bound for this)
+    String ExplainText = L"EXPLAIN QUERY PLAN " + StatementText;
+
+    if (sqlite3_prepare16_v2(Database.GetHandle(), ExplainText.w_str(), -1, &Explain, NULL) != SQLITE_OK)
+        return L"";
+
+    // Join the details of the plan steps
+    while (sqlite3_step(Explain) == SQLITE_ROW)
+    {
+        if (!QueryPlan.IsEmpty())
+            QueryPlan += L" | ";
+
+        QueryPlan += String(static_cast<const wchar_t*>(sqlite3_column_text16(Explain, 3)));
+    }
+
+    sqlite3_finalize(Explain);
+
+    return QueryPlan;
+}
+//---------------------------------------------------------------------------
+
+String TChBldQueryProfiler::QuoteCSV(const String& Text)
+{
+    return L"\"" + StringReplace(Text, L"\"", L"\"\"", TReplaceFlags() << rfReplaceAll) + L"\"";
+}
+//---------------------------------------------------------------------------
+
+String TChBldQueryProfiler::QuoteJSON(const String& Text)
+{
+    String Quoted = L"\"";
+
+    for (int i = 1; i <= Text.Length(); ++i)
+    {
+        wchar_t Char = Text[i];
+
+        switch (Char)
+        {
+            case L'"':  Quoted += L"\\\"";  break;
+            case L'\\': Quoted += L"\\\\";  break;
+            case L'\n': Quoted += L"\\n";   break;
+            case L'\r': Quoted += L"\\r";   break;
+            case L'\t': Quoted += L"\\t";   break;
+
+            default:
+                // Escape the other control characters
+                if (Char < 0x20)
+                    Quoted += L"\\u" + IntToHex(static_cast<int>(Char), 4);
+                else
+                    Quoted += Char;
+        }
+    }
+
+    return Quoted + L"\"";
+}
+//---------------------------------------------------------------------------
+
+bool TChBldQueryProfiler::GetEnabled()
+{
+    TChBldLockGuard LG(FMutex);
+
+    return FEnabled;
+}
+//---------------------------------------------------------------------------
+
+void TChBldQueryProfiler::SetEnabled(bool Value)
+{
+    TChBldLockGuard LG(FMutex);
+
+    FEnabled = Value;
+}
+//---------------------------------------------------------------------------
+
+double TChBldQueryProfiler::GetSlowQueryTime()
+{
+    TChBldLockGuard LG(FMutex);
+
+    return FSlowQueryTime;
+}
+//---------------------------------------------------------------------------
+
+void TChBldQueryProfiler::SetSlowQueryTime(double Value)
+{
+    TChBldLockGuard LG(FMutex);
+
+    FSlowQueryTime = Value;
+}
+//---------------------------------------------------------------------------
+
+} // namespace Cherrybuilder
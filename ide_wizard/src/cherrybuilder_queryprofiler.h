@@ -0,0 +1,105 @@
+﻿/* ===============================================================================
+ * CherryBuilder - The Productivity Extension for C++Builder®
+ * ===============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2017 Florian Koch <flko@mail.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ===============================================================================
+ */
+
+#ifndef cherrybuilder_queryprofilerH
+#define cherrybuilder_queryprofilerH
+//---------------------------------------------------------------------------
+
+#include <vector>
+
+#include "cherrybuilder_environment.h"
+#include "cherrybuilder_sqlite.h"
+//---------------------------------------------------------------------------
+
+namespace Cherrybuilder
+{
+
+// The measurement of a single statement execution
+struct TChBldQueryProfile
+{
+    TDateTime   Time;
+    String      Method;
+    String      Statement;
+    double      Duration;
+    int         RowsReturned;
+    int         RowsScanned;
+    String      QueryPlan;
+};
+//---------------------------------------------------------------------------
+
+// An opt-in profiler of the ProjectDB queries: It keeps the last executions in a ring
+// buffer (with the query plan of the slow ones) to be exported as CSV or JSON. It only
+// needs a database, so it can be used without the IDE as well.
+class TChBldQueryProfiler : public SQLite::TProfiler
+{
+public:
+    TChBldQueryProfiler(int Capacity=1000);
+    ~TChBldQueryProfiler();
+
+    void StatementExecuted(
+        SQLite::TDatabase& Database,
+        const String& StatementText,
+        double Duration,
+        int RowsReturned,
+        int RowsScanned
+        );
+
+    void GetProfiles(std::vector<TChBldQueryProfile>& Profiles);
+    void Clear();
+
+    void ExportCSV(const String& FileName);
+    void ExportJSON(const String& FileName);
+
+    __property bool Enabled = {read=GetEnabled, write=SetEnabled};
+    __property double SlowQueryTime = {read=GetSlowQueryTime, write=SetSlowQueryTime};
+
+private:
+    static String GetQueryPlan(SQLite::TDatabase& Database, const String& StatementText);
+
+    static String QuoteCSV(const String& Text);
+    static String QuoteJSON(const String& Text);
+
+    bool GetEnabled();
+    void SetEnabled(bool Value);
+    double GetSlowQueryTime();
+    void SetSlowQueryTime(double Value);
+
+    TMutex *FMutex;
+
+    bool    FEnabled;
+    double  FSlowQueryTime;
+
+    // The ring buffer ('FNext' is the position of the oldest profile once it's full)
+    std::vector<TChBldQueryProfile> FProfiles;
+    std::size_t                     FCapacity;
+    std::size_t                     FNext;
+};
+//---------------------------------------------------------------------------
+
+} // namespace Cherrybuilder
+
+#endif
@@ -41,10 +41,12 @@ using namespace Cherrybuilder;
 
 __fastcall TChBldSettingsForm::TChBldSettingsForm(
     TComponent* Owner,
-    TMemIniFile* SettingsINI
+    TMemIniFile* SettingsINI,
+    TChBldQueryProfiler* QueryProfiler
     )
     :   TForm(Owner),
-        FSettingsINI(SettingsINI)
+        FSettingsINI(SettingsINI),
+        FQueryProfiler(QueryProfiler)
 {
     // Hide the tabs of the settings pages and add the captions as nodes to
     // the TreeView, so they can be accessed by selecting those nodes
@@ -63,6 +65,10 @@ __fastcall TChBldSettingsForm::TChBldSettingsForm(
     edAnalyzerSyncInterval->Tag         = reinterpret_cast<int>(udAnalyzerSyncInterval);
     edAnalyzerDeepRefreshInterval->Tag  = reinterpret_cast<int>(udAnalyzerDeepRefreshInterval);
 
+    // The recorded queries can only be exported if we've got the profiler
+    btnExportProfileCSV->Enabled    = (FQueryProfiler != NULL);
+    btnExportProfileJSON->Enabled   = (FQueryProfiler != NULL);
+
     // Load the settings values
     LoadSettings();
 }
@@ -237,10 +243,16 @@ void TChBldSettingsForm::LoadSettings()
         FSettingsINI->ReadInteger(L"CodeAnalyzer", L"SyncInterval", 2000);
 
     udAnalyzerDeepRefreshInterval->Position =
-        FSettingsINI->ReadInteger(L"CodeAnalyzer", L"DeepRefreshInterval", 600000) / 1000;
+        FSettingsINI->ReadInteger(L"CodeAnalyzer", L"DeepRefreshInterval", 7200000) / 1000;
 
     edAnalyzerCtagsExecutable->Text =
         FSettingsINI->ReadString(L"CodeAnalyzer", L"CtagsExe", L"");
+
+    cbProfileQueries->Checked =
+        FSettingsINI->ReadBool(L"CodeAnalyzer", L"ProfileQueries", false);
+
+    edProfilerSlowQueryTime->Text =
+        String(FSettingsINI->ReadInteger(L"CodeAnalyzer", L"SlowQueryTime", 50));
 }
 //---------------------------------------------------------------------------
 
@@ -346,6 +358,18 @@ void TChBldSettingsForm::SaveSettings()
         edAnalyzerCtagsExecutable->Text
         );
 
+    FSettingsINI->WriteBool(
+        L"CodeAnalyzer",
+        L"ProfileQueries",
+        cbProfileQueries->Checked
+        );
+
+    FSettingsINI->WriteInteger(
+        L"CodeAnalyzer",
+        L"SlowQueryTime",
+        StrToIntDef(edProfilerSlowQueryTime->Text, 50)
+        );
+
     // Update the settings file
     FSettingsINI->UpdateFile();
 }
@@ -381,6 +405,30 @@ void __fastcall TChBldSettingsForm::pnlColorClick(TObject *Sender)
 }
 //---------------------------------------------------------------------------
 
+void __fastcall TChBldSettingsForm::btnExportProfileClick(TObject *Sender)
+{
+    bool AsJSON = (Sender == btnExportProfileJSON);
+
+    // Create a save dialog
+    std::unique_ptr<TSaveDialog> SD(new TSaveDialog(this));
+
+    SD->Filter      = AsJSON ? L"JSON files (*.json)|*.json" : L"CSV files (*.csv)|*.csv";
+    SD->DefaultExt  = AsJSON ? L"json" : L"csv";
+    SD->FileName    = AsJSON ? L"chbld_queries.json" : L"chbld_queries.csv";
+    SD->Options     = SD->Options << ofOverwritePrompt;
+
+    // If the user has chosen a file...
+    if (SD->Execute())
+    {
+        // ...write the recorded queries to it
+        if (AsJSON)
+            FQueryProfiler->ExportJSON(SD->FileName);
+        else
+            FQueryProfiler->ExportCSV(SD->FileName);
+    }
+}
+//---------------------------------------------------------------------------
+
 void TChBldSettingsForm::SetChildControlsEnabledState(TWinControl* AParent, bool AEnabled)
 {
     if (AParent)
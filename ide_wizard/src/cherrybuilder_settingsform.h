@@ -39,6 +39,8 @@
 #include <Vcl.AppEvnts.hpp>
 
 #include <memory>
+
+#include "cherrybuilder_queryprofiler.h"
 //---------------------------------------------------------------------------
 
 class TChBldSettingsForm : public TForm
@@ -116,6 +118,12 @@ __published:
     TCheckBox *cbEnableShiftCtrlArrowNavigation;
     TMemo *meCtagsVersion;
     TCheckBox *cbEnableShiftCtrlArrowJumpback;
+    TGroupBox *grbQueryProfiler;
+    TLabel *Label18;
+    TCheckBox *cbProfileQueries;
+    TEdit *edProfilerSlowQueryTime;
+    TButton *btnExportProfileCSV;
+    TButton *btnExportProfileJSON;
     void __fastcall btnOKClick(TObject *Sender);
     void __fastcall btnCancelClick(TObject *Sender);
     void __fastcall tvSelectionChange(TObject *Sender, TTreeNode *Node);
@@ -123,9 +131,14 @@ __published:
     void __fastcall edAnalyzerIntervalExit(TObject *Sender);
     void __fastcall aeConfigIdle(TObject *Sender, bool &Done);
     void __fastcall pnlColorClick(TObject *Sender);
+    void __fastcall btnExportProfileClick(TObject *Sender);
 
 public:
-    __fastcall TChBldSettingsForm(TComponent* Owner, TMemIniFile* SettingsINI);
+    __fastcall TChBldSettingsForm(
+        TComponent* Owner,
+        TMemIniFile* SettingsINI,
+        Cherrybuilder::TChBldQueryProfiler* QueryProfiler=NULL
+        );
 
 private:
     String GetCtagsVersionString();
@@ -136,6 +149,7 @@ private:
     void SetChildControlsEnabledState(TWinControl* AParent, bool AEnabled);
 
     TMemIniFile *FSettingsINI;
+    Cherrybuilder::TChBldQueryProfiler *FQueryProfiler;
 };
 
 #endif
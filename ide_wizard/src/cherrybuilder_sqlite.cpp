@@ -41,14 +41,16 @@ namespace SQLite
 //===========================================================================
 TDatabase::TDatabase(TJournalMode JournalMode)
     : 	FIsOpen(false),
-		FJournalMode(JournalMode)
+		FJournalMode(JournalMode),
+        FProfiler(NULL)
 {
 }
 //---------------------------------------------------------------------------
 
 TDatabase::TDatabase(const String& FileName, TJournalMode JournalMode)
     : 	FIsOpen(false),
-		FJournalMode(JournalMode)
+		FJournalMode(JournalMode),
+        FProfiler(NULL)
 {	
     Open(FileName);
 }
@@ -73,8 +75,14 @@ void TDatabase::Open(const String& FileName)
     {
         FFileName = FileName;
 
-        // Open or create the database (if non-existent)
-        int ResultCode = sqlite3_open16(FFileName.w_str(), &FSQLiteDB);
+        // Open or create the database (if non-existent), URI file names are enabled for
+        // attaching other databases with parameters (e.g. read-only)
+        int ResultCode = sqlite3_open_v2(
+                            UTF8String(FFileName).c_str(),
+                            &FSQLiteDB,
+                            SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI,
+                            NULL
+                            );
                 
         if (ResultCode != SQLITE_OK)
             throw Exception(
@@ -82,6 +90,10 @@ void TDatabase::Open(const String& FileName)
                 );            
 
         FIsOpen = true;
+
+        // New databases get the same text encoding as with 'sqlite3_open16' (existing
+        // ones keep theirs)
+        sqlite3_exec(FSQLiteDB, "PRAGMA encoding = 'UTF-16';", 0, 0, NULL);
 		
 		SetJournalMode(FJournalMode);		
     }
@@ -92,6 +104,33 @@ void TDatabase::Open(const String& FileName)
 }
 //---------------------------------------------------------------------------
 
+void TDatabase::Attach(const String& FileName, const String& SchemaName, bool ReadOnly)
+{
+    String URI = FileName;
+
+    // Build a URI file name (the characters with a special meaning in URIs are escaped)
+    URI = StringReplace(URI, L"%", L"%25", TReplaceFlags() << rfReplaceAll);
+    URI = StringReplace(URI, L"#", L"%23", TReplaceFlags() << rfReplaceAll);
+    URI = StringReplace(URI, L"?", L"%3f", TReplaceFlags() << rfReplaceAll);
+    URI = StringReplace(URI, L"\\", L"/", TReplaceFlags() << rfReplaceAll);
+
+    URI = L"file:///" + URI + (ReadOnly ? L"?mode=ro" : L"");
+
+    TStatement CmdAttach(*this, L"ATTACH DATABASE ?1 AS " + SchemaName + L";");
+
+    CmdAttach.BindString(1, URI);
+    CmdAttach.ExecuteStep();
+}
+//---------------------------------------------------------------------------
+
+void TDatabase::SetProfiler(TProfiler* Profiler, const String& ProfileContext)
+{
+    // The context tells the profiler which operation the statements belong to
+    FProfiler       = Profiler;
+    FProfileContext = ProfileContext;
+}
+//---------------------------------------------------------------------------
+
 void TDatabase::Close()
 {
     sqlite3_close(FSQLiteDB);
@@ -185,6 +224,26 @@ __int64 TDatabase::GetLastInsertRowId()
 }
 //---------------------------------------------------------------------------
 
+int TDatabase::GetChanges()
+{
+    if (!FIsOpen)
+        throw Exception(L"sqlite3 error: no open database");
+
+    return sqlite3_changes(FSQLiteDB);
+}
+//---------------------------------------------------------------------------
+
+// Lets the statements wait for the given time while another connection locks the database
+// (instead of failing with 'SQLITE_BUSY' at once)
+void TDatabase::SetBusyTimeout(int Milliseconds)
+{
+    if (!FIsOpen)
+        throw Exception(L"sqlite3 error: no open database");
+
+    sqlite3_busy_timeout(FSQLiteDB, Milliseconds);
+}
+//---------------------------------------------------------------------------
+
 void TDatabase::SetJournalMode(TJournalMode JournalMode)
 {
 	AnsiString JournalModeName = "";
@@ -243,7 +302,9 @@ void TDatabase::SetJournalMode(TJournalMode JournalMode)
 TStatement::TStatement(TDatabase& Database, const String& StatementText)
     :   FDatabase(Database),
         FStatementText(StatementText),
-        FCompiledStatement(NULL)
+        FCompiledStatement(NULL),
+        FIsProfiling(false),
+        FProfileRows(0)
 {
     if (FDatabase.IsOpen())
     {
@@ -259,7 +320,22 @@ TStatement::TStatement(TDatabase& Database, const String& StatementText)
 TStatement::~TStatement()
 {
     if (FDatabase.IsOpen())
+    {
+        // A statement may be dropped without stepping to its end (e.g. after the first row)
+        if (FIsProfiling)
+        {
+            try
+            {
+                FinishProfile();
+            }
+            catch (...)
+            {
+                // Never throw from the destructor
+            }
+        }
+
         sqlite3_finalize(FCompiledStatement);
+    }
 }
 //---------------------------------------------------------------------------
 
@@ -389,8 +465,28 @@ int TStatement::GetColumnCount()
 
 int TStatement::ExecuteStep()
 {
+    // Start the profiling with the first step of an execution
+    if (FDatabase.GetProfiler() && !FIsProfiling)
+    {
+        FIsProfiling    = true;
+        FProfileRows    = 0;
+
+        // Reset the counter of the full scan steps
+        sqlite3_stmt_status(FCompiledStatement, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+
+        QueryPerformanceCounter(&FProfileStart);
+    }
+
     int ResultCode = sqlite3_step(FCompiledStatement);
 
+    if (FIsProfiling)
+    {
+        if (ResultCode == SQLITE_ROW)
+            ++FProfileRows;
+        else
+            FinishProfile();
+    }
+
     switch (ResultCode)
     {
         case SQLITE_BUSY:
@@ -409,6 +505,9 @@ int TStatement::ExecuteStep()
 
 int TStatement::Reset()
 {
+    if (FIsProfiling)
+        FinishProfile();
+
     int ResultCode = sqlite3_reset(FCompiledStatement);
 
     switch (ResultCode)
@@ -570,6 +669,39 @@ const String TStatement::GetColumnAsString(const String& ColName)
 }
 //---------------------------------------------------------------------------
 
+void TStatement::GetColumnAsString(int ColNo, String& Val)
+{
+    int nChars;
+
+    const wchar_t* Text = GetColumnAsText(ColNo, nChars);
+
+    // Reuse the buffer of 'Val' (if it's not shared, it's only resized)
+    Val.SetLength(nChars);
+
+    if (nChars > 0)
+        wmemcpy(Val.c_str(), Text, nChars);
+}
+//---------------------------------------------------------------------------
+
+const wchar_t* TStatement::GetColumnAsText(int ColNo, int& nChars)
+{
+    // Note: The text is only valid until the next step or reset of the statement
+    const wchar_t* RetVal = static_cast<const wchar_t*>(sqlite3_column_text16(FCompiledStatement, ColNo));
+
+    if (sqlite3_errcode(FDatabase.GetHandle()) == SQLITE_NOMEM)
+    {
+        throw Exception(
+            L"sqlite3 error: "
+            + String(static_cast<const wchar_t*>(sqlite3_errmsg16(FDatabase.GetHandle())))
+            );
+    }
+
+    nChars = sqlite3_column_bytes16(FCompiledStatement, ColNo) / sizeof(wchar_t);
+
+    return RetVal ? RetVal : L"";
+}
+//---------------------------------------------------------------------------
+
 void TStatement::Prepare()
 {
 
@@ -591,6 +723,31 @@ void TStatement::Prepare()
 }
 //---------------------------------------------------------------------------
 
+void TStatement::FinishProfile()
+{
+    LARGE_INTEGER ProfileEnd;
+    LARGE_INTEGER Frequency;
+
+    QueryPerformanceCounter(&ProfileEnd);
+    QueryPerformanceFrequency(&Frequency);
+
+    FIsProfiling = false;
+
+    TProfiler *Profiler = FDatabase.GetProfiler();
+
+    if (!Profiler)
+        return;
+
+    Profiler->StatementExecuted(
+        FDatabase,
+        FStatementText,
+        (ProfileEnd.QuadPart - FProfileStart.QuadPart) * 1000.0 / Frequency.QuadPart,
+        FProfileRows,
+        sqlite3_stmt_status(FCompiledStatement, SQLITE_STMTSTATUS_FULLSCAN_STEP, 0)
+        );
+}
+//---------------------------------------------------------------------------
+
 int TStatement::GetColumnNoByName(const String& ColName)
 {
     int CurColNo;
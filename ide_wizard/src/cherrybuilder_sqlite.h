@@ -47,6 +47,25 @@ enum TJournalMode : int
 	jmOff		= 5
 };
 
+class TDatabase;
+
+// Receives the executions of the statements of a database (see 'TDatabase::SetProfiler')
+class TProfiler
+{
+public:
+    virtual ~TProfiler() {}
+
+    // 'Duration' is given in ms, 'RowsScanned' are the steps of full table scans
+    virtual void StatementExecuted(
+        TDatabase& Database,
+        const String& StatementText,
+        double Duration,
+        int RowsReturned,
+        int RowsScanned
+        ) = 0;
+};
+//---------------------------------------------------------------------------
+
 class TDatabase
 {
 public:
@@ -59,6 +78,12 @@ public:
     void Open(const String& FileName);
     void Close();
 
+    void Attach(const String& FileName, const String& SchemaName, bool ReadOnly=false);
+
+    void SetProfiler(TProfiler* Profiler, const String& ProfileContext);
+    TProfiler* GetProfiler() { return FProfiler; }
+    String GetProfileContext() { return FProfileContext; }
+
     void BeginTransaction();
     void RollbackTransaction();
     void CommitTransaction();
@@ -66,6 +91,9 @@ public:
     bool IsOpen();
 
     __int64 		GetLastInsertRowId();
+    int             GetChanges();
+
+    void            SetBusyTimeout(int Milliseconds);
 	TJournalMode 	GetJournalMode() { return FJournalMode; }
 
 private:
@@ -79,6 +107,9 @@ private:
 
     bool FIsOpen;
 	TJournalMode FJournalMode;
+
+    TProfiler *FProfiler;
+    String FProfileContext;
 };
 //---------------------------------------------------------------------------
 
@@ -112,6 +143,8 @@ public:
     __int64         GetColumnAsInt64(const String& ColName);
     const String    GetColumnAsString(int ColNo);
     const String    GetColumnAsString(const String& ColName);
+    void            GetColumnAsString(int ColNo, String& Val);
+    const wchar_t*  GetColumnAsText(int ColNo, int& nChars);
 
 private:
     TStatement(const TStatement&);              // Prevent copy-construction
@@ -119,12 +152,19 @@ private:
 
     void Prepare();
 
+    void FinishProfile();
+
     int GetColumnNoByName(const String& ColName);
 
     TDatabase   &FDatabase;
     String      FStatementText;
 
     sqlite3_stmt *FCompiledStatement;
+
+    // The profiling of the current execution (if the database has a profiler)
+    bool            FIsProfiling;
+    LARGE_INTEGER   FProfileStart;
+    int             FProfileRows;
 };
 //---------------------------------------------------------------------------
 
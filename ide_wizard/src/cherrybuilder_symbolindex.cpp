@@ -0,0 +1,1143 @@
+﻿/* ===============================================================================
+ * CherryBuilder - The Productivity Extension for C++Builder®
+ * ===============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2017 Florian Koch <flko@mail.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ===============================================================================
+ */
+
+#include <vcl.h>
+#pragma hdrstop
+
+#include "cherrybuilder_symbolindex.h"
+
+#include <algorithm>
+#include <iterator>
+#include <cwctype>
+
+#include <System.StrUtils.hpp>
+
+#include "cherrybuilder_debugtools.h"
+//---------------------------------------------------------------------------
+
+#pragma package(smart_init)
+
+namespace Cherrybuilder
+{
+
+//===========================================================================
+// TChBldStringHash
+//===========================================================================
+std::size_t TChBldStringHash::operator()(const String& Str) const
+{
+    // FNV-1a
+    std::size_t Hash = 2166136261U;
+
+    const wchar_t *Chars = Str.c_str();
+
+    for (int i = 0; i < Str.Length(); ++i)
+    {
+        Hash ^= static_cast<std::size_t>(Chars[i]);
+        Hash *= 16777619U;
+    }
+
+    return Hash;
+}
+//---------------------------------------------------------------------------
+
+//===========================================================================
+// TChBldNameSearchIndex
+//===========================================================================
+
+// Orders the posting lists by their length, so the intersection starts with the shortest
+static bool IsShorterList(const std::vector<int>* List, const std::vector<int>* OtherList)
+{
+    return List->size() < OtherList->size();
+}
+//---------------------------------------------------------------------------
+
+TChBldNameSearchIndex::TChBldNameSearchIndex(const VString& Names)
+{
+    unsigned int StartTicks = GetTickCount();
+
+    FNames = Names;
+    FLowerNames.reserve(Names.size());
+    FInitials.reserve(Names.size());
+
+    for (std::size_t i = 0; i < Names.size(); ++i)
+    {
+        int ID = static_cast<int>(i);
+
+        FLowerNames.push_back(Names[i].LowerCase());
+        FNameIDs[Names[i]] = ID;
+
+        const String    &LowerName  = FLowerNames.back();
+        const wchar_t   *Chars      = LowerName.c_str();
+
+        // Register the name once for each of its trigrams (the IDs stay ascending as the
+        // names are added in order)
+        for (int j = 0; j + 3 <= LowerName.Length(); ++j)
+        {
+            std::vector<int> &IDs = FTrigrams[GetTrigram(Chars + j)];
+
+            if (IDs.empty() || (IDs.back() != ID))
+                IDs.push_back(ID);
+        }
+
+        FInitials.push_back(std::make_pair(GetInitials(Names[i], false), ID));
+    }
+
+    std::sort(FInitials.begin(), FInitials.end());
+
+    CS_SEND(
+        L"NameSearchIndex::Constructor("
+            + String(GetCount())
+            + L" names, "
+            + String(static_cast<int>(FTrigrams.size()))
+            + L" trigrams, "
+            + String(GetTickCount() - StartTicks)
+            + L")"
+        );
+}
+//---------------------------------------------------------------------------
+
+bool TChBldNameSearchIndex::Contains(const String& Name) const
+{
+    return FNameIDs.find(Name) != FNameIDs.end();
+}
+//---------------------------------------------------------------------------
+
+const String& TChBldNameSearchIndex::GetName(int ID) const
+{
+    return FNames[ID];
+}
+//---------------------------------------------------------------------------
+
+void TChBldNameSearchIndex::Find(const String& Query, std::vector<std::pair<int, int> >& Matches) const
+{
+    String LowerQuery = Query.LowerCase();
+
+    if (LowerQuery.IsEmpty())
+        return;
+
+    std::vector<int> IDs;
+
+    // Get the names containing the query
+    FindSubstrings(LowerQuery, IDs);
+
+    std::unordered_set<int> MatchedIDs;
+
+    foreach_ (int ID, IDs)
+    {
+        Matches.push_back(std::make_pair((FLowerNames[ID].Pos(LowerQuery) == 1) ? mrPrefix : mrSubstring, ID));
+        MatchedIDs.insert(ID);
+    }
+
+    String Initials = GetInitials(Query, true);
+
+    // A query of a single hump is completely covered by the substring search
+    if (Initials.Length() < 2)
+        return;
+
+    // Get the names whose initials start with the ones of the query...
+    std::vector<std::pair<String, int> >::const_iterator Candidate =
+        std::lower_bound(FInitials.begin(), FInitials.end(), std::make_pair(Initials, -1));
+
+    while ((Candidate != FInitials.end()) && StartsStr(Initials, Candidate->first))
+    {
+        // ...and whose humps start with the ones of the query
+        if ((MatchedIDs.count(Candidate->second) == 0)
+            && IsCamelCaseMatch(Query, FNames[Candidate->second])
+            )
+        {
+            Matches.push_back(std::make_pair(static_cast<int>(mrCamelCase), Candidate->second));
+        }
+
+        ++Candidate;
+    }
+}
+//---------------------------------------------------------------------------
+
+bool TChBldNameSearchIndex::IsCamelCaseMatch(const String& Query, const String& Name)
+{
+    VString QueryHumps;
+    VString NameHumps;
+
+    GetHumps(Query, QueryHumps, true);
+    GetHumps(Name, NameHumps, false);
+
+    if (QueryHumps.empty() || (QueryHumps.size() > NameHumps.size()))
+        return false;
+
+    // Each hump of the query has to start the corresponding hump of the name
+    for (std::size_t i = 0; i < QueryHumps.size(); ++i)
+    {
+        if (!StartsText(QueryHumps[i], NameHumps[i]))
+            return false;
+    }
+
+    return true;
+}
+//---------------------------------------------------------------------------
+
+void TChBldNameSearchIndex::GetHumps(const String& Text, VString& Humps, bool IsQuery)
+{
+    Humps.clear();
+
+    int HumpStart = 0;
+
+    for (int i = 1; i <= Text.Length(); ++i)
+    {
+        // Underscores only separate the humps
+        if (Text[i] == L'_')
+        {
+            if (HumpStart > 0)
+                Humps.push_back(Text.SubString(HumpStart, i - HumpStart));
+
+            HumpStart = 0;
+        }
+        else if (IsHumpStart(Text, i, IsQuery))
+        {
+            if (HumpStart > 0)
+                Humps.push_back(Text.SubString(HumpStart, i - HumpStart));
+
+            HumpStart = i;
+        }
+    }
+
+    if (HumpStart > 0)
+        Humps.push_back(Text.SubString(HumpStart, Text.Length() - HumpStart + 1));
+}
+//---------------------------------------------------------------------------
+
+unsigned long long TChBldNameSearchIndex::GetTrigram(const wchar_t* Chars)
+{
+    return
+        (static_cast<unsigned long long>(Chars[0]) << 32)
+        | (static_cast<unsigned long long>(Chars[1]) << 16)
+        | static_cast<unsigned long long>(Chars[2]);
+}
+//---------------------------------------------------------------------------
+
+bool TChBldNameSearchIndex::IsHumpStart(const String& Text, int Index, bool IsQuery)
+{
+    wchar_t Char = Text[Index];
+
+    if (Char == L'_')
+        return false;
+
+    if ((Index == 1) || (Text[Index - 1] == L'_'))
+        return true;
+
+    wchar_t Prev = Text[Index - 1];
+
+    // In a query each upper case letter starts a hump ('gCEP')...
+    if (IsQuery)
+        return iswupper(Char);
+
+    wchar_t Next = (Index < Text.Length()) ? Text[Index + 1] : L'\0';
+
+    // ...in a name an upper case letter after a lower case one, the last one of a run of
+    // upper case letters ('HTMLParser') and the first digit of a number
+    return
+        (iswupper(Char) && (!iswupper(Prev) || iswlower(Next)))
+        || (iswdigit(Char) && !iswdigit(Prev));
+}
+//---------------------------------------------------------------------------
+
+String TChBldNameSearchIndex::GetInitials(const String& Text, bool IsQuery)
+{
+    String Initials = L"";
+
+    for (int i = 1; i <= Text.Length(); ++i)
+    {
+        if (IsHumpStart(Text, i, IsQuery))
+            Initials += Text[i];
+    }
+
+    return Initials.LowerCase();
+}
+//---------------------------------------------------------------------------
+
+void TChBldNameSearchIndex::FindSubstrings(const String& LowerQuery, std::vector<int>& IDs) const
+{
+    // Queries shorter than a trigram are checked against all names
+    if (LowerQuery.Length() < 3)
+    {
+        for (std::size_t i = 0; i < FLowerNames.size(); ++i)
+        {
+            if (FLowerNames[i].Pos(LowerQuery) > 0)
+                IDs.push_back(static_cast<int>(i));
+        }
+
+        return;
+    }
+
+    std::vector<const std::vector<int>*> Lists;
+
+    const wchar_t *Chars = LowerQuery.c_str();
+
+    // Get the posting lists of all trigrams of the query
+    for (int i = 0; i + 3 <= LowerQuery.Length(); ++i)
+    {
+        TTrigramMap::const_iterator List = FTrigrams.find(GetTrigram(Chars + i));
+
+        // No name contains this trigram
+        if (List == FTrigrams.end())
+            return;
+
+        Lists.push_back(&List->second);
+    }
+
+    std::sort(Lists.begin(), Lists.end(), IsShorterList);
+
+    // Intersect the lists, beginning with the shortest one
+    std::vector<int> Candidates(*Lists[0]);
+
+    for (std::size_t i = 1; (i < Lists.size()) && !Candidates.empty(); ++i)
+    {
+        std::vector<int> Intersection;
+
+        std::set_intersection(
+            Candidates.begin(),
+            Candidates.end(),
+            Lists[i]->begin(),
+            Lists[i]->end(),
+            std::back_inserter(Intersection)
+            );
+
+        Candidates.swap(Intersection);
+    }
+
+    // The trigrams may occur at other positions than in the query, so the candidates
+    // have to be checked
+    foreach_ (int ID, Candidates)
+    {
+        if (FLowerNames[ID].Pos(LowerQuery) > 0)
+            IDs.push_back(ID);
+    }
+}
+//---------------------------------------------------------------------------
+
+int TChBldNameSearchIndex::GetCount() const
+{
+    return static_cast<int>(FNames.size());
+}
+//---------------------------------------------------------------------------
+
+//===========================================================================
+// TChBldSymbolIndex
+//===========================================================================
+
+// Orders the scopes of an object by their inheritance depth
+static bool IsLowerDepth(const std::pair<int, String>& Scope, const std::pair<int, String>& OtherScope)
+{
+    return Scope.first < OtherScope.first;
+}
+//---------------------------------------------------------------------------
+
+// Orders the matches by their rank, then by their name
+static bool IsBetterMatch(const std::pair<int, String>& Match, const std::pair<int, String>& OtherMatch)
+{
+    if (Match.first != OtherMatch.first)
+        return Match.first < OtherMatch.first;
+
+    // Shorter names match the query more closely
+    if (Match.second.Length() != OtherMatch.second.Length())
+        return Match.second.Length() < OtherMatch.second.Length();
+
+    return Match.second < OtherMatch.second;
+}
+//---------------------------------------------------------------------------
+
+TChBldSymbolIndex::TChBldSymbolIndex()
+    :   FBase(new TLayer),
+        FDelta(new TLayer),
+        FCount(0)
+{
+    //
+}
+//---------------------------------------------------------------------------
+
+void TChBldSymbolIndex::Load(SQLite::TDatabase& DB)
+{
+    CS_SEND(L"SymbolIndex::Load(Begin)");
+    unsigned int StartTicks = GetTickCount();
+
+    TFileMap        Files;
+    TAncestorMap    Ancestors;
+
+    // Get all tags
+    {
+        SQLite::TStatement QryGetTags(
+            DB,
+            L"SELECT * FROM Common ORDER BY ID;"
+            );
+
+        ReadFiles(QryGetTags, Files);
+    }
+
+    // Get all ancestor closures
+    LoadAncestors(DB, NULL, Ancestors);
+
+    // Build the lookup tables (everything goes to the base layer)
+    FBase = BuildLayer(Files, Ancestors);
+    FDelta.reset(new TLayer);
+
+    FReplacedFiles.clear();
+
+    FCount = FBase->Count;
+
+    // Build the search index over all names
+    BuildSearchIndex(NULL);
+
+    CS_SEND(
+        L"SymbolIndex::Load(End, "
+            + String(GetCount())
+            + L" tags, "
+            + String(GetTickCount() - StartTicks)
+            + L")"
+        );
+}
+//---------------------------------------------------------------------------
+
+void TChBldSymbolIndex::Load(
+    const TChBldSymbolIndex& Base,
+    SQLite::TDatabase& DB,
+    const std::set<String>& ChangedFiles,
+    const std::set<String>& ChangedClasses
+    )
+{
+    CS_SEND(
+        L"SymbolIndex::Load(Begin, "
+            + String(static_cast<int>(ChangedFiles.size()))
+            + L" files, "
+            + String(static_cast<int>(ChangedClasses.size()))
+            + L" classes)"
+        );
+
+    unsigned int StartTicks = GetTickCount();
+
+    // The changed files and closures are added to the ones already replaced by the delta
+    // layer of the base index
+    TFileMap        DeltaFiles(Base.FDelta->Files);
+    TAncestorMap    DeltaAncestors(Base.FDelta->Ancestors);
+
+    FReplacedFiles = Base.FReplacedFiles;
+
+    foreach_ (const String& ChangedFile, ChangedFiles)
+    {
+        DeltaFiles.erase(ChangedFile);
+
+        TFileMap::const_iterator BaseFile = Base.FBase->Files.find(ChangedFile);
+
+        if (BaseFile != Base.FBase->Files.end())
+            FReplacedFiles.insert(BaseFile->second.get());
+    }
+
+    // Get the tags of the changed files (the removed files have none)
+    if (ChangedFiles.size() > 0)
+    {
+        SQLite::TStatement QryGetTags(
+            DB,
+            L"SELECT * FROM Common "
+            L"WHERE FileName = ?1 "
+            L"ORDER BY ID;"
+            );
+
+        foreach_ (const String& ChangedFile, ChangedFiles)
+        {
+            QryGetTags.BindString(1, ChangedFile);
+
+            ReadFiles(QryGetTags, DeltaFiles);
+
+            QryGetTags.Reset();
+        }
+    }
+
+    // Get the closures of the changed classes
+    LoadAncestors(DB, &ChangedClasses, DeltaAncestors);
+
+    int DeltaCount      = 0;
+    int ReplacedCount   = 0;
+
+    for (TFileMap::const_iterator File = DeltaFiles.begin(); File != DeltaFiles.end(); ++File)
+        DeltaCount += static_cast<int>(File->second->Tags.size());
+
+    foreach_ (const TFileSymbols* ReplacedFile, FReplacedFiles)
+        ReplacedCount += static_cast<int>(ReplacedFile->Tags.size());
+
+    // As long as the delta is small, the base layer and its search index are shared...
+    if (((DeltaCount + ReplacedCount) * 8) <= Base.FBase->Count)
+    {
+        FBase   = Base.FBase;
+        FDelta  = BuildLayer(DeltaFiles, DeltaAncestors);
+
+        FCount  = FBase->Count - ReplacedCount + FDelta->Count;
+
+        // Add the new names to the search index of the base layer
+        BuildSearchIndex(&Base);
+    }
+    // ...otherwise both layers are merged into a new base layer
+    else
+    {
+        TFileMap        Files;
+        TAncestorMap    Ancestors(Base.FBase->Ancestors);
+
+        // Take the unchanged files of the base layer and the ones of the delta...
+        for (TFileMap::const_iterator File = Base.FBase->Files.begin();
+            File != Base.FBase->Files.end();
+            ++File
+            )
+        {
+            if (FReplacedFiles.count(File->second.get()) == 0)
+                Files.insert(*File);
+        }
+
+        Files.insert(DeltaFiles.begin(), DeltaFiles.end());
+
+        // ...and replace the closures of the changed classes (removing the deleted ones)
+        for (TAncestorMap::const_iterator Closure = DeltaAncestors.begin();
+            Closure != DeltaAncestors.end();
+            ++Closure
+            )
+        {
+            if (Closure->second.empty())
+                Ancestors.erase(Closure->first);
+            else
+                Ancestors[Closure->first] = Closure->second;
+        }
+
+        FBase = BuildLayer(Files, Ancestors);
+        FDelta.reset(new TLayer);
+
+        FReplacedFiles.clear();
+
+        FCount = FBase->Count;
+
+        // Build the search index over all names
+        BuildSearchIndex(NULL);
+    }
+
+    CS_SEND(
+        L"SymbolIndex::Load(End, "
+            + String(GetCount())
+            + L" tags, delta: "
+            + String(FDelta->Count)
+            + L", "
+            + String(GetTickCount() - StartTicks)
+            + L")"
+        );
+}
+//---------------------------------------------------------------------------
+
+void TChBldSymbolIndex::GetSymbolsByName(
+    const String& Name,
+    const String& Namespace,
+    Ctags::VTag& List,
+    TChBldSymbolKeys* Keys
+    ) const
+{
+    TChBldSymbolKeys LocalKeys;
+
+    // Without the keys of a previous lookup we have to get the keys of the symbols
+    // already in the list
+    if (!Keys)
+    {
+        Keys = &LocalKeys;
+        GetSymbolKeys(List, LocalKeys);
+    }
+
+    std::vector<TSymbolRef> Refs;
+
+    GetRefs(FBase->Names, FDelta->Names, Name, Refs);
+
+    foreach_ (const TSymbolRef& Ref, Refs)
+    {
+        if (Ref.File->Tags[Ref.Position].Namespace == Namespace)
+            AddSymbol(Ref, ~0U, ~0U, List, *Keys);
+    }
+}
+//---------------------------------------------------------------------------
+
+void TChBldSymbolIndex::GetObjectMembers(
+    const String& ObjectType,
+    unsigned int Kinds,
+    unsigned int Accesses,
+    Ctags::VTag& List,
+    TChBldSymbolKeys* Keys
+    ) const
+{
+    TChBldSymbolKeys LocalKeys;
+
+    // Without the keys of a previous lookup we have to get the keys of the symbols
+    // already in the list
+    if (!Keys)
+    {
+        Keys = &LocalKeys;
+        GetSymbolKeys(List, LocalKeys);
+    }
+
+    String ClassName        = Environment::ExtractToken(ObjectType);
+    String QualifiedSuffix  = L"::" + ObjectType;
+
+    // The scopes to get the members from (the object's classes and all their ancestors)
+    std::vector<std::pair<int, String> > Scopes;
+
+    // A class may be registered in both layers
+    std::unordered_set<String, TChBldStringHash> VisitedClasses;
+
+    const TNameMap* ClassMaps[] = { &FBase->ClassesByName, &FDelta->ClassesByName };
+
+    foreach_ (const TNameMap* ClassMap, ClassMaps)
+    {
+        TNameMap::const_iterator Classes = ClassMap->find(ClassName);
+
+        if (Classes == ClassMap->end())
+            continue;
+
+        foreach_ (const String& Class, Classes->second)
+        {
+            // The object type may be given with or without (a part of) its namespace
+            if ((Class != ObjectType) && !EndsText(QualifiedSuffix, Class))
+                continue;
+
+            if (!VisitedClasses.insert(Class).second)
+                continue;
+
+            const std::vector<TAncestor> *Ancestors = GetAncestors(Class);
+
+            // Skip the classes without a closure (e.g. deleted ones)
+            if (!Ancestors)
+                continue;
+
+            foreach_ (const TAncestor& Ancestor, *Ancestors)
+                Scopes.push_back(std::make_pair(Ancestor.Depth, Ancestor.Ancestor));
+        }
+    }
+
+    // The members of the nearest classes first
+    std::stable_sort(Scopes.begin(), Scopes.end(), IsLowerDepth);
+
+    std::vector<TSymbolRef> Refs;
+
+    for (std::size_t i = 0; i < Scopes.size(); ++i)
+    {
+        Refs.clear();
+
+        GetRefs(FBase->Scopes, FDelta->Scopes, Scopes[i].second, Refs);
+
+        foreach_ (const TSymbolRef& Ref, Refs)
+            AddSymbol(Ref, Kinds, Accesses, List, *Keys);
+    }
+}
+//---------------------------------------------------------------------------
+
+void TChBldSymbolIndex::GetNamespaceMembers(
+    const String& Namespace,
+    unsigned int Kinds,
+    unsigned int Accesses,
+    Ctags::VTag& List,
+    TChBldSymbolKeys* Keys
+    ) const
+{
+    TChBldSymbolKeys LocalKeys;
+
+    // Without the keys of a previous lookup we have to get the keys of the symbols
+    // already in the list
+    if (!Keys)
+    {
+        Keys = &LocalKeys;
+        GetSymbolKeys(List, LocalKeys);
+    }
+
+    const TRefMap* NamespaceMaps[] = { &FBase->Namespaces, &FDelta->Namespaces };
+
+    // There are only a few namespaces, so they're simply checked one by one
+    foreach_ (const TRefMap* NamespaceMap, NamespaceMaps)
+    {
+        for (TRefMap::const_iterator Refs = NamespaceMap->begin();
+            Refs != NamespaceMap->end();
+            ++Refs
+            )
+        {
+            if (!EndsText(Namespace, Refs->first))
+                continue;
+
+            foreach_ (const TSymbolRef& Ref, Refs->second)
+            {
+                if (!IsReplaced(Ref))
+                    AddSymbol(Ref, Kinds, Accesses, List, *Keys);
+            }
+        }
+    }
+}
+//---------------------------------------------------------------------------
+
+void TChBldSymbolIndex::FindSymbols(
+    const String& Query,
+    unsigned int Kinds,
+    int MaxResults,
+    Ctags::VTag& List,
+    TChBldSymbolKeys* Keys
+    ) const
+{
+    TChBldSymbolKeys LocalKeys;
+
+    // Without the keys of a previous lookup we have to get the keys of the symbols
+    // already in the list
+    if (!Keys)
+    {
+        Keys = &LocalKeys;
+        GetSymbolKeys(List, LocalKeys);
+    }
+
+    // A qualified query ('Editor::GetPos') searches the names by its last part, the
+    // qualified names of their tags have to contain the complete query
+    int ScopeEnd = Query.LastDelimiter(L":");
+
+    String NameQuery = Query.SubString(ScopeEnd + 1, Query.Length() - ScopeEnd);
+
+    if (NameQuery.IsEmpty() || !FSearchIndex)
+        return;
+
+    std::vector<std::pair<int, String> > Matches;
+
+    TChBldNameSearchIndexPtr SearchIndexes[] = { FSearchIndex, FSearchDelta };
+
+    // Get the matching names of the search index and its delta
+    foreach_ (const TChBldNameSearchIndexPtr& SearchIndex, SearchIndexes)
+    {
+        if (!SearchIndex)
+            continue;
+
+        std::vector<std::pair<int, int> > IDs;
+
+        SearchIndex->Find(NameQuery, IDs);
+
+        for (std::size_t i = 0; i < IDs.size(); ++i)
+            Matches.push_back(std::make_pair(IDs[i].first, SearchIndex->GetName(IDs[i].second)));
+    }
+
+    std::sort(Matches.begin(), Matches.end(), IsBetterMatch);
+
+    int Results = 0;
+
+    std::vector<TSymbolRef> Refs;
+
+    for (std::size_t i = 0; i < Matches.size(); ++i)
+    {
+        Refs.clear();
+
+        // The names which have no tags any more yield no symbols
+        GetRefs(FBase->Names, FDelta->Names, Matches[i].second, Refs);
+
+        foreach_ (const TSymbolRef& Ref, Refs)
+        {
+            if ((ScopeEnd > 0) && !ContainsText(Ref.File->Tags[Ref.Position].QualifiedName, Query))
+                continue;
+
+            std::size_t Count = List.size();
+
+            AddSymbol(Ref, Kinds, ~0U, List, *Keys);
+
+            if ((List.size() > Count) && (++Results == MaxResults))
+                return;
+        }
+    }
+}
+//---------------------------------------------------------------------------
+
+unsigned int TChBldSymbolIndex::GetKindBit(const String& Kind)
+{
+    if (Kind == L"macro")
+        return tkMacro;
+    else if (Kind == L"typedef")
+        return tkTypedef;
+    else if (Kind == L"namespace")
+        return tkNamespace;
+    else if (Kind == L"prototype")
+        return tkPrototype;
+    else if (Kind == L"function")
+        return tkFunction;
+    else if (Kind == L"implementation")
+        return tkImplementation;
+    else if (Kind == L"member")
+        return tkMember;
+    else if (Kind == L"class")
+        return tkClass;
+    else if (Kind == L"struct")
+        return tkStruct;
+    else if (Kind == L"variable")
+        return tkVariable;
+    else if (Kind == L"local")
+        return tkLocal;
+    else if (Kind == L"property")
+        return tkProperty;
+    else if (Kind == L"constructor")
+        return tkConstructor;
+    else if (Kind == L"destructor")
+        return tkDestructor;
+    else if (Kind == L"enum")
+        return tkEnum;
+    else if (Kind == L"enumerator")
+        return tkEnumerator;
+    else if (Kind == L"externvar")
+        return tkExternvar;
+    else
+        return tkOther;
+}
+//---------------------------------------------------------------------------
+
+unsigned int TChBldSymbolIndex::GetAccessBit(const String& Access)
+{
+    if (Access == L"public")
+        return taPublic;
+    else if (Access == L"protected")
+        return taProtected;
+    else if (Access == L"private")
+        return taPrivate;
+    else
+        return taNone;
+}
+//---------------------------------------------------------------------------
+
+Ctags::TTag TChBldSymbolIndex::ReadTag(SQLite::TStatement& Query)
+{
+    Ctags::TTag Tag;
+
+    Tag.Name            = Query.GetColumnAsString(1);
+    Tag.QualifiedName   = Query.GetColumnAsString(2);
+    Tag.File            = Query.GetColumnAsString(3);
+    Tag.Address         = Query.GetColumnAsString(4);
+    Tag.Kind            = Query.GetColumnAsString(5);
+    Tag.LineNo          = Query.GetColumnAsInt(6);
+    Tag.Namespace       = Query.GetColumnAsString(7);
+    Tag.Class           = Query.GetColumnAsString(8);
+    Tag.Struct          = Query.GetColumnAsString(9);
+    Tag.Access          = Query.GetColumnAsString(10);
+    Tag.Implementation  = Query.GetColumnAsString(11);
+    Tag.Signature       = Query.GetColumnAsString(12);
+    Tag.Typeref_A       = Query.GetColumnAsString(13);
+    Tag.Typeref_B       = Query.GetColumnAsString(14);
+    Tag.Inherits        = Query.GetColumnAsString(15);
+
+    return Tag;
+}
+//---------------------------------------------------------------------------
+
+// Reads the tags of a query grouped by their files (replacing the given files)
+void TChBldSymbolIndex::ReadFiles(SQLite::TStatement& Query, TFileMap& Files)
+{
+    std::unordered_map<String, boost::shared_ptr<TFileSymbols>, TChBldStringHash> NewFiles;
+
+    while (Query.ExecuteStep() != SQLITE_DONE)
+    {
+        Ctags::TTag Tag = ReadTag(Query);
+
+        boost::shared_ptr<TFileSymbols> &File = NewFiles[Tag.File];
+
+        if (!File)
+            File.reset(new TFileSymbols);
+
+        File->Kinds.push_back(GetKindBit(Tag.Kind));
+        File->Accesses.push_back(GetAccessBit(Tag.Access));
+        File->Tags.push_back(Tag);
+    }
+
+    for (std::unordered_map<String, boost::shared_ptr<TFileSymbols>, TChBldStringHash>::const_iterator
+            File = NewFiles.begin();
+        File != NewFiles.end();
+        ++File
+        )
+    {
+        Files[File->first] = File->second;
+    }
+}
+//---------------------------------------------------------------------------
+
+String TChBldSymbolIndex::GetScope(const Ctags::TTag& Tag)
+{
+    return Tag.Class.IsEmpty() ? Tag.Struct : Tag.Class;
+}
+//---------------------------------------------------------------------------
+
+String TChBldSymbolIndex::GetSymbolKey(const Ctags::TTag& Symbol)
+{
+    // Symbols with the same name, kind and type are shown only once (e.g. overridden
+    // methods of the ancestors)
+    return Symbol.Name + L"\n" + Symbol.Kind + L"\n" + Symbol.Typeref_B;
+}
+//---------------------------------------------------------------------------
+
+void TChBldSymbolIndex::GetSymbolKeys(const Ctags::VTag& List, TChBldSymbolKeys& Keys)
+{
+    foreach_ (const Ctags::TTag& Symbol, List)
+        Keys.insert(GetSymbolKey(Symbol));
+}
+//---------------------------------------------------------------------------
+
+// Loads the closures of the given classes (all if none are given), a class without any
+// closure gets an empty one
+void TChBldSymbolIndex::LoadAncestors(
+    SQLite::TDatabase& DB,
+    const std::set<String>* Classes,
+    TAncestorMap& Ancestors
+    )
+{
+    if (!Classes)
+    {
+        SQLite::TStatement QryGetAncestors(
+            DB,
+            L"SELECT Class, Ancestor, Depth FROM Ancestors "
+            L"ORDER BY Class, Depth;"
+            );
+
+        ReadAncestors(QryGetAncestors, Ancestors);
+    }
+    else if (!Classes->empty())
+    {
+        // The class name is bound (it's taken from the sources)
+        SQLite::TStatement QryGetAncestors(
+            DB,
+            L"SELECT Class, Ancestor, Depth FROM Ancestors "
+            L"WHERE Class = ?1 "
+            L"ORDER BY Depth;"
+            );
+
+        foreach_ (const String& Class, *Classes)
+        {
+            Ancestors[Class].clear();
+
+            QryGetAncestors.BindString(1, Class);
+
+            ReadAncestors(QryGetAncestors, Ancestors);
+
+            QryGetAncestors.Reset();
+        }
+    }
+}
+//---------------------------------------------------------------------------
+
+void TChBldSymbolIndex::ReadAncestors(SQLite::TStatement& Query, TAncestorMap& Ancestors)
+{
+    while (Query.ExecuteStep() != SQLITE_DONE)
+    {
+        TAncestor Ancestor;
+
+        Ancestor.Ancestor   = Query.GetColumnAsString(1);
+        Ancestor.Depth      = Query.GetColumnAsInt(2);
+
+        Ancestors[Query.GetColumnAsString(0)].push_back(Ancestor);
+    }
+}
+//---------------------------------------------------------------------------
+
+// Builds a layer with the lookup tables of the given files and closures (which are taken
+// over by the layer)
+TChBldSymbolIndex::TLayerPtr TChBldSymbolIndex::BuildLayer(TFileMap& Files, TAncestorMap& Ancestors)
+{
+    boost::shared_ptr<TLayer> Layer(new TLayer);
+
+    Layer->Files.swap(Files);
+    Layer->Ancestors.swap(Ancestors);
+
+    for (TFileMap::const_iterator File = Layer->Files.begin(); File != Layer->Files.end(); ++File)
+    {
+        const Ctags::VTag &Tags = File->second->Tags;
+
+        for (std::size_t i = 0; i < Tags.size(); ++i)
+        {
+            const Ctags::TTag &Tag = Tags[i];
+
+            TSymbolRef Ref = {File->second.get(), static_cast<int>(i)};
+
+            Layer->Names[Tag.Name].push_back(Ref);
+
+            if (!Tag.Namespace.IsEmpty())
+                Layer->Namespaces[Tag.Namespace].push_back(Ref);
+
+            String Scope = GetScope(Tag);
+
+            if (!Scope.IsEmpty())
+                Layer->Scopes[Scope].push_back(Ref);
+        }
+
+        Layer->Count += static_cast<int>(Tags.size());
+    }
+
+    // Register each class under its unqualified name (the deleted ones are found in the
+    // base layer only)
+    for (TAncestorMap::const_iterator Closure = Layer->Ancestors.begin();
+        Closure != Layer->Ancestors.end();
+        ++Closure
+        )
+    {
+        if (!Closure->second.empty())
+            Layer->ClassesByName[Environment::ExtractToken(Closure->first)].push_back(Closure->first);
+    }
+
+    return Layer;
+}
+//---------------------------------------------------------------------------
+
+void TChBldSymbolIndex::BuildSearchIndex(const TChBldSymbolIndex* Base)
+{
+    // With a shared base layer, its search index is shared as well
+    if (Base && Base->FSearchIndex)
+    {
+        TChBldNameSearchIndexPtr BaseIndex = Base->FSearchIndex;
+        TChBldNameSearchIndexPtr BaseDelta = Base->FSearchDelta;
+
+        VString DeltaNames;
+        bool    HasNewNames = false;
+
+        // Get the names of the delta layer which are not in the shared search index
+        for (TRefMap::const_iterator Refs = FDelta->Names.begin();
+            Refs != FDelta->Names.end();
+            ++Refs
+            )
+        {
+            if (BaseIndex->Contains(Refs->first))
+                continue;
+
+            DeltaNames.push_back(Refs->first);
+
+            if (!BaseDelta || !BaseDelta->Contains(Refs->first))
+                HasNewNames = true;
+        }
+
+        FSearchIndex = BaseIndex;
+
+        if (DeltaNames.empty())
+            FSearchDelta.reset();
+        else if (!HasNewNames && (static_cast<std::size_t>(BaseDelta->Count) == DeltaNames.size()))
+            FSearchDelta = BaseDelta;
+        else
+            FSearchDelta.reset(new TChBldNameSearchIndex(DeltaNames));
+
+        return;
+    }
+
+    VString Names;
+
+    Names.reserve(FBase->Names.size() + FDelta->Names.size());
+
+    // (Re)Build the search index over all names of both layers
+    for (TRefMap::const_iterator Refs = FBase->Names.begin(); Refs != FBase->Names.end(); ++Refs)
+        Names.push_back(Refs->first);
+
+    for (TRefMap::const_iterator Refs = FDelta->Names.begin(); Refs != FDelta->Names.end(); ++Refs)
+    {
+        if (FBase->Names.count(Refs->first) == 0)
+            Names.push_back(Refs->first);
+    }
+
+    FSearchIndex.reset(new TChBldNameSearchIndex(Names));
+    FSearchDelta.reset();
+}
+//---------------------------------------------------------------------------
+
+bool TChBldSymbolIndex::IsReplaced(const TSymbolRef& Ref) const
+{
+    return !FReplacedFiles.empty() && (FReplacedFiles.count(Ref.File) > 0);
+}
+//---------------------------------------------------------------------------
+
+// Gets the tags of a key from a lookup table of the base layer (skipping the ones of the
+// replaced files) and the one of the delta layer
+void TChBldSymbolIndex::GetRefs(
+    const TRefMap& BaseRefs,
+    const TRefMap& DeltaRefs,
+    const String& Key,
+    std::vector<TSymbolRef>& Refs
+    ) const
+{
+    const TRefMap* RefMaps[] = { &BaseRefs, &DeltaRefs };
+
+    foreach_ (const TRefMap* RefMap, RefMaps)
+    {
+        TRefMap::const_iterator KeyRefs = RefMap->find(Key);
+
+        if (KeyRefs == RefMap->end())
+            continue;
+
+        foreach_ (const TSymbolRef& Ref, KeyRefs->second)
+        {
+            if (!IsReplaced(Ref))
+                Refs.push_back(Ref);
+        }
+    }
+}
+//---------------------------------------------------------------------------
+
+// Gets the closure of a class (the ones of the delta layer replace the ones of the base
+// layer), NULL for an unknown or deleted class
+const std::vector<TChBldSymbolIndex::TAncestor>* TChBldSymbolIndex::GetAncestors(const String& Class) const
+{
+    TAncestorMap::const_iterator Ancestors = FDelta->Ancestors.find(Class);
+
+    if (Ancestors == FDelta->Ancestors.end())
+    {
+        Ancestors = FBase->Ancestors.find(Class);
+
+        if (Ancestors == FBase->Ancestors.end())
+            return NULL;
+    }
+
+    return Ancestors->second.empty() ? NULL : &Ancestors->second;
+}
+//---------------------------------------------------------------------------
+
+void TChBldSymbolIndex::AddSymbol(
+    const TSymbolRef& Ref,
+    unsigned int Kinds,
+    unsigned int Accesses,
+    Ctags::VTag& List,
+    TChBldSymbolKeys& Keys
+    ) const
+{
+    unsigned int Kind = Ref.File->Kinds[Ref.Position];
+
+    // Filter by kind and access
+    if (((Kind & Kinds) == 0) || ((Ref.File->Accesses[Ref.Position] & Accesses) == 0))
+        return;
+
+    const Ctags::TTag &Symbol = Ref.File->Tags[Ref.Position];
+
+    // Properties without a type are not shown
+    if ((Kind == tkProperty) && Symbol.Typeref_B.IsEmpty())
+        return;
+
+    // Add each symbol only once
+    if (Keys.insert(GetSymbolKey(Symbol)).second)
+        List.push_back(Symbol);
+}
+//---------------------------------------------------------------------------
+
+int TChBldSymbolIndex::GetCount() const
+{
+    return FCount;
+}
+//---------------------------------------------------------------------------
+
+} // namespace Cherrybuilder
@@ -0,0 +1,329 @@
+﻿/* ===============================================================================
+ * CherryBuilder - The Productivity Extension for C++Builder®
+ * ===============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2017 Florian Koch <flko@mail.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ===============================================================================
+ */
+
+#ifndef cherrybuilder_symbolindexH
+#define cherrybuilder_symbolindexH
+//---------------------------------------------------------------------------
+
+#include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <boost/shared_ptr.hpp>
+
+#include "cherrybuilder_environment.h"
+#include "cherrybuilder_sqlite.h"
+#include "cherrybuilder_ctags.h"
+//---------------------------------------------------------------------------
+
+namespace Cherrybuilder
+{
+
+// The tag kinds as bits (so the kinds can be filtered without comparing strings)
+enum TChBldTagKind : unsigned int
+{
+    tkOther             = 0x00000001,
+    tkMacro             = 0x00000002,
+    tkTypedef           = 0x00000004,
+    tkNamespace         = 0x00000008,
+    tkPrototype         = 0x00000010,
+    tkFunction          = 0x00000020,
+    tkImplementation    = 0x00000040,
+    tkMember            = 0x00000080,
+    tkClass             = 0x00000100,
+    tkStruct            = 0x00000200,
+    tkVariable          = 0x00000400,
+    tkLocal             = 0x00000800,
+    tkProperty          = 0x00001000,
+    tkConstructor       = 0x00002000,
+    tkDestructor        = 0x00004000,
+    tkEnum              = 0x00008000,
+    tkEnumerator        = 0x00010000,
+    tkExternvar         = 0x00020000
+};
+
+// The member access as bits
+enum TChBldTagAccess : unsigned int
+{
+    taNone              = 0x00000001,
+    taPublic            = 0x00000002,
+    taProtected         = 0x00000004,
+    taPrivate           = 0x00000008
+};
+//---------------------------------------------------------------------------
+
+// Hash functor for using 'String' as key of the unordered containers
+struct TChBldStringHash
+{
+    std::size_t operator()(const String& Str) const;
+};
+//---------------------------------------------------------------------------
+
+// The keys of the symbols in a result list (see 'TChBldSymbolIndex::GetSymbolKey'), kept
+// across the lookups filling the same list
+typedef std::unordered_set<String, TChBldStringHash> TChBldSymbolKeys;
+//---------------------------------------------------------------------------
+
+// How a name matches a search query (the better matches first)
+enum TChBldMatchRank
+{
+    mrPrefix            = 0,
+    mrCamelCase         = 1,
+    mrSubstring         = 2
+};
+//---------------------------------------------------------------------------
+
+// An immutable trigram and camel-case index over a set of names, which finds the names
+// containing a query (case-insensitive) or matching its humps ('gCEP' finds
+// 'GetCurrentEditorPos') without scanning all of them
+class TChBldNameSearchIndex
+{
+public:
+    explicit TChBldNameSearchIndex(const VString& Names);
+
+    bool Contains(const String& Name) const;
+    const String& GetName(int ID) const;
+
+    void Find(const String& Query, std::vector<std::pair<int, int> >& Matches) const;
+
+    static bool IsCamelCaseMatch(const String& Query, const String& Name);
+    static void GetHumps(const String& Text, VString& Humps, bool IsQuery);
+
+    __property int Count = {read=GetCount};
+
+private:
+    typedef std::unordered_map<unsigned long long, std::vector<int> > TTrigramMap;
+
+    static unsigned long long GetTrigram(const wchar_t* Chars);
+    static bool IsHumpStart(const String& Text, int Index, bool IsQuery);
+    static String GetInitials(const String& Text, bool IsQuery);
+
+    void FindSubstrings(const String& LowerQuery, std::vector<int>& IDs) const;
+
+    int GetCount() const;
+
+    // The names and their lower case variants (the position is the ID of a name)
+    VString                                             FNames;
+    VString                                             FLowerNames;
+
+    // Name -> ID
+    std::unordered_map<String, int, TChBldStringHash>   FNameIDs;
+
+    // Trigram of the lower case names -> ascending IDs of the names containing it
+    TTrigramMap                                         FTrigrams;
+
+    // The initials of the humps of each name (lower case), sorted for prefix lookups
+    std::vector<std::pair<String, int> >                FInitials;
+};
+//---------------------------------------------------------------------------
+
+typedef boost::shared_ptr<const TChBldNameSearchIndex> TChBldNameSearchIndexPtr;
+//---------------------------------------------------------------------------
+
+// An immutable in-memory image of the tags of a project database, which serves the code
+// completion lookups without SQL. A new index is built for each refresh and published
+// by the project DB, so readers keep using their snapshot until they're done. The index
+// consists of a large base layer, which is shared by the indexes of the following
+// refreshes, and a small delta layer with the files and ancestor closures changed since
+// then (replacing the ones of the base layer). Once the delta grows too large, both are
+// merged into a new base layer.
+class TChBldSymbolIndex
+{
+public:
+    TChBldSymbolIndex();
+
+    void Load(SQLite::TDatabase& DB);
+
+    void Load(
+        const TChBldSymbolIndex& Base,
+        SQLite::TDatabase& DB,
+        const std::set<String>& ChangedFiles,
+        const std::set<String>& ChangedClasses
+        );
+
+    void GetSymbolsByName(
+        const String& Name,
+        const String& Namespace,
+        Ctags::VTag& List,
+        TChBldSymbolKeys* Keys=NULL
+        ) const;
+
+    void GetObjectMembers(
+        const String& ObjectType,
+        unsigned int Kinds,
+        unsigned int Accesses,
+        Ctags::VTag& List,
+        TChBldSymbolKeys* Keys=NULL
+        ) const;
+
+    void GetNamespaceMembers(
+        const String& Namespace,
+        unsigned int Kinds,
+        unsigned int Accesses,
+        Ctags::VTag& List,
+        TChBldSymbolKeys* Keys=NULL
+        ) const;
+
+    void FindSymbols(
+        const String& Query,
+        unsigned int Kinds,
+        int MaxResults,
+        Ctags::VTag& List,
+        TChBldSymbolKeys* Keys=NULL
+        ) const;
+
+    static unsigned int GetKindBit(const String& Kind);
+    static unsigned int GetAccessBit(const String& Access);
+    static String GetScope(const Ctags::TTag& Tag);
+
+    static String GetSymbolKey(const Ctags::TTag& Symbol);
+    static void GetSymbolKeys(const Ctags::VTag& List, TChBldSymbolKeys& Keys);
+
+    __property int Count = {read=GetCount};
+
+private:
+    // The tags of a file with their kind and access bits (shared by the layers until the
+    // file changes)
+    struct TFileSymbols
+    {
+        Ctags::VTag                 Tags;
+        std::vector<unsigned int>   Kinds;
+        std::vector<unsigned int>   Accesses;
+    };
+
+    typedef boost::shared_ptr<const TFileSymbols> TFileSymbolsPtr;
+
+    // A tag of a file
+    struct TSymbolRef
+    {
+        const TFileSymbols  *File;
+        int                 Position;
+    };
+
+    // An entry of the ancestor closure of a class
+    struct TAncestor
+    {
+        String  Ancestor;
+        int     Depth;
+    };
+
+    typedef std::unordered_map<String, TFileSymbolsPtr, TChBldStringHash>           TFileMap;
+    typedef std::unordered_map<String, std::vector<TSymbolRef>, TChBldStringHash>   TRefMap;
+    typedef std::unordered_map<String, VString, TChBldStringHash>                   TNameMap;
+    typedef std::unordered_map<String, std::vector<TAncestor>, TChBldStringHash>    TAncestorMap;
+
+    // The files and ancestor closures of a layer with their lookup tables
+    struct TLayer
+    {
+        TLayer() : Count(0) {}
+
+        // File -> tags
+        TFileMap        Files;
+
+        // Tag name -> tags
+        TRefMap         Names;
+
+        // Namespace -> tags
+        TRefMap         Namespaces;
+
+        // Scope -> member tags
+        TRefMap         Scopes;
+
+        // Qualified class -> ancestor closure (ordered by depth, including the class
+        // itself; empty for a class of the base layer which has been deleted)
+        TAncestorMap    Ancestors;
+
+        // Unqualified class name -> qualified classes
+        TNameMap        ClassesByName;
+
+        // The number of tags
+        int             Count;
+    };
+
+    typedef boost::shared_ptr<const TLayer> TLayerPtr;
+
+    static Ctags::TTag ReadTag(SQLite::TStatement& Query);
+    static void ReadFiles(SQLite::TStatement& Query, TFileMap& Files);
+
+    static void LoadAncestors(
+        SQLite::TDatabase& DB,
+        const std::set<String>* Classes,
+        TAncestorMap& Ancestors
+        );
+
+    static void ReadAncestors(SQLite::TStatement& Query, TAncestorMap& Ancestors);
+
+    static TLayerPtr BuildLayer(TFileMap& Files, TAncestorMap& Ancestors);
+
+    void BuildSearchIndex(const TChBldSymbolIndex* Base);
+
+    bool IsReplaced(const TSymbolRef& Ref) const;
+
+    void GetRefs(
+        const TRefMap& BaseRefs,
+        const TRefMap& DeltaRefs,
+        const String& Key,
+        std::vector<TSymbolRef>& Refs
+        ) const;
+
+    const std::vector<TAncestor>* GetAncestors(const String& Class) const;
+
+    void AddSymbol(
+        const TSymbolRef& Ref,
+        unsigned int Kinds,
+        unsigned int Accesses,
+        Ctags::VTag& List,
+        TChBldSymbolKeys& Keys
+        ) const;
+
+    int GetCount() const;
+
+    TLayerPtr                   FBase;
+    TLayerPtr                   FDelta;
+
+    // The files of the base layer which have been changed or removed since then (their
+    // tags are skipped on lookup)
+    std::unordered_set<const TFileSymbols*> FReplacedFiles;
+
+    // The number of the current tags of both layers
+    int                         FCount;
+
+    // The search index over the tag names: As building it takes a while, the one of the
+    // base layer is shared and only the names of the delta layer missing in it are put
+    // into the small delta index (names without tags any more yield no symbols on lookup)
+    TChBldNameSearchIndexPtr    FSearchIndex;
+    TChBldNameSearchIndexPtr    FSearchDelta;
+};
+//---------------------------------------------------------------------------
+
+typedef boost::shared_ptr<const TChBldSymbolIndex> TChBldSymbolIndexPtr;
+//---------------------------------------------------------------------------
+
+} // namespace Cherrybuilder
+
+#endif
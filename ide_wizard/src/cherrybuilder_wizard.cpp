@@ -44,6 +44,8 @@ __fastcall TChBldWiz::TChBldWiz(_di_IBorlandIDEServices AIDESrv)
     :   FIDESrv(AIDESrv),
         FIDENotifier(NULL),
         FIDENotifierIndex(0),
+        FDebuggerNotifier(NULL),
+        FDebuggerNotifierIndex(0),
         FKeyBinder(NULL),
         FKeyBinderIndex(0),
         FCodeInsightManager(NULL),
@@ -99,7 +101,7 @@ void TChBldWiz::Init()
         );
 
     // Create CodeInsightManager object
-    TChBldCodeInsightManager *CIM = new TChBldCodeInsightManager(FSettingsINI, FProjectDB);
+    TChBldCodeInsightManager *CIM = new TChBldCodeInsightManager(FSettingsINI, FProjectDB, FAnalyzer);
 
     // Assign the interface
     FCodeInsightManager = CIM;
@@ -114,6 +116,13 @@ void TChBldWiz::Init()
     // Add it to the IDE
     FIDENotifierIndex = IDE::GetInterface<_di_IOTAServices>()->AddNotifier(FIDENotifier);
 
+    // Create DebuggerNotifier
+    FDebuggerNotifier = new TChBldDebuggerNotifier(FAnalyzer);
+
+    // Add it to the IDE
+    FDebuggerNotifierIndex =
+        IDE::GetInterface<_di_IOTADebuggerServices>()->AddNotifier(FDebuggerNotifier);
+
     // Create KeyBinder
     FKeyBinder = new TChBldKeyBinder(CIM);
 
@@ -171,6 +180,10 @@ void TChBldWiz::DeInit()
     if (FIDENotifierIndex > 0)
         IDE::GetInterface<_di_IOTAServices>()->RemoveNotifier(FIDENotifierIndex);
 
+    // Unregister DebuggerNotifier from the IDE
+    if (FDebuggerNotifierIndex > 0)
+        IDE::GetInterface<_di_IOTADebuggerServices>()->RemoveNotifier(FDebuggerNotifierIndex);
+
     // Unregister KeyBinder from the IDE
     if (FKeyBinderIndex > 0)
         IDE::GetInterface<_di_IOTAKeyboardServices>()->RemoveKeyboardBinding(FKeyBinderIndex);
@@ -320,10 +333,106 @@ void TChBldWiz::SettingsIniDefaultInit()
         1000
         );
 
+    FSettingsINI->WriteInteger(
+        L"CodeAnalyzer",
+        L"EditQuietPeriod",
+        300
+        );
+
     FSettingsINI->WriteInteger(
         L"CodeAnalyzer",
         L"DeepRefreshInterval",
-        600000
+        7200000
+        );
+
+    FSettingsINI->WriteInteger(
+        L"CodeAnalyzer",
+        L"WatchQuietPeriod",
+        500
+        );
+
+    FSettingsINI->WriteInteger(
+        L"CodeAnalyzer",
+        L"BusyTypingPeriod",
+        2000
+        );
+
+    FSettingsINI->WriteInteger(
+        L"CodeAnalyzer",
+        L"MaxCpuLoad",
+        80
+        );
+
+    FSettingsINI->WriteInteger(
+        L"CodeAnalyzer",
+        L"WriteChunkRows",
+        5000
+        );
+
+    FSettingsINI->WriteInteger(
+        L"CodeAnalyzer",
+        L"WriteChunkTime",
+        20
+        );
+
+    FSettingsINI->WriteInteger(
+        L"CodeAnalyzer",
+        L"TaggingWorkers",
+        2
+        );
+
+    FSettingsINI->WriteInteger(
+        L"CodeAnalyzer",
+        L"PipelineQueueDepth",
+        4
+        );
+
+    FSettingsINI->WriteInteger(
+        L"CodeAnalyzer",
+        L"IndexIdleTime",
+        1000
+        );
+
+    FSettingsINI->WriteInteger(
+        L"CodeAnalyzer",
+        L"IndexBatchFiles",
+        8
+        );
+
+    FSettingsINI->WriteInteger(
+        L"CodeAnalyzer",
+        L"IndexRescanInterval",
+        300000
+        );
+
+    FSettingsINI->WriteInteger(
+        L"CodeAnalyzer",
+        L"MaxDBVariants",
+        4
+        );
+
+    FSettingsINI->WriteInteger(
+        L"CodeAnalyzer",
+        L"CheckpointRows",
+        10000
+        );
+
+    FSettingsINI->WriteInteger(
+        L"CodeAnalyzer",
+        L"AnalyzeInterval",
+        1800000
+        );
+
+    FSettingsINI->WriteBool(
+        L"CodeAnalyzer",
+        L"ProfileQueries",
+        false
+        );
+
+    FSettingsINI->WriteInteger(
+        L"CodeAnalyzer",
+        L"SlowQueryTime",
+        50
         );
 
     // ...and save them
@@ -333,7 +442,9 @@ void TChBldWiz::SettingsIniDefaultInit()
 
 void __fastcall TChBldWiz::ToolsMenuClick(TObject* Sender)
 {
-    std::unique_ptr<TChBldSettingsForm> SettingsForm(new TChBldSettingsForm(NULL, FSettingsINI));
+    std::unique_ptr<TChBldSettingsForm> SettingsForm(
+        new TChBldSettingsForm(NULL, FSettingsINI, FProjectDB.QueryProfiler)
+        );
 
     if (SettingsForm->ShowModal() == mrOk)
         FAnalyzer->UpdateSettings();
@@ -75,6 +75,9 @@ private:
     _di_IOTAIDENotifier80       FIDENotifier;
     int                         FIDENotifierIndex;
 
+    _di_IOTADebuggerNotifier    FDebuggerNotifier;
+    int                         FDebuggerNotifierIndex;
+
     _di_IOTAKeyboardBinding     FKeyBinder;
     int                         FKeyBinderIndex;
 